@@ -0,0 +1,166 @@
+#include "quiet.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// simulated shared channel for carrier sense and tdma
+// 1 to 8 nodes always have a frame queued, and transmit on to one channel
+//   which is the sum of all of their output. a separate listener decodes
+//   the channel, so only frames which didn't collide get through. every
+//   node also runs a decoder on the channel, which its encoder listens to
+//   when carrier sense is on. with tdma, node n owns slot n of a cycle of
+//   one slot per node
+// goodput is what the listener received per second of channel time, and
+//   collided airtime is the share of time in which more than one node was
+//   transmitting at once
+// usage: bench_csma [profiles file] [profile name]
+
+#define MAX_NODES 8
+static const size_t block_len = 2048;
+static const float sim_seconds = 120;
+static const float sample_rate = 44100;
+static const size_t tdma_guard_len = 441;
+
+typedef enum { mac_none, mac_csma, mac_tdma } mac_t;
+static const char *mac_names[] = { "none", "csma", "tdma" };
+
+typedef struct {
+    size_t frames;
+    size_t bytes;
+} received_t;
+
+static void on_received(void *ctx, const uint8_t *payload, size_t payload_len,
+                        const quiet_decoder_frame_stats *stats) {
+    received_t *received = ctx;
+    received->frames++;
+    received->bytes += payload_len;
+}
+
+static void on_overheard(void *ctx, const uint8_t *payload, size_t payload_len,
+                         const quiet_decoder_frame_stats *stats) {}
+
+typedef struct {
+    quiet_encoder *e;
+    quiet_decoder *sense;
+    quiet_sample_t *block;
+    size_t sent;
+} node_t;
+
+static int run(const char *profiles_fname, const char *profile, size_t num_nodes,
+               mac_t mac) {
+    quiet_encoder_options *encodeopt = quiet_encoder_profile_filename(profiles_fname, profile);
+    quiet_decoder_options *decodeopt = quiet_decoder_profile_filename(profiles_fname, profile);
+    if (!encodeopt || !decodeopt) {
+        printf("could not read profile %s from %s\n", profile, profiles_fname);
+        return 1;
+    }
+
+    received_t received = { 0, 0 };
+    quiet_decoder *listener = quiet_decoder_create(decodeopt, sample_rate);
+    quiet_decoder_set_frame_callback(listener, on_received, &received);
+
+    node_t nodes[MAX_NODES];
+    for (size_t i = 0; i < num_nodes; i++) {
+        quiet_encoder_options nodeopt = *encodeopt;
+        if (mac == mac_tdma) {
+            nodeopt.tdma_num_slots = num_nodes;
+            nodeopt.tdma_slot_mask = 1u << i;
+            nodeopt.tdma_guard_len = tdma_guard_len;
+        }
+        nodes[i].e = quiet_encoder_create(&nodeopt, sample_rate);
+        nodes[i].sense = quiet_decoder_create(decodeopt, sample_rate);
+        quiet_decoder_set_frame_callback(nodes[i].sense, on_overheard, NULL);
+        if (mac == mac_csma) {
+            quiet_encoder_set_carrier_sense(nodes[i].e, nodes[i].sense);
+        }
+        nodes[i].block = malloc(block_len * sizeof(quiet_sample_t));
+        nodes[i].sent = 0;
+    }
+
+    size_t frame_len = quiet_encoder_get_frame_len(nodes[0].e);
+    uint8_t *frame = calloc(frame_len, 1);
+    quiet_sample_t *channel = malloc(block_len * sizeof(quiet_sample_t));
+
+    size_t num_blocks = sim_seconds * sample_rate / block_len;
+    size_t busy_blocks = 0, collided_blocks = 0;
+    for (size_t b = 0; b < num_blocks; b++) {
+        memset(channel, 0, block_len * sizeof(quiet_sample_t));
+        size_t transmitting = 0;
+        for (size_t i = 0; i < num_nodes; i++) {
+            node_t *n = &nodes[i];
+            if (quiet_encoder_queued_frames(n->e) == 0) {
+                // tag frames so that the decoder doesn't see repeats
+                frame[0] = i;
+                if (frame_len >= 1 + sizeof(size_t)) {
+                    memcpy(frame + 1, &n->sent, sizeof(size_t));
+                }
+                if (quiet_encoder_send(n->e, frame, frame_len) > 0) {
+                    n->sent++;
+                }
+            }
+            ssize_t written = quiet_encoder_emit(n->e, n->block, block_len);
+            if (written < 0) {
+                written = 0;
+            }
+            memset(n->block + written, 0, (block_len - written) * sizeof(quiet_sample_t));
+            bool is_loud = false;
+            for (size_t j = 0; j < block_len; j++) {
+                channel[j] += n->block[j];
+                is_loud |= n->block[j] != 0;
+            }
+            transmitting += is_loud;
+        }
+        busy_blocks += transmitting > 0;
+        collided_blocks += transmitting > 1;
+
+        quiet_decoder_consume(listener, channel, block_len);
+        for (size_t i = 0; i < num_nodes; i++) {
+            quiet_decoder_consume(nodes[i].sense, channel, block_len);
+        }
+    }
+    quiet_decoder_flush(listener);
+
+    size_t sent = 0, backoffs = 0;
+    float backoff_time = 0, slot_use = 0;
+    for (size_t i = 0; i < num_nodes; i++) {
+        // the frame still queued at the end never went out
+        sent += nodes[i].sent - quiet_encoder_queued_frames(nodes[i].e);
+        backoffs += quiet_encoder_backoffs(nodes[i].e);
+        backoff_time += quiet_encoder_backoff_time(nodes[i].e);
+        slot_use += quiet_encoder_tdma_utilization(nodes[i].e);
+    }
+    printf("%5zu  %4s  %7zu  %9zu  %12.1f  %12.1f%%  %8zu  %10.1f  %8.1f%%\n", num_nodes,
+           mac_names[mac], sent, received.frames, received.bytes / sim_seconds,
+           busy_blocks ? 100.0f * collided_blocks / busy_blocks : 0.0f, backoffs,
+           num_nodes ? backoff_time / num_nodes : 0.0f,
+           num_nodes ? 100.0f * slot_use / num_nodes : 0.0f);
+
+    for (size_t i = 0; i < num_nodes; i++) {
+        quiet_encoder_destroy(nodes[i].e);
+        quiet_decoder_destroy(nodes[i].sense);
+        free(nodes[i].block);
+    }
+    quiet_decoder_destroy(listener);
+    free(channel);
+    free(frame);
+    free(encodeopt);
+    free(decodeopt);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const char *profiles_fname = (argc > 1) ? argv[1] : "../tests/test-profiles.json";
+    const char *profile = (argc > 2) ? argv[2] : "modem";
+
+    printf("%5s  %4s  %7s  %9s  %12s  %13s  %8s  %10s  %9s\n", "nodes", "mac", "sent",
+           "received", "goodput B/s", "collided", "backoffs", "backoff s", "slot use");
+    for (size_t num_nodes = 1; num_nodes <= MAX_NODES; num_nodes++) {
+        for (mac_t mac = mac_none; mac <= mac_tdma; mac++) {
+            if (run(profiles_fname, profile, num_nodes, mac)) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
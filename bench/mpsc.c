@@ -0,0 +1,160 @@
+#include "quiet/mpsc.h"
+#include "quiet/ring_blocking.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+#include <sched.h>
+
+// producer-side benchmark for the encoder's frame queue
+// 1 to 16 threads send frames the way quiet_encoder_send does while a
+//   single consumer drains them the way quiet_encoder_emit does. this
+//   compares the lock-free mpsc queue with a shared ring_blocking writer,
+//   which is what every sender serializes on otherwise
+// reported latency is the mean time a producer spends inside one
+//   successful send, including any time spent waiting for the lock
+
+#define MAX_PRODUCERS 16
+static const size_t frame_len = 64;
+
+typedef struct {
+    mpsc_queue *q;
+    ring *buf;
+    size_t num_frames;
+    double send_time;
+} arg_t;
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void *produce_mpsc(void *arg_void) {
+    arg_t *arg = (arg_t*)arg_void;
+    uint8_t frame[64] = { 0 };
+    arg->send_time = 0;
+    for (size_t i = 0; i < arg->num_frames; ) {
+        double start = now_seconds();
+        ssize_t res = mpsc_enqueue(arg->q, frame, frame_len, 0);
+        if (res == 1) {
+            arg->send_time += now_seconds() - start;
+            i++;
+        } else {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+void *produce_ring(void *arg_void) {
+    arg_t *arg = (arg_t*)arg_void;
+    uint8_t record[sizeof(size_t) + 64] = { 0 };
+    memcpy(record, &frame_len, sizeof(size_t));
+    arg->send_time = 0;
+    for (size_t i = 0; i < arg->num_frames; ) {
+        double start = now_seconds();
+        ring_writer_lock(arg->buf);
+        ssize_t res = ring_write(arg->buf, record, sizeof(size_t) + frame_len);
+        ring_writer_unlock(arg->buf);
+        if (res > 0) {
+            arg->send_time += now_seconds() - start;
+            i++;
+        } else {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+void consume_mpsc(mpsc_queue *q, size_t num_frames) {
+    uint8_t frame[64];
+    for (size_t i = 0; i < num_frames; ) {
+        size_t len;
+        uint64_t deadline;
+        if (mpsc_dequeue(q, frame, sizeof(frame), &len, &deadline) == 1) {
+            i++;
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+void consume_ring(ring *buf, size_t num_frames) {
+    uint8_t frame[64];
+    for (size_t i = 0; i < num_frames; ) {
+        size_t len;
+        ring_reader_lock(buf);
+        ssize_t nread = ring_read(buf, &len, sizeof(size_t));
+        if (nread > 0) {
+            ring_read(buf, frame, len);
+            i++;
+        }
+        ring_reader_unlock(buf);
+        if (nread <= 0) {
+            sched_yield();
+        }
+    }
+}
+
+// returns elapsed wall time and fills in mean per-send latency
+double bench_producers(bool use_mpsc, size_t num_producers, size_t num_frames, double *latency) {
+    mpsc_queue *q = NULL;
+    ring *buf = NULL;
+    if (use_mpsc) {
+        q = mpsc_create((1 << 16) / (sizeof(mpsc_slot) + frame_len), frame_len);
+    } else {
+        buf = ring_create(1 << 16);
+        ring_set_exclusive_reader(buf);
+    }
+
+    arg_t args[MAX_PRODUCERS];
+    pthread_t producers[MAX_PRODUCERS];
+    size_t per_producer = num_frames / num_producers;
+    double start = now_seconds();
+    for (size_t i = 0; i < num_producers; i++) {
+        args[i].q = q;
+        args[i].buf = buf;
+        args[i].num_frames = per_producer;
+        pthread_create(&producers[i], NULL, use_mpsc ? produce_mpsc : produce_ring, &args[i]);
+    }
+    if (use_mpsc) {
+        consume_mpsc(q, per_producer * num_producers);
+    } else {
+        consume_ring(buf, per_producer * num_producers);
+    }
+    double send_time = 0;
+    for (size_t i = 0; i < num_producers; i++) {
+        pthread_join(producers[i], NULL);
+        send_time += args[i].send_time;
+    }
+    double elapsed = now_seconds() - start;
+
+    *latency = send_time / (per_producer * num_producers);
+    if (use_mpsc) {
+        mpsc_destroy(q);
+    } else {
+        ring_destroy(buf);
+    }
+    return elapsed;
+}
+
+int main(int argc, char **argv) {
+    size_t num_frames = (argc > 1) ? strtoul(argv[1], NULL, 10) : (1 << 21);
+    size_t producer_counts[] = { 1, 2, 4, 8, 16 };
+    size_t producer_counts_len = sizeof(producer_counts)/sizeof(size_t);
+
+    for (size_t i = 0; i < producer_counts_len; i++) {
+        size_t n = producer_counts[i];
+        double latency;
+        double elapsed = bench_producers(true, n, num_frames, &latency);
+        printf("mpsc          producers=%2zu: %12.0f ops/s, %8.3f us/send\n",
+               n, (num_frames / n * n) / elapsed, latency * 1e6);
+        elapsed = bench_producers(false, n, num_frames, &latency);
+        printf("ring_blocking producers=%2zu: %12.0f ops/s, %8.3f us/send\n",
+               n, (num_frames / n * n) / elapsed, latency * 1e6);
+    }
+
+    return 0;
+}
@@ -0,0 +1,211 @@
+#if BENCH_RING_ATOMIC
+#include "quiet/ring_atomic.h"
+static const char *ring_name = "ring_atomic";
+static const bool ring_can_block = false;
+#elif BENCH_RING_FUTEX
+#include "quiet/ring_futex.h"
+static const char *ring_name = "ring_futex";
+static const bool ring_can_block = true;
+#else
+#include "quiet/ring_blocking.h"
+static const char *ring_name = "ring_blocking";
+static const bool ring_can_block = true;
+#endif
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+#include <sched.h>
+
+// single producer, single consumer throughput benchmark
+// records are written the way quiet_encoder_send writes them (length prefix
+//   and payload in one write) and read the way quiet_decoder_recv reads them
+//   (length prefix, then payload), taking the ring locks around every call
+
+typedef struct {
+    ring *buf;
+    size_t num_records;
+    size_t payload_len;
+} arg_t;
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void *write_records(void *arg_void) {
+    arg_t *arg = (arg_t*)arg_void;
+    uint8_t *record = calloc(sizeof(size_t) + arg->payload_len, 1);
+    memcpy(record, &arg->payload_len, sizeof(size_t));
+    for (size_t i = 0; i < arg->num_records; ) {
+        ring_writer_lock(arg->buf);
+        ssize_t nwritten = ring_write(arg->buf, record, sizeof(size_t) + arg->payload_len);
+        ring_writer_unlock(arg->buf);
+        if (nwritten > 0) {
+            i++;
+        } else {
+            sched_yield();
+        }
+    }
+    free(record);
+    return NULL;
+}
+
+void *read_records(void *arg_void) {
+    arg_t *arg = (arg_t*)arg_void;
+    uint8_t *payload = malloc(arg->payload_len);
+    for (size_t i = 0; i < arg->num_records; ) {
+        size_t len;
+        ring_reader_lock(arg->buf);
+        ssize_t nread = ring_read(arg->buf, &len, sizeof(size_t));
+        if (nread > 0) {
+            ring_read(arg->buf, payload, len);
+            i++;
+        }
+        ring_reader_unlock(arg->buf);
+        if (nread <= 0) {
+            sched_yield();
+        }
+    }
+    free(payload);
+    return NULL;
+}
+
+// one thread alternates between writing and reading a batch of records
+// this measures the cost of the ring calls themselves without any
+//   scheduler effects, which dominate on machines with few cores
+double bench_interleaved(size_t num_records, size_t payload_len) {
+    ring *buf = ring_create(1 << 16);
+    ring_set_exclusive_writer(buf);
+    ring_set_exclusive_reader(buf);
+    uint8_t *record = calloc(sizeof(size_t) + payload_len, 1);
+    memcpy(record, &payload_len, sizeof(size_t));
+    uint8_t *payload = malloc(payload_len);
+    size_t batch = (1 << 15) / (sizeof(size_t) + payload_len);
+
+    double start = now_seconds();
+    for (size_t i = 0; i < num_records; i += batch) {
+        for (size_t j = 0; j < batch; j++) {
+            ring_writer_lock(buf);
+            ring_write(buf, record, sizeof(size_t) + payload_len);
+            ring_writer_unlock(buf);
+        }
+        for (size_t j = 0; j < batch; j++) {
+            size_t len;
+            ring_reader_lock(buf);
+            ring_read(buf, &len, sizeof(size_t));
+            ring_read(buf, payload, len);
+            ring_reader_unlock(buf);
+        }
+    }
+    double elapsed = now_seconds() - start;
+
+    free(record);
+    free(payload);
+    ring_destroy(buf);
+    return elapsed;
+}
+
+typedef struct {
+    ring *ping;
+    ring *pong;
+    size_t num_trips;
+} pingpong_t;
+
+void *echo_records(void *arg_void) {
+    pingpong_t *arg = (pingpong_t*)arg_void;
+    uint64_t token;
+    for (size_t i = 0; i < arg->num_trips; i++) {
+        ring_reader_lock(arg->ping);
+        ring_read(arg->ping, &token, sizeof(token));
+        ring_reader_unlock(arg->ping);
+        ring_writer_lock(arg->pong);
+        ring_write(arg->pong, &token, sizeof(token));
+        ring_writer_unlock(arg->pong);
+    }
+    return NULL;
+}
+
+// two threads bounce a token back and forth through a pair of rings, with
+//   both readers in blocking mode. every read finds the ring empty, so
+//   this measures how quickly a blocked reader is woken by a write
+double bench_wake_latency(size_t num_trips) {
+    pingpong_t args = {
+        .ping = ring_create(1 << 12),
+        .pong = ring_create(1 << 12),
+        .num_trips = num_trips,
+    };
+    ring_set_reader_blocking(args.ping, 0, 0);
+    ring_set_reader_blocking(args.pong, 0, 0);
+
+    pthread_t echo;
+    pthread_create(&echo, NULL, echo_records, &args);
+
+    double start = now_seconds();
+    for (uint64_t i = 0; i < num_trips; i++) {
+        uint64_t token = i;
+        ring_writer_lock(args.ping);
+        ring_write(args.ping, &token, sizeof(token));
+        ring_writer_unlock(args.ping);
+        ring_reader_lock(args.pong);
+        ring_read(args.pong, &token, sizeof(token));
+        ring_reader_unlock(args.pong);
+    }
+    double elapsed = now_seconds() - start;
+
+    pthread_join(echo, NULL);
+    ring_destroy(args.ping);
+    ring_destroy(args.pong);
+    // each round trip is two wakeups
+    return elapsed / (2 * num_trips);
+}
+
+int main(int argc, char **argv) {
+    size_t payload_lens[] = { 16, 64, 256, 1024 };
+    size_t payload_lens_len = sizeof(payload_lens)/sizeof(size_t);
+    size_t num_records = (argc > 1) ? strtoul(argv[1], NULL, 10) : (1 << 22);
+
+    for (size_t i = 0; i < payload_lens_len; i++) {
+        ring *buf = ring_create(1 << 16);
+        ring_set_exclusive_writer(buf);
+        ring_set_exclusive_reader(buf);
+        if (ring_can_block) {
+            // let the ring put each side to sleep rather than spinning on it
+            ring_set_reader_blocking(buf, 0, 0);
+            ring_set_writer_blocking(buf, 0, 0);
+        }
+        arg_t args = {
+            .buf = buf,
+            .num_records = num_records,
+            .payload_len = payload_lens[i],
+        };
+        pthread_t w, r;
+        double start = now_seconds();
+        pthread_create(&w, NULL, write_records, &args);
+        pthread_create(&r, NULL, read_records, &args);
+        pthread_join(w, NULL);
+        pthread_join(r, NULL);
+        double elapsed = now_seconds() - start;
+        ring_destroy(buf);
+
+        double ops = num_records / elapsed;
+        double mbytes = (num_records * (sizeof(size_t) + payload_lens[i])) / elapsed / 1e6;
+        printf("%s threaded    payload_len=%5zu: %12.0f ops/s, %8.1f MB/s\n",
+               ring_name, payload_lens[i], ops, mbytes);
+
+        elapsed = bench_interleaved(num_records, payload_lens[i]);
+        ops = num_records / elapsed;
+        mbytes = (num_records * (sizeof(size_t) + payload_lens[i])) / elapsed / 1e6;
+        printf("%s interleaved payload_len=%5zu: %12.0f ops/s, %8.1f MB/s\n",
+               ring_name, payload_lens[i], ops, mbytes);
+    }
+
+    if (ring_can_block) {
+        size_t num_trips = (argc > 2) ? strtoul(argv[2], NULL, 10) : (1 << 16);
+        double latency = bench_wake_latency(num_trips);
+        printf("%s wake latency: %8.2f us\n", ring_name, latency * 1e6);
+    }
+    return 0;
+}
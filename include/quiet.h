@@ -27,6 +27,8 @@ typedef enum {
     quiet_would_block,
     quiet_timedout,
     quiet_io,
+    quiet_decoder_bad_config,
+    quiet_invalid_argument,
 } quiet_error;
 
 /**
@@ -429,6 +431,71 @@ typedef enum encodings {
     gmsk_encoding,
 } quiet_encoding_t;
 
+/**
+ * @enum quiet_overflow_policy_t
+ * Queue overflow policy
+ *
+ * Selects what happens when a frame is added to a full queue, either by
+ * quiet_encoder_send or by the decoder after it receives a frame.
+ */
+typedef enum quiet_overflow_policies {
+    /**
+     * Discard the newest frame
+     *
+     * For the encoder, quiet_encoder_send refuses the frame, as it always
+     * has, and reports quiet_would_block (or waits, if
+     * quiet_encoder_set_blocking has been called). For the decoder, the
+     * received frame is discarded and counted as dropped.
+     */
+    quiet_overflow_drop_newest,
+
+    /**
+     * Discard the oldest frames
+     *
+     * Queued frames are discarded, oldest first, until the new frame fits.
+     * Discarded frames are counted as dropped. quiet_encoder_send never
+     * blocks under this policy.
+     */
+    quiet_overflow_drop_oldest,
+
+    /**
+     * Wait for room
+     *
+     * The writer waits until the reader has made room. For the encoder
+     * this is the same as calling quiet_encoder_set_blocking with no
+     * timeout. For the decoder, quiet_decoder_consume waits for
+     * quiet_decoder_recv to read frames. Only available when libquiet is
+     * built with a ring which supports blocking.
+     */
+    quiet_overflow_block,
+} quiet_overflow_policy_t;
+
+/// Most priority classes an encoder can have
+enum { quiet_max_priorities = 4 };
+
+/**
+ * Adaptation level
+ *
+ * One set of frame schemes which an encoder may switch to when the
+ * channel allows it. See adaptation_levels in quiet_encoder_options.
+ */
+typedef struct {
+    quiet_checksum_scheme_t checksum_scheme;
+    quiet_error_correction_scheme_t inner_fec_scheme;
+    quiet_error_correction_scheme_t outer_fec_scheme;
+    /// Ignored by gmsk_encoding, which has only the one modulation
+    quiet_modulation_scheme_t mod_scheme;
+
+    /**
+     * Highest error vector magnitude this level is used at, in dB
+     *
+     * Compared against the average of the error vector magnitudes given to
+     * quiet_encoder_report_frame_stats. Lower values mean a cleaner
+     * channel.
+     */
+    float max_error_vector_magnitude;
+} quiet_adaptation_level;
+
 /**
  * Encoder options
  *
@@ -475,6 +542,267 @@ typedef struct {
      * decode than longer frames.
      */
     size_t frame_len;
+
+    /**
+     * Length of frame queue, in bytes
+     *
+     * Frames wait in this queue between quiet_encoder_send and
+     * quiet_encoder_emit. Each queued frame uses its length plus a
+     * header of sizeof(size_t) + 8 bytes. 0 selects the default of 64KiB.
+     * If set, it must be large enough to hold one frame of frame_len.
+     */
+    size_t queue_len;
+
+    /// What to do when quiet_encoder_send finds the queue full
+    quiet_overflow_policy_t overflow_policy;
+
+    /**
+     * Use a lock-free multi-producer frame queue
+     *
+     * When set, any number of threads may call quiet_encoder_send at once
+     * without serializing on a lock, and quiet_encoder_emit takes frames
+     * without locking. Each frame occupies a fixed slot of frame_len bytes
+     * plus a small header, so queue_len holds fewer short frames than it
+     * would otherwise.
+     *
+     * In this mode quiet_encoder_send never blocks,
+     * quiet_encoder_get_fd is unavailable, and overflow_policy must be
+     * quiet_overflow_drop_newest.
+     */
+    bool multi_producer;
+
+    /**
+     * Number of priority classes
+     *
+     * Each class has its own queue of queue_len bytes. Class 0 is the most
+     * urgent, and quiet_encoder_send uses the least urgent class,
+     * num_priorities - 1. 0 and 1 both give a single queue. At most
+     * quiet_max_priorities, and may not be combined with multi_producer.
+     */
+    size_t num_priorities;
+
+    /**
+     * Share of transmissions for each priority class
+     *
+     * If every weight is 0, then quiet_encoder_emit always sends from the
+     * most urgent class which has frames queued (strict priority).
+     * Otherwise, classes with a nonzero weight take turns, each sending up
+     * to its weight in frames per round, and classes with a weight of 0
+     * only send when every weighted class is empty.
+     *
+     * With either scheme, a frame which has been taken from its queue but
+     * has not yet started transmitting gives way to a newly queued frame
+     * of a more urgent class, and goes back to the front of its own queue.
+     */
+    unsigned int priority_weights[quiet_max_priorities];
+
+    /**
+     * Keep frames from straddling calls to quiet_encoder_emit
+     *
+     * When set, a frame which would not finish within the rest of the
+     * current block of samples, but which would fit in a whole block, is
+     * held until the next call to quiet_encoder_emit and the current block
+     * ends in silence. Once a block which carries such a frame has been
+     * returned, the encoder has nothing left of it to render, so the
+     * frame's latency is bounded by the audio buffering downstream of
+     * emit. Frames longer than a block still span calls, starting at the
+     * beginning of one. quiet_encoder_pending_samples reports what the
+     * encoder is still holding.
+     */
+    bool low_latency;
+
+    /**
+     * Number of rendered frames to keep for reuse
+     *
+     * When nonzero, the encoder keeps the samples of up to this many
+     * recently sent frames, keyed by payload, and replays them instead of
+     * rendering the same payload again. This suits beacons which repeat a
+     * few payloads, as replaying costs little more than a copy. The
+     * least recently sent payload is evicted first.
+     *
+     * Only frames which start after the modulator has gone idle are
+     * cached or replayed, and each of them ends with the same flush that
+     * follows the last frame of a burst. This adds a short gap after
+     * each such frame, which keeps the output identical to rendering it.
+     *
+     * The cache is disabled when frame_repeats is set, as each frame then
+     * carries a sequence number and never renders the same way twice.
+     */
+    size_t waveform_cache_len;
+
+    /**
+     * Pack several messages in to each frame
+     *
+     * When set, quiet_encoder_emit fills each frame with as many queued
+     * messages as fit in frame_len, each prefixed by its length as a
+     * big-endian 16 bit integer, so that small messages share one
+     * preamble, header and checksum. Messages are never split across
+     * frames, and quiet_encoder_get_frame_len is reduced by the size of
+     * the prefix. The receiving decoder must also set aggregate.
+     *
+     * Messages taken from different priority classes may share a frame,
+     * and a frame is never preempted once its messages have been taken.
+     */
+    bool aggregate;
+
+    /**
+     * Longest time to wait for a frame to fill, in milliseconds
+     *
+     * Used only with aggregate. A frame which still has room is held back
+     * until this long after its first message was taken from the queue,
+     * in case more messages arrive. 0 sends whatever is queued right away.
+     */
+    unsigned int aggregation_linger_ms;
+
+    /**
+     * Largest frame to send while messages are backed up, in bytes
+     *
+     * Used only with aggregate. A frame normally holds up to frame_len
+     * bytes of messages, but if more messages are already waiting once
+     * it's full, the encoder keeps packing them in to the same frame up
+     * to this length. A busy queue is then sent with one preamble and
+     * header for many messages, which the decoder splits as usual. 0, or
+     * anything at most frame_len, disables this.
+     * quiet_encoder_clamp_frame_len also disables it.
+     */
+    size_t burst_frame_len;
+
+    /**
+     * Erasure coded segments added to each message, as a percentage
+     *
+     * Used only by quiet_encoder_send_message. A message split in to k
+     * segments is sent with ceil(k * message_parity_percent / 100) extra
+     * parity segments, and quiet_decoder_recv_message can rebuild it from
+     * any k of them. This lets a one-way link ride out lost frames without
+     * retransmission. With parity, a message may use at most 256 segments
+     * in total. 0 sends no parity.
+     */
+    unsigned int message_parity_percent;
+
+    /**
+     * Extra copies of each frame to send
+     *
+     * Each frame is sent this many more times, back to back, behind a one
+     * byte sequence number which lets the decoder tell the copies apart
+     * from new frames. The decoder receives the first copy which passes
+     * its checksum and ignores the rest, and with modem_encoding it also
+     * combines copies which fail, so that two weak copies can still be
+     * received. quiet_encoder_get_frame_len is reduced by the size of the
+     * sequence number. The receiving decoder must set frame_repeats to the
+     * same value. 0 sends each frame once.
+     */
+    unsigned int frame_repeats;
+
+    /**
+     * Compress messages before they are queued
+     *
+     * When set, each message given to quiet_encoder_send or the other send
+     * functions is compressed with a fast lz77 coder and prefixed with a
+     * flag byte which says whether it was. A message which compression
+     * doesn't shorten is sent as it is, so it costs only the flag.
+     * quiet_encoder_get_frame_len is reduced by the size of the flag. The
+     * receiving decoder must also set compress, with the same dictionary.
+     */
+    bool compress;
+
+    /**
+     * Bytes which messages are likely to have in common
+     *
+     * Used only with compress. A short message has little history of its
+     * own for the compressor to refer back to, so it may also refer to
+     * this, e.g. a typical message or the keys it usually contains. Only
+     * the last 65535 bytes are used. The encoder keeps its own copy. NULL
+     * for none.
+     */
+    const uint8_t *compression_dictionary;
+    size_t compression_dictionary_len;
+
+    /**
+     * Faster schemes to switch to while the channel allows
+     *
+     * The encoder starts out with its own schemes above, which should suit
+     * the worst channel expected. Each level here should be faster than
+     * the one before it. As quiet_encoder_report_frame_stats brings back
+     * news of how frames are received, each new frame is sent with the
+     * fastest level whose max_error_vector_magnitude the channel meets,
+     * or with the encoder's own schemes if it meets none of them. Every
+     * frame header already describes the schemes of its frame, so the
+     * decoder follows along without any configuration.
+     *
+     * Airtime estimates, including quiet_encoder_clamp_frame_len and the
+     * length of TDMA slots, use whichever of the encoder's own schemes
+     * and these levels takes longest for each frame length, so they hold
+     * whichever level is in use. The encoder keeps its own copy. NULL for
+     * none.
+     */
+    const quiet_adaptation_level *adaptation_levels;
+    size_t num_adaptation_levels;
+
+    /**
+     * Length of one backoff slot, in milliseconds
+     *
+     * Used only once quiet_encoder_set_carrier_sense has been called. This
+     * should be at least as long as the listening decoder takes to notice
+     * a transmission, which is mostly the block size given to
+     * quiet_decoder_consume. 0 selects the default of 50ms.
+     */
+    unsigned int csma_slot_ms;
+
+    /**
+     * Largest number of slots to pick a backoff from
+     *
+     * Used only once quiet_encoder_set_carrier_sense has been called. The
+     * window starts at 2 slots and doubles each time the channel is found
+     * busy, up to this many. 0 selects the default of 32.
+     */
+    unsigned int csma_max_window;
+
+    /**
+     * Number of slots in each TDMA cycle
+     *
+     * When set, time on the channel is divided in to a repeating cycle of
+     * this many slots, and the encoder only transmits in the slots given
+     * by tdma_slot_mask. Each frame starts at least tdma_guard_len samples
+     * in to one of those slots and ends at least tdma_guard_len samples
+     * before it ends, so encoders which share a channel and own different
+     * slots never overlap. Time is counted in the samples written by
+     * quiet_encoder_emit, which in this mode always fills its buffer,
+     * writing silence while it waits for a slot. See
+     * quiet_encoder_set_tdma_clock to line encoders up with each other. At
+     * most 32. 0 disables TDMA.
+     */
+    unsigned int tdma_num_slots;
+
+    /**
+     * Slots which this encoder may transmit in
+     *
+     * Used only with tdma_num_slots. Bit n is set if the encoder owns slot
+     * n of each cycle. At least one of the first tdma_num_slots bits must
+     * be set.
+     */
+    uint32_t tdma_slot_mask;
+
+    /**
+     * Length of each TDMA slot, in samples at the encoder's sample rate
+     *
+     * Used only with tdma_num_slots. A slot must have room for the longest
+     * frame the encoder sends, including its flush, between its guard
+     * intervals. 0 selects exactly that length, worked out from the same
+     * airtime model as quiet_encoder_frame_airtime. Every encoder on the
+     * channel must use the same slot length, so set this explicitly if
+     * their frame options differ.
+     */
+    size_t tdma_slot_len;
+
+    /**
+     * Silence kept at each end of a TDMA slot, in samples at the
+     * encoder's sample rate
+     *
+     * Used only with tdma_num_slots. This absorbs drift between the clocks
+     * of encoders sharing the channel, and the difference between their
+     * frames' airtime estimates and the samples actually written.
+     */
+    size_t tdma_guard_len;
 } quiet_encoder_options;
 
 /**
@@ -523,6 +851,103 @@ typedef struct {
      * behavior.
      */
     bool is_debug;
+
+    /**
+     * Length of received frame queue, in bytes
+     *
+     * Frames wait in this queue between being decoded and
+     * quiet_decoder_recv. Each queued frame uses its length plus
+     * sizeof(size_t). 0 selects the default of 64KiB.
+     */
+    size_t queue_len;
+
+    /**
+     * Length of frame stats queue, in bytes
+     *
+     * Used only once quiet_decoder_enable_stats has been called. Each
+     * frame's stats use roughly 8 bytes per received symbol. 0 selects the
+     * default of 64KiB.
+     */
+    size_t stats_queue_len;
+
+    /// What to do when a received frame does not fit in the queue
+    quiet_overflow_policy_t overflow_policy;
+
+    /**
+     * Number of frames kept for subscribers
+     *
+     * Used only while quiet_decoder_subscribe has subscribers. A
+     * subscriber may fall this many frames behind the decoder before its
+     * overflow policy applies. 0 selects the default of 64 frames.
+     */
+    size_t broadcast_queue_len;
+
+    /**
+     * Split each frame in to the messages packed in to it
+     *
+     * Set this to receive from an encoder which has aggregate set. Each
+     * message is then received separately by quiet_decoder_recv, or by
+     * whichever other consumer is attached. If a frame's framing is
+     * inconsistent, the messages before the fault are still received and
+     * the rest of the frame is counted as dropped.
+     */
+    bool aggregate;
+
+    /**
+     * Copies of each frame sent after the first
+     *
+     * Set this to receive from an encoder which has frame_repeats set, to
+     * the same value. Only the first copy of each frame to pass its
+     * checksum is received. With modem_encoding, the payload symbols of
+     * copies which fail their checksum are averaged and decoded again
+     * before the error correction, so that noise which ruins each copy
+     * alone is partly cancelled out. Copies are matched by the sequence
+     * number in their frame header, so a failed copy is never averaged
+     * with another frame's, nor with a frame which was already received.
+     */
+    unsigned int frame_repeats;
+
+    /**
+     * Decompress each received message
+     *
+     * Set this, and the same compression_dictionary, to receive from an
+     * encoder which has compress set. Messages are decompressed before
+     * they are received by any consumer. A message which fails to
+     * decompress, or which would decompress to more than 64KiB, is counted
+     * as dropped.
+     */
+    bool compress;
+
+    /// Must match the encoder's compression_dictionary. The decoder keeps its own copy.
+    const uint8_t *compression_dictionary;
+    size_t compression_dictionary_len;
+
+    /**
+     * Input power above which the channel counts as busy, in dB
+     *
+     * Used by quiet_decoder_channel_busy, relative to a full scale sine's
+     * power of 0.5. This should sit above the background noise of the
+     * microphone and room. 0 selects the default of -50dB, as with the
+     * other options, so a threshold of exactly 0dB can't be chosen. Since
+     * that is a full scale signal, a value just below it such as -0.1dB
+     * serves the same purpose.
+     */
+    float carrier_sense_threshold;
+
+    /**
+     * Number of messages quiet_decoder_recv_message can reassemble at once
+     *
+     * 0 selects the default of 4.
+     */
+    size_t reassembly_slots;
+
+    /**
+     * Memory for messages being reassembled, in bytes
+     *
+     * Each message in progress uses its full length, and a message longer
+     * than this can never be received. 0 selects the default of 256KiB.
+     */
+    size_t reassembly_len;
 } quiet_decoder_options;
 
 /**
@@ -753,6 +1178,83 @@ quiet_encoder *quiet_encoder_create(const quiet_encoder_options *opt, float samp
  */
 ssize_t quiet_encoder_send(quiet_encoder *e, const void *buf, size_t len);
 
+/**
+ * Send a message of any length
+ * @param e encoder object
+ * @param buf user buffer containing the message
+ * @param len the number of bytes in buf
+ *
+ * quiet_encoder_send_message splits a message which may be longer than
+ * the encoder's frame length in to segments and queues each of them as a
+ * frame. Every segment carries a small header with the message's id,
+ * length and crc32 and the segment's position, so the receiver can put
+ * the message back together with quiet_decoder_recv_message even if
+ * segments arrive out of order.
+ *
+ * If message_parity_percent is set, erasure coded parity segments follow
+ * the data segments, so that the message survives the loss of as many
+ * segments as there are parity segments.
+ *
+ * Segments are queued one after another in the least urgent class, and
+ * can be interleaved with frames from other threads. If the queue fills
+ * partway through, the segments already queued are still sent, and the
+ * receiver eventually discards the incomplete message.
+ *
+ * quiet_encoder_send_message will return a negative value and set the
+ * last error to quiet_msg_size if the frame length is too short to hold
+ * a segment header, or if the message would need more than 65535
+ * segments, or more than 256 including parity.
+ *
+ * @return len if every segment was queued, 0 if the queue is closed, or
+ * -1 if sending failed
+ */
+ssize_t quiet_encoder_send_message(quiet_encoder *e, const void *buf, size_t len);
+
+/**
+ * Send a single frame with a given priority
+ * @param e encoder object
+ * @param buf user buffer containing the frame payload
+ * @param len the number of bytes in buf
+ * @param priority priority class, 0 being the most urgent
+ *
+ * quiet_encoder_send_priority behaves as quiet_encoder_send, but queues
+ * the frame in the given priority class. Each class has its own queue, so
+ * a full queue in one class does not hold back the others. See
+ * quiet_encoder_options.priority_weights for how classes are chosen.
+ *
+ * quiet_encoder_send_priority will return a negative value and set the
+ * last error to quiet_invalid_argument if priority is not less than the
+ * encoder's num_priorities.
+ *
+ * @return the number of bytes copied from the buffer, 0 if the queue
+ * is closed, or -1 if sending failed
+ */
+ssize_t quiet_encoder_send_priority(quiet_encoder *e, const void *buf, size_t len,
+                                    unsigned int priority);
+
+/**
+ * Send a single frame which expires
+ * @param e encoder object
+ * @param buf user buffer containing the frame payload
+ * @param len the number of bytes in buf
+ * @param sec seconds the frame may wait before it starts transmitting
+ * @param nano nanoseconds the frame may wait before it starts transmitting
+ *
+ * quiet_encoder_send_ttl behaves as quiet_encoder_send, but gives the frame
+ * a time to live, measured from this call. If the frame is still queued
+ * once its time to live has passed, then quiet_encoder_emit discards it
+ * without modulating it and moves on to the next frame. Discarded frames
+ * are counted by quiet_encoder_expired_frames. With aggregate, a message
+ * which expires while it waits for its aggregate to fill is left out of
+ * it in the same way. A frame which has already started transmitting is
+ * always sent in full.
+ *
+ * @return the number of bytes copied from the buffer, 0 if the queue
+ * is closed, or -1 if sending failed
+ */
+ssize_t quiet_encoder_send_ttl(quiet_encoder *e, const void *buf, size_t len, time_t sec,
+                               long nano);
+
 /**
  * Set blocking mode of quiet_encoder_send
  * @param e encoder object
@@ -770,6 +1272,9 @@ ssize_t quiet_encoder_send(quiet_encoder *e, const void *buf, size_t len);
  * quiet_encoder_set_blocking on a host without pthread will assert
  * false.
  *
+ * This has no effect if the encoder's overflow_policy is
+ * quiet_overflow_drop_oldest, as quiet_encoder_send never waits then.
+ *
  */
 void quiet_encoder_set_blocking(quiet_encoder *e, time_t sec, long nano);
 
@@ -785,6 +1290,170 @@ void quiet_encoder_set_blocking(quiet_encoder *e, time_t sec, long nano);
  */
 void quiet_encoder_set_nonblocking(quiet_encoder *e);
 
+/**
+ * Return number of expired frames
+ * @param e encoder object
+ *
+ * quiet_encoder_expired_frames returns the total number of frames sent
+ * with quiet_encoder_send_ttl which were discarded because their time to
+ * live passed before they could be transmitted.
+ *
+ * @return Total number of expired frames
+ */
+size_t quiet_encoder_expired_frames(quiet_encoder *e);
+
+/**
+ * Return number of queued frames
+ * @param e encoder object
+ *
+ * quiet_encoder_queued_frames returns the number of frames waiting in the
+ * transmit queue, across every priority class. A frame which
+ * quiet_encoder_emit has already started to transmit is not counted.
+ * While senders are active the value is a snapshot and may briefly
+ * include frames whose quiet_encoder_send has not yet returned.
+ *
+ * @return Number of frames queued
+ */
+size_t quiet_encoder_queued_frames(quiet_encoder *e);
+
+/**
+ * Return number of queued payload bytes
+ * @param e encoder object
+ *
+ * quiet_encoder_queued_bytes returns the total payload length of the
+ * frames counted by quiet_encoder_queued_frames.
+ *
+ * @return Number of payload bytes queued
+ */
+size_t quiet_encoder_queued_bytes(quiet_encoder *e);
+
+/**
+ * Return number of samples the encoder is holding
+ * @param e encoder object
+ *
+ * quiet_encoder_pending_samples returns how many samples quiet_encoder_emit
+ * will produce before it starts on anything still waiting in the transmit
+ * queue. This counts samples already rendered but not yet returned, the
+ * rest of the frame being transmitted, and the modulator and resampler
+ * flush at the end of a burst. The count is taken at the end of each call
+ * to quiet_encoder_emit, at the encoder's output sample rate.
+ *
+ * Together with quiet_encoder_estimated_drain_time and the latency of the
+ * audio device, this bounds how long a frame sent now takes to be heard.
+ *
+ * This may be called from any thread.
+ *
+ * @return Number of samples pending
+ */
+size_t quiet_encoder_pending_samples(quiet_encoder *e);
+
+/**
+ * Report how well frames from this encoder are being received
+ * @param e encoder object
+ * @param stats stats of one frame from this encoder, as measured by the
+ *  receiving decoder and carried back over whatever return channel the
+ *  application has. Only error_vector_magnitude and checksum_passed are
+ *  used.
+ *
+ * Used only with adaptation_levels. The encoder averages the reported
+ * error vector magnitudes and chooses the level for the next new frame
+ * from the average. It steps up to a faster level only once the channel
+ * beats that level's limit by 1 dB, so that it doesn't flap between two
+ * levels, and it steps down one level straight away for any frame which
+ * failed its checksum.
+ *
+ * This may be called from one thread while another calls
+ * quiet_encoder_emit.
+ */
+void quiet_encoder_report_frame_stats(quiet_encoder *e, const quiet_decoder_frame_stats *stats);
+
+/**
+ * Return the adaptation level chosen for new frames
+ * @param e encoder object
+ *
+ * This may be called from any thread.
+ *
+ * @return 0 for the encoder's own schemes, or n for adaptation_levels[n - 1]
+ */
+size_t quiet_encoder_adaptation_level(quiet_encoder *e);
+
+/**
+ * Estimate time to send every queued frame
+ * @param e encoder object
+ *
+ * quiet_encoder_estimated_drain_time estimates how long quiet_encoder_emit
+ * will take to transmit the frames counted by quiet_encoder_queued_frames.
+ * The estimate uses the same frame length to sample length model as
+ * quiet_encoder_clamp_frame_len, fitted once when the encoder is created,
+ * so it is cheap enough to call before every send. With frame_repeats,
+ * every copy of each frame is counted. It does not include the rest of a
+ * frame already being transmitted, or any gaps between frames.
+ *
+ * This may be called from any thread.
+ *
+ * @return Estimated drain time in seconds
+ */
+float quiet_encoder_estimated_drain_time(quiet_encoder *e);
+
+/**
+ * Return time needed to transmit a frame
+ * @param e encoder object
+ * @param frame_len payload length of the frame
+ *
+ * quiet_encoder_frame_airtime returns how long quiet_encoder_emit takes to
+ * transmit a frame with a payload of frame_len bytes, not counting the
+ * flush at the end of a burst. The encoder works this out for every frame
+ * length once when it is created, so this is a quick lookup which does
+ * not allocate.
+ *
+ * This may be called from any thread.
+ *
+ * @return Airtime in seconds
+ */
+float quiet_encoder_frame_airtime(const quiet_encoder *e, size_t frame_len);
+
+/**
+ * Discard queued frames
+ * @param e encoder object
+ *
+ * quiet_encoder_purge discards every frame waiting in the transmit queue,
+ * across every priority class. A frame which quiet_encoder_emit has
+ * already taken from the queue is still sent. Purged frames are not
+ * counted by quiet_encoder_dropped_frames.
+ *
+ * In multi_producer mode, only the thread calling quiet_encoder_emit may
+ * take frames from the queue, so the frames are discarded by its next
+ * call to quiet_encoder_emit instead, and this returns 0.
+ *
+ * @return Number of frames discarded
+ */
+size_t quiet_encoder_purge(quiet_encoder *e);
+
+/**
+ * Get pollable descriptor for quiet_encoder_send
+ * @param e encoder object
+ *
+ * quiet_encoder_get_fd returns a file descriptor which polls as readable
+ * whenever the transmit queue has room for a frame of the encoder's maximum
+ * frame length, e.g. when quiet_encoder_send would not block. This allows
+ * many encoders to be multiplexed with poll, select or epoll rather than
+ * dedicating a thread to each blocking call. With more than one priority
+ * class, the descriptor tracks the queue used by quiet_encoder_send.
+ *
+ * The descriptor is level-triggered and is owned by the encoder. The caller
+ * must not read from, write to or close it. It is closed by
+ * quiet_encoder_destroy. Once the encoder is closed, the descriptor stays
+ * readable so that pollers wake and observe the closed state.
+ *
+ * This function is only supported on systems with pthread. Calling
+ * quiet_encoder_get_fd on a host without pthread will assert false. Builds
+ * using the lock-free atomic queue have no descriptor to offer, so it
+ * returns -1 and sets quiet_io there.
+ *
+ * @return a file descriptor, or -1 if one could not be created
+ */
+int quiet_encoder_get_fd(quiet_encoder *e);
+
 /**
  * Set blocking mode of quiet_encoder_emit
  * @param e encoder object
@@ -875,6 +1544,10 @@ size_t quiet_encoder_get_frame_len(const quiet_encoder *e);
  * empty, and no future calls to quiet_encoder_emit will retrieve any more
  * samples.
  *
+ * With tdma_num_slots set, quiet_encoder_emit fills every block until the
+ * queue is closed, writing silence outside of the encoder's slots, as it
+ * keeps time by the samples it writes.
+ *
  * @return the number of samples written to samplebuf, which shall never
  *  exceed samplebuf_len. If the returned number of samples written is less
  *  than samplebuf_len, then the encoder has finished encoding the payload
@@ -904,6 +1577,30 @@ ssize_t quiet_encoder_emit(quiet_encoder *e, quiet_sample_t *samplebuf, size_t s
  */
 void quiet_encoder_close(quiet_encoder *e);
 
+/**
+ * Return number of dropped frames
+ * @param e encoder object
+ *
+ * quiet_encoder_dropped_frames returns the total number of queued frames
+ * which were discarded by the quiet_overflow_drop_oldest policy to make
+ * room for newer ones. Frames refused by quiet_encoder_send are not
+ * counted, since the caller was told about them.
+ *
+ * @return Total number of frames dropped from the send queue
+ */
+size_t quiet_encoder_dropped_frames(quiet_encoder *e);
+
+/**
+ * Return number of dropped bytes
+ * @param e encoder object
+ *
+ * quiet_encoder_dropped_bytes returns the total payload length of the
+ * frames counted by quiet_encoder_dropped_frames.
+ *
+ * @return Total number of payload bytes dropped from the send queue
+ */
+size_t quiet_encoder_dropped_bytes(quiet_encoder *e);
+
 /**
  * Destroy encoder
  * @param e encoder object
@@ -1005,6 +1702,181 @@ void quiet_decoder_set_blocking(quiet_decoder *d, time_t sec, long nano);
  */
 void quiet_decoder_set_nonblocking(quiet_decoder *d);
 
+/**
+ * Get pollable descriptor for quiet_decoder_recv
+ * @param d decoder object
+ *
+ * quiet_decoder_get_fd returns a file descriptor which polls as readable
+ * whenever the receive queue holds at least one frame, e.g. when
+ * quiet_decoder_recv would not block. This allows many decoders to be
+ * multiplexed with poll, select or epoll rather than dedicating a thread to
+ * each blocking call.
+ *
+ * The descriptor is level-triggered and is owned by the decoder. The caller
+ * must not read from, write to or close it. It is closed by
+ * quiet_decoder_destroy. Once the decoder is closed, the descriptor stays
+ * readable so that pollers wake and observe the closed state.
+ *
+ * Frames delivered by quiet_decoder_set_frame_callback skip the receive
+ * queue and will not make this descriptor readable.
+ *
+ * This function is only supported on systems with pthread. Calling
+ * quiet_decoder_get_fd on a host without pthread will assert false. Builds
+ * using the lock-free atomic queue have no descriptor to offer, so it
+ * returns -1 and sets quiet_io there.
+ *
+ * @return a file descriptor, or -1 if one could not be created
+ */
+int quiet_decoder_get_fd(quiet_decoder *d);
+
+/**
+ * Frame delivery callback
+ * @param ctx user context pointer given to quiet_decoder_set_frame_callback
+ * @param payload decoded frame, borrowed from the decoder
+ * @param payload_len number of bytes in payload
+ * @param stats info about the decoded frame, borrowed from the decoder
+ *
+ * payload and stats are only valid for the duration of the callback. The
+ * callback must copy anything it wishes to keep. The symbols field of stats
+ * is not populated; use quiet_decoder_consume_stats to inspect symbols.
+ */
+typedef void (*quiet_decoder_frame_callback)(void *ctx, const uint8_t *payload,
+                                             size_t payload_len,
+                                             const quiet_decoder_frame_stats *stats);
+
+/**
+ * Deliver frames by callback rather than through the receive queue
+ * @param d decoder object
+ * @param fn callback which will receive each decoded frame, or NULL
+ * @param ctx user context pointer passed through to fn
+ *
+ * quiet_decoder_set_frame_callback causes the decoder to hand each decoded
+ * frame directly to fn as soon as it passes checksum. The receive queue is
+ * skipped entirely, so quiet_decoder_recv will not see any frames while a
+ * callback is set. Passing NULL for fn restores delivery through the receive
+ * queue.
+ *
+ * fn is called on the thread which calls quiet_decoder_consume or
+ * quiet_decoder_flush, from within that call. It should return quickly, as
+ * decoding does not continue until it returns, and it must not call
+ * quiet_decoder_consume or quiet_decoder_flush itself.
+ *
+ * This function must be called from the same thread that calls
+ * quiet_decoder_consume, or before that thread is started.
+ */
+void quiet_decoder_set_frame_callback(quiet_decoder *d, quiet_decoder_frame_callback fn,
+                                      void *ctx);
+
+/**
+ * @struct quiet_decoder_subscriber
+ * Independent reader of a decoder's frames
+ */
+struct quiet_decoder_subscriber;
+typedef struct quiet_decoder_subscriber quiet_decoder_subscriber;
+
+/**
+ * Subscribe to decoded frames
+ * @param d decoder object
+ * @param policy what happens when this subscriber falls behind
+ *
+ * quiet_decoder_subscribe adds a subscriber which will see every frame the
+ * decoder receives from now on. Any number of subscribers may read the
+ * same frames, each at its own pace, without copying them. While a
+ * decoder has at least one subscriber, frames go to its subscribers
+ * instead of to quiet_decoder_recv. A frame callback set by
+ * quiet_decoder_set_frame_callback takes precedence over both.
+ *
+ * Up to broadcast_queue_len frames are kept for subscribers. If a
+ * subscriber falls further behind than that, then with
+ * quiet_overflow_drop_oldest it skips ahead to the oldest frame still
+ * kept, and with quiet_overflow_block quiet_decoder_consume waits for it
+ * to catch up. A lagging subscriber with quiet_overflow_drop_oldest never
+ * slows the decoder or the other subscribers.
+ *
+ * quiet_overflow_drop_newest is not meaningful here, since the kept
+ * frames are always the newest ones, and is rejected.
+ *
+ * @return a subscriber, or NULL on failure. On failure the last error is
+ *  set to quiet_decoder_bad_config. This always fails on a host without
+ *  pthread.
+ */
+quiet_decoder_subscriber *quiet_decoder_subscribe(quiet_decoder *d, quiet_overflow_policy_t policy);
+
+/**
+ * Remove a subscriber
+ * @param s subscriber object
+ *
+ * quiet_decoder_unsubscribe releases any frame held by s and frees it. If
+ * this was the last subscriber, then frames go back to quiet_decoder_recv.
+ * Subscribers which remain when the decoder is destroyed are freed along
+ * with it.
+ */
+void quiet_decoder_unsubscribe(quiet_decoder_subscriber *s);
+
+/**
+ * Read the next frame for a subscriber without copying it
+ * @param s subscriber object
+ * @param frame set to point at the frame's payload
+ *
+ * quiet_decoder_subscriber_recv first releases the frame returned by the
+ * previous call, if any, and then returns the next frame for this
+ * subscriber. The payload stays valid, and is not modified, until
+ * quiet_decoder_subscriber_release or the next call to
+ * quiet_decoder_subscriber_recv. Holding a frame does not slow the
+ * decoder.
+ *
+ * Each subscriber should be used by only one thread at a time. By
+ * default this function does not block, see
+ * quiet_decoder_subscriber_set_blocking.
+ *
+ * @return the frame's length, 0 if the decoder has been closed and this
+ *  subscriber has read every frame, or -1 with the last error set to
+ *  quiet_would_block or quiet_timedout
+ */
+ssize_t quiet_decoder_subscriber_recv(quiet_decoder_subscriber *s, const uint8_t **frame);
+
+/**
+ * Release a frame read by a subscriber
+ * @param s subscriber object
+ *
+ * quiet_decoder_subscriber_release hands back the frame returned by the
+ * last call to quiet_decoder_subscriber_recv, after which it must not be
+ * used. It does nothing if no frame is held.
+ */
+void quiet_decoder_subscriber_release(quiet_decoder_subscriber *s);
+
+/**
+ * Set blocking mode of quiet_decoder_subscriber_recv
+ * @param s subscriber object
+ * @param sec timeout seconds
+ * @param nano timeout nanoseconds
+ *
+ * This behaves as quiet_decoder_set_blocking does for
+ * quiet_decoder_recv. If `sec` and `nano` are both 0, then
+ * quiet_decoder_subscriber_recv waits indefinitely.
+ */
+void quiet_decoder_subscriber_set_blocking(quiet_decoder_subscriber *s, time_t sec, long nano);
+
+/**
+ * Set nonblocking mode of quiet_decoder_subscriber_recv
+ * @param s subscriber object
+ *
+ * This is the default mode of a new subscriber.
+ */
+void quiet_decoder_subscriber_set_nonblocking(quiet_decoder_subscriber *s);
+
+/**
+ * Return number of frames a subscriber skipped
+ * @param s subscriber object
+ *
+ * quiet_decoder_subscriber_dropped_frames returns the number of frames
+ * which this subscriber missed because it fell more than
+ * broadcast_queue_len frames behind.
+ *
+ * @return Total number of frames skipped by this subscriber
+ */
+size_t quiet_decoder_subscriber_dropped_frames(quiet_decoder_subscriber *s);
+
 /**
  * Feed received sound samples to decoder
  * @param d decoder object
@@ -1044,6 +1916,114 @@ ssize_t quiet_decoder_consume(quiet_decoder *d, const quiet_sample_t *samplebuf,
  */
 bool quiet_decoder_frame_in_progress(quiet_decoder *d);
 
+/**
+ * Check if someone is transmitting on the channel
+ * @param d decoder object
+ *
+ * quiet_decoder_channel_busy reports whether the last block given to
+ * quiet_decoder_consume was louder than carrier_sense_threshold, or ended
+ * with a frame in progress. Loudness catches transmissions which are too
+ * weak or too mangled to synchronize on, while frames in progress catch
+ * the quiet moments within a frame.
+ *
+ * Unlike quiet_decoder_frame_in_progress, this may be called from any
+ * thread.
+ *
+ * @return true if the channel is busy
+ */
+bool quiet_decoder_channel_busy(quiet_decoder *d);
+
+/**
+ * Listen before transmitting
+ * @param e encoder object
+ * @param d decoder listening to the channel this encoder transmits on, or
+ *  NULL to stop listening
+ *
+ * quiet_encoder_set_carrier_sense makes quiet_encoder_emit hold back the
+ * start of each burst of frames while quiet_decoder_channel_busy reports
+ * that d hears someone else. Each time the channel is found busy, the
+ * encoder backs off for a random number of slots of csma_slot_ms, from a
+ * window which doubles with every busy channel up to csma_max_window
+ * slots and starts over once the channel is clear. A burst which has
+ * started is never interrupted.
+ *
+ * Backoffs are timed by the samples d consumes, so d must be fed the
+ * channel continuously, even while the encoder has nothing to send. It
+ * will also hear this encoder's own frames, so a burst is usually
+ * followed by a backoff.
+ *
+ * While the encoder holds back, quiet_encoder_emit behaves as though
+ * nothing were queued. This must be called before quiet_encoder_emit
+ * starts, and d must outlive the encoder or be detached first.
+ */
+void quiet_encoder_set_carrier_sense(quiet_encoder *e, quiet_decoder *d);
+
+/**
+ * Return number of times the encoder backed off
+ * @param e encoder object
+ *
+ * This may be called from any thread.
+ *
+ * @return Total number of backoffs since the encoder was created
+ */
+size_t quiet_encoder_backoffs(quiet_encoder *e);
+
+/**
+ * Return time spent backing off
+ * @param e encoder object
+ *
+ * This may be called from any thread.
+ *
+ * @return Total length of every backoff, in seconds of channel time
+ */
+float quiet_encoder_backoff_time(quiet_encoder *e);
+
+/**
+ * Set the encoder's position in the TDMA cycle
+ * @param e encoder object
+ * @param sample_time samples since the start of a cycle, at the encoder's
+ *  sample rate
+ *
+ * Used only with tdma_num_slots. The encoder keeps time by counting the
+ * samples written by quiet_encoder_emit, starting from 0 when it is
+ * created. Encoders sharing a channel must count from the same moment,
+ * e.g. the time of a beacon which they have all heard, and this sets the
+ * count to agree with it. A frame already being transmitted is finished
+ * where it is.
+ *
+ * This must be called from the same thread which calls
+ * quiet_encoder_emit.
+ */
+void quiet_encoder_set_tdma_clock(quiet_encoder *e, uint64_t sample_time);
+
+/**
+ * Return the length of each TDMA slot
+ * @param e encoder object
+ *
+ * This is tdma_slot_len if it was given, or otherwise the length which
+ * the encoder chose to fit its longest frame.
+ *
+ * @return Slot length in samples at the encoder's sample rate, or 0 if
+ *  TDMA is disabled
+ */
+size_t quiet_encoder_tdma_slot_len(const quiet_encoder *e);
+
+/**
+ * Return how much of the encoder's TDMA slots it has used
+ * @param e encoder object
+ *
+ * quiet_encoder_tdma_utilization divides the samples in which the
+ * encoder was transmitting by the length of the slots it owns which have
+ * passed, since it was created. Slots which go unused because nothing
+ * was queued count against it, as do guard intervals and the ends of
+ * slots too short for the next frame.
+ *
+ * This may be called from any thread.
+ *
+ * @return Fraction of owned slot time spent transmitting, from 0 to 1
+ */
+float quiet_encoder_tdma_utilization(quiet_encoder *e);
+
 /**
  * Flush existing state through decoder
  * @param d decoder object
@@ -1082,6 +2062,84 @@ void quiet_decoder_close(quiet_decoder *d);
  */
 unsigned int quiet_decoder_checksum_fails(const quiet_decoder *d);
 
+/**
+ * Return number of frames recovered by combining copies
+ * @param d decoder object
+ *
+ * quiet_decoder_combined_frames returns how many frames were received
+ * only because copies which each failed their checksum were combined.
+ * Always 0 unless frame_repeats is set and modem_encoding is used.
+ *
+ * @return Total number of frames recovered from repeated copies
+ */
+unsigned int quiet_decoder_combined_frames(const quiet_decoder *d);
+
+/**
+ * Return number of dropped frames
+ * @param d decoder object
+ *
+ * quiet_decoder_dropped_frames returns the total number of frames which
+ * were decoded successfully but discarded because the receive queue was
+ * full, across the lifetime of the decoder. Which frames are discarded
+ * depends on the decoder's overflow_policy.
+ *
+ * @return Total number of frames dropped from the receive queue
+ */
+size_t quiet_decoder_dropped_frames(quiet_decoder *d);
+
+/**
+ * Return number of dropped bytes
+ * @param d decoder object
+ *
+ * quiet_decoder_dropped_bytes returns the total payload length of the
+ * frames counted by quiet_decoder_dropped_frames.
+ *
+ * @return Total number of payload bytes dropped from the receive queue
+ */
+size_t quiet_decoder_dropped_bytes(quiet_decoder *d);
+
+/**
+ * Receive a message sent by quiet_encoder_send_message
+ * @param d decoder object
+ * @param data user buffer which quiet will write the message in to
+ * @param len length of user buffer
+ *
+ * quiet_decoder_recv_message reads frames with quiet_decoder_recv and
+ * reassembles them in to messages, returning once a whole message has
+ * arrived and its crc32 matches. Segments may arrive in any order, and
+ * repeated segments are ignored. If the message was sent with parity,
+ * missing segments are rebuilt as soon as enough segments have arrived.
+ * Up to reassembly_slots messages may be in progress at once, using up
+ * to reassembly_len bytes between them; when a new message does not fit,
+ * the ones which have gone longest without a segment are abandoned.
+ *
+ * As with quiet_decoder_recv, a message longer than len is truncated,
+ * and blocking mode applies to each frame read. Frames which are not
+ * segments, e.g. those sent with quiet_encoder_send, are discarded and
+ * counted by quiet_decoder_dropped_messages, so don't mix the two kinds
+ * of send on one channel.
+ *
+ * Unlike quiet_decoder_recv, this keeps reassembly state in the decoder,
+ * so it must only be called from one thread at a time.
+ *
+ * @return number of bytes written to buffer, 0 at EOF, or -1 if no
+ * message could be completed from the frames available
+ */
+ssize_t quiet_decoder_recv_message(quiet_decoder *d, uint8_t *data, size_t len);
+
+/**
+ * Return number of abandoned messages
+ * @param d decoder object
+ *
+ * quiet_decoder_dropped_messages returns how many messages
+ * quiet_decoder_recv_message has given up on, because they were pushed
+ * out of the reassembly buffers, could never fit in them, or failed their
+ * crc32. Each frame it read which was not a segment also counts as one.
+ *
+ * @return Total number of messages dropped during reassembly
+ */
+size_t quiet_decoder_dropped_messages(quiet_decoder *d);
+
 /**
  * Fetch stats from last call to quiet_decoder_consume
  * @param d decoder object
@@ -1118,6 +2176,9 @@ const quiet_decoder_frame_stats *quiet_decoder_recv_stats(quiet_decoder *d);
  * By default, stats collection is disabled. Therefore, if the user would like
  * to use quiet_decoder_consume_stats, then they must first call
  * quiet_decoder_enable_stats.
+ *
+ * If the stats queue can't be allocated, stats collection stays disabled
+ * and quiet_mem_fail is set.
  */
 void quiet_decoder_enable_stats(quiet_decoder *d);
 
@@ -0,0 +1,79 @@
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <errno.h>
+
+#include <pthread.h>
+
+#include "quiet/common.h"
+
+// one decoded frame as seen by subscribers
+// a frame is shared rather than copied per subscriber. it is referenced
+//   once by the slot holding it and once by each subscriber currently
+//   reading it, and is only reused once nobody references it
+typedef struct broadcast_frame {
+    size_t refs;
+    size_t len;
+    size_t cap;
+    uint8_t *data;
+    struct broadcast_frame *next; // freelist link
+} broadcast_frame;
+
+typedef struct broadcast broadcast;
+
+struct quiet_decoder_subscriber {
+    broadcast *b;
+    size_t cursor; // free-running position of next frame to read
+    quiet_overflow_policy_t policy;
+    broadcast_frame *held; // frame returned by the last recv, if not yet released
+    size_t dropped_frames;
+    bool is_blocking;
+    struct timespec timeout;
+    struct quiet_decoder_subscriber *next;
+};
+
+typedef struct quiet_decoder_subscriber broadcast_subscriber;
+
+// single writer, many reader queue of frames
+// every subscriber has its own cursor in to the same ring of frames. a
+//   subscriber which falls a whole ring behind either holds the writer
+//   back (quiet_overflow_block) or skips ahead to the oldest frame still
+//   kept (quiet_overflow_drop_oldest), so a slow subscriber of the second
+//   kind never slows the writer or the other subscribers
+// all state is guarded by one mutex, which is only held for bookkeeping
+//   and for copying a frame in. subscribers read frames in place
+struct broadcast {
+    pthread_mutex_t mutex;
+    pthread_cond_t readable; // a frame was written or the queue was closed
+    pthread_cond_t writable; // a blocking subscriber advanced or left
+    broadcast_frame **slots;
+    size_t num_slots;
+    size_t head; // free-running count of frames written
+    broadcast_frame *freelist;
+    broadcast_subscriber *subscribers;
+    size_t num_subscribers;
+    bool is_closed;
+};
+
+broadcast *broadcast_create(size_t num_slots);
+// also frees any subscribers which have not unsubscribed
+void broadcast_destroy(broadcast *b);
+// returns false, without queueing the frame, if there are no subscribers
+bool broadcast_write(broadcast *b, const uint8_t *payload, size_t len);
+void broadcast_close(broadcast *b);
+
+// policy is quiet_overflow_drop_oldest or quiet_overflow_block
+// new subscribers see frames written after they subscribe
+broadcast_subscriber *broadcast_subscribe(broadcast *b, quiet_overflow_policy_t policy);
+void broadcast_unsubscribe(broadcast_subscriber *s);
+// releases any previously held frame, then points frame at the next one
+// returns its length, 0 once closed and caught up, or a RingError
+ssize_t broadcast_recv(broadcast_subscriber *s, const uint8_t **frame);
+void broadcast_release(broadcast_subscriber *s);
+void broadcast_set_blocking(broadcast_subscriber *s, time_t sec, long nano);
+void broadcast_set_nonblocking(broadcast_subscriber *s);
+size_t broadcast_dropped_frames(broadcast_subscriber *s);
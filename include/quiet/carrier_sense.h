@@ -0,0 +1,18 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "quiet/common.h"
+
+// what a decoder hears on its channel, so that encoders sharing the
+//   channel can hold off while someone else is transmitting
+// the decoder updates it at the end of each quiet_decoder_consume, and
+//   encoders may read it from any thread
+typedef struct {
+    _Atomic bool is_busy;
+    // base rate samples the decoder has consumed. this is the channel's
+    //   clock, so that backoffs run at the speed the channel does
+    _Atomic uint64_t now;
+} carrier_sense;
+
+carrier_sense *decoder_carrier_sense(decoder *d);
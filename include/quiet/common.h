@@ -35,6 +35,15 @@ typedef struct {
 } demodulator;
 
 static const float SAMPLE_RATE = 44100;
+// each message in an aggregated frame is prefixed with its length as a
+//   big-endian 16 bit integer
+static const size_t SUBFRAME_HEADER_LEN = 2;
+// each repeated frame starts with a sequence number, shared by its copies
+static const size_t REPEAT_HEADER_LEN = 1;
+// repeated frames also carry the sequence number in the frame header, whose
+//   own checksum lets a copy that fails its payload checksum be matched to
+//   the other copies of its frame
+static const size_t REPEAT_TAG_LEN = 1;
 unsigned char *ofdm_subcarriers_create(const ofdm_options *opt);
 size_t constrained_write(sample_t *src, size_t src_len, sample_t *dst,
                          size_t dest_len);
@@ -0,0 +1,30 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+// compressed messages start with a flag byte saying how the rest is coded
+static const size_t COMPRESS_HEADER_LEN = 1;
+enum { compress_flag_raw = 0, compress_flag_lz = 1 };
+
+// byte oriented lz77, laid out like lz4 blocks. each sequence is a token
+//   whose high nibble counts literals and low nibble counts match bytes
+//   past the minimum, with 15 meaning more follow in 255s, then the
+//   literals, then a 16-bit big-endian offset back to the match. the last
+//   sequence stops after its literals
+// matches may reach back in to a dictionary which both ends share, so
+//   short messages have some history to draw on. only the last
+//   COMPRESS_MAX_OFFSET bytes of it can be reached
+#define COMPRESS_MIN_MATCH 4
+#define COMPRESS_MAX_OFFSET 65535
+
+// compress src in to dst, which holds dst_len bytes
+// returns the compressed length, or 0 if it doesn't fit in dst_len
+size_t compress_lz(const uint8_t *dict, size_t dict_len, const uint8_t *src, size_t src_len,
+                   uint8_t *dst, size_t dst_len);
+// returns the decompressed length, or -1 if src is malformed or would
+//   decompress to more than dst_len bytes
+ssize_t decompress_lz(const uint8_t *dict, size_t dict_len, const uint8_t *src, size_t src_len,
+                      uint8_t *dst, size_t dst_len);
@@ -4,14 +4,27 @@
 #include "quiet/demodulator.h"
 #if RING_ATOMIC
 #include "quiet/ring_atomic.h"
+#elif RING_FUTEX
+#include "quiet/ring_futex.h"
 #elif RING_BLOCKING
 #include "quiet/ring_blocking.h"
 #else
 #include "quiet/ring.h"
 #endif
+#if QUIET_BROADCAST
+#include "quiet/broadcast.h"
+#endif
+#include "quiet/sar.h"
+#include "quiet/compress.h"
+#include "quiet/carrier_sense.h"
 
 const size_t decoder_default_buffer_len = 1 << 16;
 const size_t decoder_default_stats_buffer_len = 1 << 16;
+const size_t decoder_default_broadcast_len = 64;
+const size_t decoder_default_reassembly_slots = 4;
+const size_t decoder_default_reassembly_len = 1 << 18;
+const size_t decoder_max_decompressed_len = 1 << 16;
+const float decoder_default_carrier_sense_threshold = -50.0f;
 
 typedef struct { ofdmflexframesync framesync; } ofdm_decoder;
 
@@ -37,9 +50,44 @@ struct quiet_decoder {
     sample_t *baserate;
     size_t baserate_offset;
     unsigned int checksum_fails;
+    // used only with frame_repeats
+    // sequence number of the last frame received, so its copies are skipped
+    bool has_repeat_seq;
+    uint8_t repeat_seq;
+    // running mean of the payload symbols of copies which failed their
+    //   checksum. only modem_encoding reports its symbols, so combiner is
+    //   NULL for the others
+    qpacketmodem combiner;
+    float complex *combined_symbols;
+    size_t combined_symbols_cap;
+    unsigned int num_combined; // copies in the mean, 0 if empty
+    uint8_t combined_seq;
+    framesyncstats_s combined_stats;
+    unsigned int combined_payload_len;
+    uint8_t *combined_payload;
+    unsigned int combined_frames;
     ring *buf;
+    // frames discarded because buf was full, guarded by buf's reader lock
+    size_t dropped_frames;
+    size_t dropped_bytes;
     uint8_t *writeframe;
     size_t writeframe_len;
+    quiet_decoder_frame_callback frame_callback;
+    void *frame_callback_ctx;
+    // only used by quiet_decoder_recv_message
+    sar_reassembler *reassembler;
+    uint8_t *segment; // allocated on first use
+    size_t segment_len;
+    size_t unsegmented_frames; // frames recv_message found no segment header in
+    // the decoder's copy of compression_dictionary
+    uint8_t *compression_dict;
+    size_t compression_dict_len;
+    uint8_t *decompressframe; // allocated on first use
+    carrier_sense sense;
+    double sensed_samples; // base rate, kept fractional across resampling
+#if QUIET_BROADCAST
+    broadcast *bcast;
+#endif
 
     ring *stats_ring;
     uint8_t *stats_packed;
@@ -57,6 +105,9 @@ struct quiet_decoder {
 static int decoder_on_decode(unsigned char *header, int header_valid, unsigned char *payload,
                              unsigned int payload_len, int payload_valid,
                              framesyncstats_s stats, void *dvoid);
+static void decoder_deliver(decoder *d, unsigned char *payload, size_t payload_len,
+                            framesyncstats_s stats);
 static void decoder_ofdm_create(const decoder_options *opt, decoder *d);
 static void decoder_modem_create(const decoder_options *opt, decoder *d);
 static size_t decoder_max_len(decoder *d);
+static void decoder_sense_channel(decoder *d, const sample_t *samplebuf, size_t sample_len);
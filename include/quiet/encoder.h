@@ -4,15 +4,48 @@
 #include "quiet/modulator.h"
 #if RING_ATOMIC
 #include "quiet/ring_atomic.h"
+#elif RING_FUTEX
+#include "quiet/ring_futex.h"
 #elif RING_BLOCKING
 #include "quiet/ring_blocking.h"
 #else
 #include "quiet/ring.h"
 #endif
+#include "quiet/mpsc.h"
+#include "quiet/waveform_cache.h"
+#include "quiet/sar.h"
+#include "quiet/compress.h"
+#include "quiet/carrier_sense.h"
 
 const size_t encoder_default_buffer_len = 1 << 16;
+// weight of each new report in the average error vector magnitude
+const float encoder_adaptation_smoothing = 0.25f;
+// margin in dB by which the channel must beat a faster level's limit
+const float encoder_adaptation_hysteresis = 1.0f;
+const unsigned int encoder_default_csma_slot_ms = 50;
+const unsigned int encoder_default_csma_max_window = 32;
+// contention window, in slots, after the channel has been clear
+const unsigned int encoder_csma_min_window = 2;
+const unsigned int encoder_tdma_max_slots = 32;
 
-typedef struct { ofdmflexframegen framegen; } ofdm_encoder;
+// each queued frame is this header followed by len bytes of payload
+typedef struct {
+    size_t len;
+    uint64_t deadline; // CLOCK_MONOTONIC nanoseconds, 0 if the frame never expires
+} encoder_frame_header;
+
+// one run of the airtime table
+// every frame length after the previous entry's max_len, up to and
+//   including this max_len, takes the same number of base rate samples
+typedef struct {
+    size_t max_len;
+    size_t samples;
+} encoder_airtime_run;
+
+typedef struct {
+    ofdmflexframegen framegen;
+    size_t symbols_remaining;
+} ofdm_encoder;
 
 typedef struct {
     flexframegen framegen;
@@ -22,6 +55,7 @@ typedef struct {
 typedef struct {
     gmskframegen framegen;
     size_t stride;
+    size_t samples_remaining;
 } gmsk_encoder;
 
 struct quiet_encoder {
@@ -45,13 +79,108 @@ struct quiet_encoder {
     bool is_close_frame;
     float resample_rate;
     resamp_rrrf resampler;
-    ring *buf;
+    // frames are queued in exactly one of bufs and mpsc
+    // bufs has one ring per priority class, most urgent first
+    ring *bufs[quiet_max_priorities];
+    size_t num_priorities;
+    unsigned int priority_credits[quiet_max_priorities];
+    mpsc_queue *mpsc;
+    // frames discarded by drop_oldest, guarded by bufs[0]'s reader lock
+    size_t dropped_frames;
+    size_t dropped_bytes;
+    // frames discarded past their deadline, only written by emit
+    _Atomic size_t expired_frames;
+    // totals across every queue. senders add before writing, so these can
+    //   briefly overcount but never wrap below zero
+    _Atomic size_t queued_frames;
+    _Atomic size_t queued_bytes;
+    // id for the next quiet_encoder_send_message, truncated to 16 bits
+    _Atomic unsigned int next_message_id;
+    // purge can't read the mpsc queue from another thread, so emit does it
+    _Atomic bool is_purge_requested;
+    // frame length to sample length, built once at create so that
+    //   lookups need neither the frame generator nor any allocation.
+    //   sorted by both max_len and samples
+    encoder_airtime_run *airtime;
+    size_t airtime_len;
+    size_t airtime_cap;
+    // linear fit of the airtime table, for O(1) drain estimates
+    float airtime_per_frame;
+    float airtime_per_byte;
+    // output samples rendered or committed to but not yet returned by
+    //   emit, stored as emit returns so that any thread can read it
+    _Atomic size_t pending_samples;
     uint8_t *tempframe;
+    // the frame being sent, which may be preempted until it starts
     uint8_t *readframe;
+    // fixed at create, as quiet_encoder_clamp_frame_len may shrink frame_len
+    //   while longer frames are still queued
+    size_t readframe_cap;
+    size_t readframe_len;
+    uint64_t readframe_deadline;
+    size_t readframe_priority;
+    bool readframe_started;
+    // copies of readframe still to send after this one, and the sequence
+    //   number of the next new frame. used only with frame_repeats
+    unsigned int repeats_remaining;
+    uint8_t repeat_seq;
+    // messages waiting to be sent together, each prefixed by its length
+    uint8_t *aggframe;
+    size_t aggframe_len;
+    uint64_t aggframe_started; // when the first of them was taken
+    // deadline of each message in aggframe, so that it can still expire
+    uint64_t *aggframe_deadlines;
+    size_t aggframe_count;
+    // a preempted frame, which goes ahead of the rest of its class
+    uint8_t *stashframe;
+    size_t stashframe_len;
+    uint64_t stashframe_deadline;
+    size_t stashframe_priority;
+    bool has_stashed_frame;
+    // true until modulator_emit runs after a reset. only frames which
+    //   start from this state can be cached or replayed
+    bool is_modulator_reset;
+    // rendered frames by payload, NULL if disabled
+    waveform_cache *waveform_cache;
+    // samples of the frame being rendered, saved once it's flushed
+    bool is_cache_recording;
+    sample_t *cache_record;
+    size_t cache_record_len;
+    size_t cache_record_cap;
+    // the encoder's copy of compression_dictionary
+    uint8_t *compression_dict;
+    size_t compression_dict_len;
+    uint8_t *compressframe;
+    // schemes to send with. level 0 is the encoder's own, and the rest are
+    //   copied from adaptation_levels
+    quiet_adaptation_level *levels;
+    size_t num_levels;
+    size_t level; // in use by the framegen
+    // chosen by quiet_encoder_report_frame_stats for the next new frame
+    _Atomic size_t next_level;
+    // average of the reported evm, only used by the reporting thread
+    float reported_evm;
+    bool has_reported_evm;
+    // channel to listen to before starting a burst, NULL if disabled
+    carrier_sense *sense;
+    uint64_t backoff_until; // on the channel's clock
+    unsigned int contention_window;
+    uint32_t backoff_rng;
+    _Atomic size_t backoffs;
+    _Atomic uint64_t backoff_samples;
+    // tdma, all in output samples
+    size_t tdma_slot_len;
+    uint64_t tdma_clock; // samples emitted, or as set by quiet_encoder_set_tdma_clock
+    _Atomic uint64_t tdma_owned_samples; // of our own slots which have passed
+    _Atomic uint64_t tdma_busy_samples;  // written other than silence
 };
 
 static void encoder_ofdm_create(const encoder_options *opt, encoder *e);
 static void encoder_modem_create(const encoder_options *opt, encoder *e);
 static int encoder_is_assembled(encoder *e);
 static size_t encoder_fillsymbols(encoder *e, size_t requested_length);
-static size_t quiet_encoder_sample_len(quiet_encoder *e, size_t data_len);
+static void encoder_reset_framegen(encoder *e);
+static size_t quiet_encoder_sample_len(const quiet_encoder *e, size_t data_len);
+static void encoder_build_airtime(encoder *e);
+static size_t encoder_max_frame_len(const encoder *e);
+static size_t encoder_frame_output_len(const encoder *e, size_t frame_len);
@@ -0,0 +1,19 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+// systematic reed-solomon erasure code over gf(256), applied across blocks
+//   of equal length rather than within one
+// k data blocks are extended by m parity blocks, and the data can be
+//   recovered from any k of the k + m. k + m may be at most 256
+#define ERASURE_MAX_BLOCKS 256
+
+// parity must hold m * stride bytes, data k * stride
+void erasure_encode(const uint8_t *data, size_t k, size_t m, size_t stride, uint8_t *parity);
+// blocks holds the k data blocks followed by the m parity blocks, and
+//   present flags which of them arrived
+// missing data blocks are rebuilt in place. returns false if fewer than k
+//   blocks are present, or if memory could not be allocated
+bool erasure_decode(uint8_t *blocks, const bool *present, size_t k, size_t m, size_t stride);
@@ -0,0 +1,60 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include <stdatomic.h>
+
+#include "quiet/common.h"
+
+#define MPSC_CACHE_LINE 64
+
+// header of each slot. the payload follows it directly
+// seq tells producers and the consumer whose turn it is. a slot at
+//   position pos is free for a producer when seq == pos, and holds a
+//   frame for the consumer when seq == pos + 1
+typedef struct {
+    _Atomic size_t seq;
+    size_t len;
+    uint64_t deadline; // carried along for the consumer, not interpreted
+} mpsc_slot;
+
+// bounded multi-producer, single-consumer queue of frames
+// each frame occupies one fixed-size slot. producers claim slots with a
+//   compare-and-swap on enqueue_pos and never wait on each other while
+//   copying, and the consumer takes frames without any atomic
+//   read-modify-write at all
+// this is nonblocking only: a full queue refuses frames and an empty
+//   one returns immediately
+typedef struct {
+    union {
+        _Atomic size_t pos;
+        uint8_t pad[MPSC_CACHE_LINE];
+    } enqueue;
+    union {
+        size_t pos; // only touched by the consumer
+        uint8_t pad[MPSC_CACHE_LINE];
+    } dequeue;
+    // read-only after creation, aside from is_closed
+    size_t num_slots; // power of two
+    size_t mask;
+    size_t slot_stride; // bytes from one slot to the next
+    size_t max_len;
+    uint8_t *slots;
+    _Atomic bool is_closed;
+} mpsc_queue;
+
+// num_slots will be rounded up to the next power of two
+mpsc_queue *mpsc_create(size_t num_slots, size_t max_len);
+void mpsc_destroy(mpsc_queue *q);
+// frames may be empty, so these return 1 on success rather than a length
+// safe to call from any number of threads at once
+// returns 1 on success, 0 if closed, RingErrorWouldBlock if full
+ssize_t mpsc_enqueue(mpsc_queue *q, const void *buf, size_t len, uint64_t deadline);
+// must only be called from one thread at a time
+// returns 1 on success and sets len and deadline, RingErrorWouldBlock if
+//   empty, and 0 once the queue is both closed and empty
+ssize_t mpsc_dequeue(mpsc_queue *q, void *dst, size_t dst_len, size_t *len, uint64_t *deadline);
+void mpsc_close(mpsc_queue *q);
@@ -20,12 +20,15 @@ ssize_t ring_read(ring *r, void *dst, size_t len);
 void ring_close(ring *r);
 bool ring_is_closed(ring *r);
 void ring_advance_reader(ring *r, size_t len);
+size_t ring_read_available(ring *r);
 
 ssize_t ring_write_partial_init(ring *r, size_t len);
 ssize_t ring_write_partial(ring *r, const void *buf, size_t len);
 ssize_t ring_write_partial_commit(ring *r);
 
 // stubs for unusable feature
+int ring_get_reader_fd(ring *r);
+int ring_get_writer_fd(ring *r, size_t threshold);
 void ring_set_reader_blocking(ring *r, time_t sec, long nano);
 void ring_set_reader_nonblocking(ring *r);
 void ring_set_writer_blocking(ring *r, time_t sec, long nano);
@@ -36,3 +39,5 @@ void ring_writer_lock(ring *r);
 void ring_writer_unlock(ring *r);
 void ring_reader_lock(ring *r);
 void ring_reader_unlock(ring *r);
+void ring_set_exclusive_writer(ring *r);
+void ring_set_exclusive_reader(ring *r);
@@ -1,3 +1,4 @@
+#include <assert.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <unistd.h>
@@ -9,29 +10,59 @@
 
 #include "quiet/common.h"
 
+// assumed size of a cache line. reader and writer state are kept on
+//   separate lines so that the two sides don't invalidate each other
+#define RING_CACHE_LINE 64
+
+// state owned by the writing side
+typedef struct {
+    _Atomic size_t writer; // free-running position of next byte to be written
+    size_t reader_cache; // writer's last view of reader, refreshed only when full
+    size_t partial_write_length;
+    size_t partial_writer; // free-running position of next partial write
+    bool partial_write_in_progress;
+    bool is_shared; // false if ring_set_exclusive_writer has been called
+    pthread_mutex_t mutex;
+} ring_writer_state;
+
+// state owned by the reading side
+typedef struct {
+    _Atomic size_t reader; // free-running position of next byte to be read
+    size_t writer_cache; // reader's last view of writer, refreshed only when empty
+    bool is_shared; // false if ring_set_exclusive_reader has been called
+    pthread_mutex_t mutex;
+} ring_reader_state;
+
 // stdatomic approach to ring buffer
+// positions are free-running counters which are masked down to an offset in
+//   base, so length is always a power of two. reader == writer means empty
+//   and writer - reader == length means full
 typedef struct {
+    union {
+        ring_writer_state w;
+        uint8_t pad[((sizeof(ring_writer_state) + RING_CACHE_LINE - 1) / RING_CACHE_LINE) * RING_CACHE_LINE];
+    } writer;
+    union {
+        ring_reader_state r;
+        uint8_t pad[((sizeof(ring_reader_state) + RING_CACHE_LINE - 1) / RING_CACHE_LINE) * RING_CACHE_LINE];
+    } reader;
+    // read-only after creation, aside from is_closed
     size_t length;
+    size_t mask;
     uint8_t *base;
-    _Atomic uintptr_t reader; // reader points to next block to be read
-    _Atomic uintptr_t writer; // writer points to next block to be written
-    pthread_mutex_t reader_mutex;
-    pthread_mutex_t writer_mutex;
     _Atomic bool is_closed;
-    size_t partial_write_length;
-    uint8_t *partial_writer;
-    bool partial_write_in_progress;
 } ring;
 
+// length will be rounded up to the next power of two
 ring *ring_create(size_t length);
 void ring_destroy(ring *r);
-size_t ring_calculate_distance(const ring *r, const uint8_t *src, const uint8_t *dst);
-uint8_t *ring_calculate_advance(const ring *r, uint8_t *p, size_t adv);
 ssize_t ring_write(ring *r, const void *buf, size_t len);
 ssize_t ring_read(ring *r, void *dst, size_t len);
 void ring_close(ring *r);
 bool ring_is_closed(ring *r);
 void ring_advance_reader(ring *r, size_t len);
+// bytes which a reader could read right now
+size_t ring_read_available(ring *r);
 
 ssize_t ring_write_partial_init(ring *r, size_t len);
 ssize_t ring_write_partial(ring *r, const void *buf, size_t len);
@@ -42,6 +73,8 @@ void ring_set_reader_blocking(ring *r, time_t sec, long nano);
 void ring_set_reader_nonblocking(ring *r);
 void ring_set_writer_blocking(ring *r, time_t sec, long nano);
 void ring_set_writer_nonblocking(ring *r);
+int ring_get_reader_fd(ring *r);
+int ring_get_writer_fd(ring *r, size_t threshold);
 
 // lock functions
 // ring_atomic supports one reader and one writer simultaneously
@@ -54,3 +87,9 @@ void ring_writer_lock(ring *r);
 void ring_writer_unlock(ring *r);
 void ring_reader_lock(ring *r);
 void ring_reader_unlock(ring *r);
+
+// promise that only one thread will ever write (or read), which turns
+//   the corresponding lock functions into nops
+// must be called before the ring is shared between threads
+void ring_set_exclusive_writer(ring *r);
+void ring_set_exclusive_reader(ring *r);
@@ -6,15 +6,28 @@
 #include <stdbool.h>
 #include <sys/time.h>
 #include <errno.h>
+#include <fcntl.h>
 
 #include <pthread.h>
 
+#if QUIET_HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
+
 #include "quiet/common.h"
 
 typedef struct {
     bool is_blocking;
     struct timespec timeout;
     pthread_cond_t cond;
+
+    // optional pollable descriptor, readable while the waited-on
+    //   condition holds. -1 until requested
+    int notify_fd;
+    // write side of notify_fd, same as notify_fd when using eventfd
+    int notify_write_fd;
+    bool notify_is_set;
+    size_t notify_threshold;
 } ring_wait_t;
 
 // pthread condvar approach to ring buffer
@@ -50,6 +63,8 @@ void ring_close(ring *r);
 bool ring_is_closed(ring *r);
 // must be called with lock held
 void ring_advance_reader(ring *r, size_t len);
+// must be called with lock held
+size_t ring_read_available(ring *r);
 
 ssize_t ring_write_partial_init(ring *r, size_t len);
 ssize_t ring_write_partial(ring *r, const void *buf, size_t len);
@@ -64,8 +79,20 @@ void ring_set_writer_blocking(ring *r, time_t sec, long nano);
 // must be called with lock held
 void ring_set_writer_nonblocking(ring *r);
 
+// get a descriptor which polls readable while there are bytes to read
+// must be called with lock held
+int ring_get_reader_fd(ring *r);
+// get a descriptor which polls readable while threshold bytes can be written
+// must be called with lock held
+int ring_get_writer_fd(ring *r, size_t threshold);
+
 // there's only one mutex here, but this api allows us to mimic atomic ring
 void ring_reader_lock(ring *r);
 void ring_reader_unlock(ring *r);
 void ring_writer_lock(ring *r);
 void ring_writer_unlock(ring *r);
+
+// nops. the mutex also guards the condvars, so it's needed even with only
+//   one reader and one writer
+void ring_set_exclusive_writer(ring *r);
+void ring_set_exclusive_reader(ring *r);
@@ -0,0 +1,150 @@
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include <stdatomic.h>
+#include <pthread.h>
+
+#if QUIET_HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
+
+#include "quiet/common.h"
+
+// assumed size of a cache line. reader and writer state are kept on
+//   separate lines so that the two sides don't invalidate each other
+#define RING_CACHE_LINE 64
+
+// one side's view of blocking
+// a side that finds the ring full (or empty) spins briefly, then sleeps
+//   on seq. the other side only makes a syscall to wake it if sleeping
+//   is set, so the uncontended path never enters the kernel
+typedef struct {
+    _Atomic uint32_t seq; // futex word, bumped by the other side before waking
+    _Atomic uint32_t sleeping;
+    bool is_blocking;
+    struct timespec timeout;
+    unsigned int spin; // current adaptive spin budget, in polls
+} ring_futex_wait_t;
+
+// state owned by the writing side
+typedef struct {
+    _Atomic size_t writer; // free-running position of next byte to be written
+    size_t reader_cache; // writer's last view of reader, refreshed only when full
+    size_t partial_write_length;
+    size_t partial_writer; // free-running position of next partial write
+    bool partial_write_in_progress;
+    bool is_shared; // false if ring_set_exclusive_writer has been called
+    pthread_mutex_t mutex;
+    ring_futex_wait_t wait;
+} ring_writer_state;
+
+// state owned by the reading side
+typedef struct {
+    _Atomic size_t reader; // free-running position of next byte to be read
+    size_t writer_cache; // reader's last view of writer, refreshed only when empty
+    bool is_shared; // false if ring_set_exclusive_reader has been called
+    pthread_mutex_t mutex;
+    ring_futex_wait_t wait;
+} ring_reader_state;
+
+// optional pollable descriptor, readable while the waited-on condition
+//   holds. -1 until requested
+typedef struct {
+    int fd;
+    // write side of fd, same as fd when using eventfd
+    int write_fd;
+    bool is_set;
+    size_t threshold;
+} ring_futex_notify_t;
+
+// futex approach to ring buffer
+// the indices work the same way as in ring_atomic, so reads and writes
+//   which don't have to wait are lock-free. a side that has to wait spins
+//   for a short while and then sleeps on a futex until the other side
+//   moves its index
+// positions are free-running counters which are masked down to an offset
+//   in base, so length is always a power of two
+typedef struct {
+    union {
+        ring_writer_state w;
+        uint8_t pad[((sizeof(ring_writer_state) + RING_CACHE_LINE - 1) / RING_CACHE_LINE) * RING_CACHE_LINE];
+    } writer;
+    union {
+        ring_reader_state r;
+        uint8_t pad[((sizeof(ring_reader_state) + RING_CACHE_LINE - 1) / RING_CACHE_LINE) * RING_CACHE_LINE];
+    } reader;
+    // read-only after creation, aside from is_closed
+    size_t length;
+    size_t mask;
+    uint8_t *base;
+    unsigned int max_spin; // 0 on single core machines
+    _Atomic bool is_closed;
+
+    // descriptors are rarely used, so they share one mutex instead of
+    //   making the fast paths coordinate
+    _Atomic bool notify_enabled;
+    pthread_mutex_t notify_mutex;
+    ring_futex_notify_t read_notify;
+    ring_futex_notify_t write_notify;
+} ring;
+
+// length will be rounded up to the next power of two
+ring *ring_create(size_t length);
+void ring_destroy(ring *r);
+// must be called with writer lock held
+ssize_t ring_write(ring *r, const void *buf, size_t len);
+// must be called with reader lock held
+ssize_t ring_read(ring *r, void *dst, size_t len);
+void ring_close(ring *r);
+bool ring_is_closed(ring *r);
+// must be called with reader lock held
+void ring_advance_reader(ring *r, size_t len);
+// bytes which a reader could read right now
+size_t ring_read_available(ring *r);
+
+// must be called with writer lock held
+ssize_t ring_write_partial_init(ring *r, size_t len);
+ssize_t ring_write_partial(ring *r, const void *buf, size_t len);
+ssize_t ring_write_partial_commit(ring *r);
+
+// must be called with reader lock held
+void ring_set_reader_blocking(ring *r, time_t sec, long nano);
+// must be called with reader lock held
+void ring_set_reader_nonblocking(ring *r);
+// must be called with writer lock held
+void ring_set_writer_blocking(ring *r, time_t sec, long nano);
+// must be called with writer lock held
+void ring_set_writer_nonblocking(ring *r);
+
+// get a descriptor which polls readable while there are bytes to read
+int ring_get_reader_fd(ring *r);
+// get a descriptor which polls readable while threshold bytes can be written
+int ring_get_writer_fd(ring *r, size_t threshold);
+
+// lock functions
+// as with ring_atomic, one reader and one writer may run simultaneously
+//    without any locking
+// if there will be more than 1 simultaneous writers, then
+//    every writer must use ring_writer_lock/ring_writer_unlock
+// if there will be more than 1 simultaneous readers, then
+//    every reader must use ring_reader_lock/ring_reader_unlock
+// a blocked call releases its side's lock while it sleeps, the same way
+//    ring_blocking's condvar wait does
+void ring_writer_lock(ring *r);
+void ring_writer_unlock(ring *r);
+void ring_reader_lock(ring *r);
+void ring_reader_unlock(ring *r);
+
+// promise that only one thread will ever write (or read), which turns
+//   the corresponding lock functions into nops
+// must be called before the ring is shared between threads
+void ring_set_exclusive_writer(ring *r);
+void ring_set_exclusive_reader(ring *r);
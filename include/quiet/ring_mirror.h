@@ -0,0 +1,14 @@
+#include <stddef.h>
+#include <stdint.h>
+
+// double-mapped storage for ring buffers
+// the same pages are mapped twice, back to back, so that base[i] and
+//   base[i + length] are the same byte. any span of up to length bytes
+//   which starts inside the ring is then contiguous in memory, and
+//   reads and writes never have to be split at the end of the ring
+
+// length is rounded up to a multiple of the page size, and the rounded
+//   length is written back
+// returns NULL if the mapping could not be made
+uint8_t *ring_mirror_create(size_t *length);
+void ring_mirror_destroy(uint8_t *base, size_t length);
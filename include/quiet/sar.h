@@ -0,0 +1,95 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "quiet/common.h"
+#include "quiet/erasure.h"
+
+// segmentation and reassembly of messages longer than one frame
+// each segment starts with this header, all fields big-endian
+//   id      2 bytes, shared by every segment of a message
+//   index   2 bytes
+//   count   2 bytes, number of data segments in the message
+//   parity  1 byte, number of erasure coded segments following them
+//   len     4 bytes, length of the whole message
+//   crc     4 bytes, crc32 of the whole message
+// every data segment but the last carries ceil(len / count) bytes, so the
+//   receiver can place a segment without having seen the others
+// parity segments are always full length, coded as if the last data
+//   segment were padded with zeros. any count of the count + parity
+//   segments are enough to rebuild the message
+#define SAR_HEADER_LEN 15
+
+// how many recently finished messages are remembered, so that segments
+//   which arrive after their message is done don't start it over
+#define SAR_RECENT_LEN 8
+
+typedef struct {
+    uint16_t id;
+    uint16_t index;
+    uint16_t count;
+    uint8_t parity;
+    uint32_t len;
+    uint32_t crc;
+} sar_header;
+
+uint32_t sar_crc32(const uint8_t *buf, size_t len);
+void sar_header_write(uint8_t *dst, const sar_header *h);
+// returns false if the header is malformed or doesn't match seg_len, the
+//   number of payload bytes following it
+bool sar_header_read(const uint8_t *src, size_t seg_len, sar_header *h);
+// where segment index of a message described by h lands, and its length
+size_t sar_segment_stride(const sar_header *h);
+size_t sar_segment_offset(const sar_header *h, uint16_t index);
+size_t sar_segment_len(const sar_header *h, uint16_t index);
+
+// a message whose segments are still arriving
+typedef struct {
+    bool in_use;
+    uint16_t id;
+    uint16_t count;
+    uint8_t parity;
+    uint16_t received;
+    uint32_t len;
+    uint32_t crc;
+    uint8_t *received_map; // one bit per segment
+    // segments at their offsets. with parity this is every segment at a
+    //   full stride, otherwise just the message
+    uint8_t *data;
+    size_t size;
+    uint64_t last_used;
+} sar_slot;
+
+typedef struct {
+    bool is_set;
+    uint16_t id;
+    uint32_t len;
+    uint32_t crc;
+} sar_recent;
+
+// reassembles messages from segments which may arrive out of order, more
+//   than once, or not at all if enough parity segments make up for them
+// at most num_slots messages are in progress at once, using at most
+//   max_bytes between them. when a new message doesn't fit, the ones
+//   which have gone longest without a segment are abandoned
+// not thread safe
+typedef struct {
+    sar_slot *slots;
+    size_t num_slots;
+    size_t max_bytes;
+    size_t bytes_in_use;
+    uint64_t tick;
+    size_t dropped_messages;
+    sar_recent recent[SAR_RECENT_LEN];
+    size_t recent_next;
+} sar_reassembler;
+
+sar_reassembler *sar_reassembler_create(size_t num_slots, size_t max_bytes);
+void sar_reassembler_destroy(sar_reassembler *r);
+// add one received segment
+// returns true once a message is complete and its crc matches, copying up
+//   to dst_len bytes of it in to dst and setting msg_len to its full length
+bool sar_reassembler_add(sar_reassembler *r, const uint8_t *segment, size_t segment_len,
+                         uint8_t *dst, size_t dst_len, size_t *msg_len);
@@ -0,0 +1,44 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "quiet/common.h"
+
+// one rendered frame. samples are base rate, running from a freshly
+//   reset modulator through the flush at the end of the frame
+typedef struct {
+    uint64_t hash;
+    uint8_t *payload;
+    size_t payload_len;
+    sample_t *samples;
+    size_t samples_len;
+    uint64_t last_used; // 0 if this entry is empty
+} waveform_cache_entry;
+
+// small least-recently-used map from payload bytes to rendered samples
+// each cache belongs to one encoder, so the encoder's configuration is
+//   implicitly part of the key
+// meant for a handful of entries, so lookups scan every entry. not
+//   thread safe
+typedef struct {
+    waveform_cache_entry *entries;
+    size_t num_entries;
+    uint64_t tick;
+} waveform_cache;
+
+waveform_cache *waveform_cache_create(size_t num_entries);
+void waveform_cache_destroy(waveform_cache *c);
+// forget every entry, e.g. once the frames they were rendered for would
+//   now render differently
+void waveform_cache_clear(waveform_cache *c);
+// returns the entry for payload and marks it as most recently used, or
+//   NULL if payload isn't cached
+const waveform_cache_entry *waveform_cache_get(waveform_cache *c, const uint8_t *payload,
+                                               size_t payload_len);
+// copies payload and samples into the cache, evicting the least recently
+//   used entry if the cache is full
+// returns false if the copies could not be allocated
+bool waveform_cache_put(waveform_cache *c, const uint8_t *payload, size_t payload_len,
+                        const sample_t *samples, size_t samples_len);
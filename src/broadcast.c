@@ -0,0 +1,266 @@
+#include "quiet/broadcast.h"
+
+broadcast *broadcast_create(size_t num_slots) {
+    broadcast *b = malloc(sizeof(broadcast));
+    pthread_mutex_init(&b->mutex, NULL);
+    pthread_cond_init(&b->readable, NULL);
+    pthread_cond_init(&b->writable, NULL);
+    b->num_slots = num_slots ? num_slots : 1;
+    b->slots = calloc(b->num_slots, sizeof(broadcast_frame*));
+    b->head = 0;
+    b->freelist = NULL;
+    b->subscribers = NULL;
+    b->num_subscribers = 0;
+    b->is_closed = false;
+    return b;
+}
+
+static void broadcast_frame_destroy(broadcast_frame *f) {
+    free(f->data);
+    free(f);
+}
+
+// must be called with mutex held
+static void broadcast_frame_unref(broadcast *b, broadcast_frame *f) {
+    f->refs--;
+    if (!f->refs) {
+        f->next = b->freelist;
+        b->freelist = f;
+    }
+}
+
+// must be called with mutex held
+static void broadcast_release_locked(broadcast_subscriber *s) {
+    if (s->held) {
+        broadcast_frame_unref(s->b, s->held);
+        s->held = NULL;
+    }
+}
+
+void broadcast_destroy(broadcast *b) {
+    broadcast_subscriber *s = b->subscribers;
+    while (s) {
+        broadcast_subscriber *next = s->next;
+        broadcast_release_locked(s);
+        free(s);
+        s = next;
+    }
+
+    for (size_t i = 0; i < b->num_slots; i++) {
+        if (b->slots[i]) {
+            broadcast_frame_destroy(b->slots[i]);
+        }
+    }
+    while (b->freelist) {
+        broadcast_frame *next = b->freelist->next;
+        broadcast_frame_destroy(b->freelist);
+        b->freelist = next;
+    }
+
+    free(b->slots);
+    pthread_cond_destroy(&b->readable);
+    pthread_cond_destroy(&b->writable);
+    pthread_mutex_destroy(&b->mutex);
+    free(b);
+}
+
+// must be called with mutex held
+static bool broadcast_is_held_back(broadcast *b) {
+    for (broadcast_subscriber *s = b->subscribers; s; s = s->next) {
+        if (s->policy == quiet_overflow_block && b->head - s->cursor >= b->num_slots) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// must be called with mutex held
+// find a frame for the next slot to hold, preferring the one already
+//   there if nobody is still reading it
+static broadcast_frame *broadcast_take_frame(broadcast *b, size_t len) {
+    broadcast_frame **slot = &b->slots[b->head % b->num_slots];
+    broadcast_frame *f = *slot;
+    if (f && f->refs == 1) {
+        f->refs = 0;
+    } else {
+        if (f) {
+            // a subscriber still has the old frame, it'll be reclaimed
+            //   when they release it
+            broadcast_frame_unref(b, f);
+        }
+        f = b->freelist;
+        if (f) {
+            b->freelist = f->next;
+        } else {
+            f = calloc(1, sizeof(broadcast_frame));
+        }
+    }
+
+    if (len > f->cap) {
+        f->data = realloc(f->data, len);
+        f->cap = len;
+    }
+    *slot = f;
+    return f;
+}
+
+bool broadcast_write(broadcast *b, const uint8_t *payload, size_t len) {
+    pthread_mutex_lock(&b->mutex);
+    if (!b->num_subscribers) {
+        pthread_mutex_unlock(&b->mutex);
+        return false;
+    }
+
+    while (!b->is_closed && broadcast_is_held_back(b)) {
+        pthread_cond_wait(&b->writable, &b->mutex);
+    }
+
+    if (b->is_closed) {
+        pthread_mutex_unlock(&b->mutex);
+        return true;
+    }
+
+    broadcast_frame *f = broadcast_take_frame(b, len);
+    memcpy(f->data, payload, len);
+    f->len = len;
+    f->refs = 1;
+    b->head++;
+
+    pthread_cond_broadcast(&b->readable);
+    pthread_mutex_unlock(&b->mutex);
+    return true;
+}
+
+void broadcast_close(broadcast *b) {
+    pthread_mutex_lock(&b->mutex);
+    b->is_closed = true;
+    pthread_cond_broadcast(&b->readable);
+    pthread_cond_broadcast(&b->writable);
+    pthread_mutex_unlock(&b->mutex);
+}
+
+broadcast_subscriber *broadcast_subscribe(broadcast *b, quiet_overflow_policy_t policy) {
+    broadcast_subscriber *s = malloc(sizeof(broadcast_subscriber));
+    s->b = b;
+    s->policy = policy;
+    s->held = NULL;
+    s->dropped_frames = 0;
+    s->is_blocking = false;
+    s->timeout.tv_sec = 0;
+    s->timeout.tv_nsec = 0;
+
+    pthread_mutex_lock(&b->mutex);
+    s->cursor = b->head;
+    s->next = b->subscribers;
+    b->subscribers = s;
+    b->num_subscribers++;
+    pthread_mutex_unlock(&b->mutex);
+    return s;
+}
+
+void broadcast_unsubscribe(broadcast_subscriber *s) {
+    broadcast *b = s->b;
+    pthread_mutex_lock(&b->mutex);
+    broadcast_release_locked(s);
+    for (broadcast_subscriber **p = &b->subscribers; *p; p = &(*p)->next) {
+        if (*p == s) {
+            *p = s->next;
+            break;
+        }
+    }
+    b->num_subscribers--;
+    // the writer may have been waiting on us
+    pthread_cond_broadcast(&b->writable);
+    pthread_mutex_unlock(&b->mutex);
+    free(s);
+}
+
+static struct timespec broadcast_deadline(const broadcast_subscriber *s) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += s->timeout.tv_sec;
+    deadline.tv_nsec += s->timeout.tv_nsec;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    return deadline;
+}
+
+ssize_t broadcast_recv(broadcast_subscriber *s, const uint8_t **frame) {
+    broadcast *b = s->b;
+    bool has_deadline = s->is_blocking && (s->timeout.tv_sec || s->timeout.tv_nsec);
+    struct timespec deadline;
+    if (has_deadline) {
+        deadline = broadcast_deadline(s);
+    }
+
+    pthread_mutex_lock(&b->mutex);
+    broadcast_release_locked(s);
+    while (s->cursor == b->head) {
+        if (b->is_closed) {
+            pthread_mutex_unlock(&b->mutex);
+            return 0;
+        }
+        if (!s->is_blocking) {
+            pthread_mutex_unlock(&b->mutex);
+            return RingErrorWouldBlock;
+        }
+        int res;
+        if (has_deadline) {
+            res = pthread_cond_timedwait(&b->readable, &b->mutex, &deadline);
+        } else {
+            res = pthread_cond_wait(&b->readable, &b->mutex);
+        }
+        if (res == ETIMEDOUT) {
+            pthread_mutex_unlock(&b->mutex);
+            return RingErrorTimedout;
+        }
+    }
+
+    if (b->head - s->cursor > b->num_slots) {
+        // the writer has lapped us, so skip to the oldest frame still kept
+        // only possible with drop_oldest, as block holds the writer back
+        s->dropped_frames += b->head - s->cursor - b->num_slots;
+        s->cursor = b->head - b->num_slots;
+    }
+
+    broadcast_frame *f = b->slots[s->cursor % b->num_slots];
+    f->refs++;
+    s->held = f;
+    s->cursor++;
+    if (s->policy == quiet_overflow_block) {
+        pthread_cond_signal(&b->writable);
+    }
+    pthread_mutex_unlock(&b->mutex);
+
+    *frame = f->data;
+    return f->len;
+}
+
+void broadcast_release(broadcast_subscriber *s) {
+    pthread_mutex_lock(&s->b->mutex);
+    broadcast_release_locked(s);
+    pthread_mutex_unlock(&s->b->mutex);
+}
+
+void broadcast_set_blocking(broadcast_subscriber *s, time_t sec, long nano) {
+    pthread_mutex_lock(&s->b->mutex);
+    s->is_blocking = true;
+    s->timeout.tv_sec = sec;
+    s->timeout.tv_nsec = nano;
+    pthread_mutex_unlock(&s->b->mutex);
+}
+
+void broadcast_set_nonblocking(broadcast_subscriber *s) {
+    pthread_mutex_lock(&s->b->mutex);
+    s->is_blocking = false;
+    pthread_mutex_unlock(&s->b->mutex);
+}
+
+size_t broadcast_dropped_frames(broadcast_subscriber *s) {
+    pthread_mutex_lock(&s->b->mutex);
+    size_t dropped = s->dropped_frames;
+    pthread_mutex_unlock(&s->b->mutex);
+    return dropped;
+}
@@ -0,0 +1,197 @@
+#include "quiet/compress.h"
+
+#define COMPRESS_HASH_BITS 12
+
+// dict and src as one buffer, so that matches can run across the seam
+typedef struct {
+    const uint8_t *dict;
+    size_t dict_len;
+    const uint8_t *src;
+} compress_view;
+
+typedef struct {
+    uint8_t *dst;
+    size_t len;
+    size_t cap;
+    bool is_full;
+} compress_writer;
+
+static uint8_t compress_at(const compress_view *v, size_t pos) {
+    return (pos < v->dict_len) ? v->dict[pos] : v->src[pos - v->dict_len];
+}
+
+static uint32_t compress_read32(const compress_view *v, size_t pos) {
+    return ((uint32_t)compress_at(v, pos) << 24) | ((uint32_t)compress_at(v, pos + 1) << 16) |
+           ((uint32_t)compress_at(v, pos + 2) << 8) | compress_at(v, pos + 3);
+}
+
+static size_t compress_hash(uint32_t v) {
+    return (v * 2654435761u) >> (32 - COMPRESS_HASH_BITS);
+}
+
+static void compress_put(compress_writer *w, uint8_t b) {
+    if (w->len == w->cap) {
+        w->is_full = true;
+        return;
+    }
+    w->dst[w->len++] = b;
+}
+
+// the part of a length which didn't fit in its nibble
+static void compress_put_len(compress_writer *w, size_t len) {
+    for (; len >= 255; len -= 255) {
+        compress_put(w, 255);
+    }
+    compress_put(w, len);
+}
+
+static void compress_put_literals(compress_writer *w, const uint8_t *literals, size_t len) {
+    if (len > w->cap - w->len) {
+        w->is_full = true;
+        return;
+    }
+    memcpy(w->dst + w->len, literals, len);
+    w->len += len;
+}
+
+// one sequence, or the last one if match_len is 0
+static void compress_put_sequence(compress_writer *w, const uint8_t *literals, size_t literals_len,
+                                  size_t offset, size_t match_len) {
+    size_t match_extra = match_len ? match_len - COMPRESS_MIN_MATCH : 0;
+    uint8_t token = ((literals_len < 15 ? literals_len : 15) << 4) |
+                    (match_extra < 15 ? match_extra : 15);
+    compress_put(w, token);
+    if (literals_len >= 15) {
+        compress_put_len(w, literals_len - 15);
+    }
+    compress_put_literals(w, literals, literals_len);
+    if (!match_len) {
+        return;
+    }
+    compress_put(w, offset >> 8);
+    compress_put(w, offset & 0xff);
+    if (match_extra >= 15) {
+        compress_put_len(w, match_extra - 15);
+    }
+}
+
+size_t compress_lz(const uint8_t *dict, size_t dict_len, const uint8_t *src, size_t src_len,
+                   uint8_t *dst, size_t dst_len) {
+    if (dict_len > COMPRESS_MAX_OFFSET) {
+        dict += dict_len - COMPRESS_MAX_OFFSET;
+        dict_len = COMPRESS_MAX_OFFSET;
+    }
+    compress_view v = {
+        .dict = dict,
+        .dict_len = dict_len,
+        .src = src,
+    };
+    compress_writer w = {
+        .dst = dst,
+        .len = 0,
+        .cap = dst_len,
+        .is_full = false,
+    };
+
+    // most recent position of each hashed 4 byte run, or SIZE_MAX
+    size_t table[1 << COMPRESS_HASH_BITS];
+    for (size_t i = 0; i < (1 << COMPRESS_HASH_BITS); i++) {
+        table[i] = SIZE_MAX;
+    }
+
+    size_t end = dict_len + src_len;
+    size_t pos = 0;
+    for (; pos < dict_len && pos + COMPRESS_MIN_MATCH <= end; pos++) {
+        table[compress_hash(compress_read32(&v, pos))] = pos;
+    }
+
+    pos = dict_len;
+    size_t anchor = dict_len;
+    while (pos + COMPRESS_MIN_MATCH <= end && !w.is_full) {
+        uint32_t run = compress_read32(&v, pos);
+        size_t h = compress_hash(run);
+        size_t candidate = table[h];
+        table[h] = pos;
+        if (candidate == SIZE_MAX || pos - candidate > COMPRESS_MAX_OFFSET ||
+            compress_read32(&v, candidate) != run) {
+            pos++;
+            continue;
+        }
+
+        size_t match_len = COMPRESS_MIN_MATCH;
+        while (pos + match_len < end &&
+               compress_at(&v, candidate + match_len) == compress_at(&v, pos + match_len)) {
+            match_len++;
+        }
+        compress_put_sequence(&w, src + (anchor - dict_len), pos - anchor, pos - candidate,
+                              match_len);
+        pos += match_len;
+        anchor = pos;
+    }
+    compress_put_sequence(&w, src + (anchor - dict_len), end - anchor, 0, 0);
+
+    return w.is_full ? 0 : w.len;
+}
+
+// adds the 255s which follow a saturated nibble on to len
+static bool decompress_len(const uint8_t *src, size_t src_len, size_t *in, size_t *len) {
+    while (true) {
+        if (*in == src_len) {
+            return false;
+        }
+        uint8_t b = src[(*in)++];
+        *len += b;
+        if (b != 255) {
+            return true;
+        }
+    }
+}
+
+ssize_t decompress_lz(const uint8_t *dict, size_t dict_len, const uint8_t *src, size_t src_len,
+                      uint8_t *dst, size_t dst_len) {
+    if (dict_len > COMPRESS_MAX_OFFSET) {
+        dict += dict_len - COMPRESS_MAX_OFFSET;
+        dict_len = COMPRESS_MAX_OFFSET;
+    }
+
+    size_t in = 0, out = 0;
+    while (in < src_len) {
+        uint8_t token = src[in++];
+
+        size_t literals_len = token >> 4;
+        if (literals_len == 15 && !decompress_len(src, src_len, &in, &literals_len)) {
+            return -1;
+        }
+        if (literals_len > src_len - in || literals_len > dst_len - out) {
+            return -1;
+        }
+        memcpy(dst + out, src + in, literals_len);
+        in += literals_len;
+        out += literals_len;
+        if (in == src_len) {
+            return out;
+        }
+
+        if (src_len - in < 2) {
+            return -1;
+        }
+        size_t offset = ((size_t)src[in] << 8) | src[in + 1];
+        in += 2;
+        size_t match_len = token & 0x0f;
+        if (match_len == 15 && !decompress_len(src, src_len, &in, &match_len)) {
+            return -1;
+        }
+        match_len += COMPRESS_MIN_MATCH;
+        if (!offset || offset > dict_len + out || match_len > dst_len - out) {
+            return -1;
+        }
+
+        // byte at a time, as a match may overlap its own output
+        for (size_t i = 0; i < match_len; i++, out++) {
+            size_t from = dict_len + out - offset;
+            dst[out] = (from < dict_len) ? dict[from] : dst[from - dict_len];
+        }
+    }
+    // every stream ends with a literal run, even an empty one
+    return -1;
+}
@@ -4,6 +4,50 @@ unsigned int quiet_decoder_checksum_fails(const quiet_decoder *d) {
     return d->checksum_fails;
 }
 
+unsigned int quiet_decoder_combined_frames(const quiet_decoder *d) {
+    return d->combined_frames;
+}
+
+size_t quiet_decoder_dropped_frames(quiet_decoder *d) {
+    ring_reader_lock(d->buf);
+    size_t dropped = d->dropped_frames;
+    ring_reader_unlock(d->buf);
+    return dropped;
+}
+
+size_t quiet_decoder_dropped_bytes(quiet_decoder *d) {
+    ring_reader_lock(d->buf);
+    size_t dropped = d->dropped_bytes;
+    ring_reader_unlock(d->buf);
+    return dropped;
+}
+
+static void decoder_count_drop(decoder *d, size_t len) {
+    ring_reader_lock(d->buf);
+    d->dropped_frames++;
+    d->dropped_bytes += len;
+    ring_reader_unlock(d->buf);
+}
+
+// discard the oldest queued frame to make room for a newer one
+// returns false if there was nothing left to discard
+static bool decoder_drop_oldest(decoder *d) {
+    ring_reader_lock(d->buf);
+    // we're the only writer and we hold the reader lock, so anything we
+    //   see here stays readable, and the read below can't block
+    if (ring_read_available(d->buf) < sizeof(size_t)) {
+        ring_reader_unlock(d->buf);
+        return false;
+    }
+    size_t len;
+    ring_read(d->buf, &len, sizeof(size_t));
+    ring_advance_reader(d->buf, len);
+    d->dropped_frames++;
+    d->dropped_bytes += len;
+    ring_reader_unlock(d->buf);
+    return true;
+}
+
 static void decoder_collect_stats(decoder *d, framesyncstats_s stats, int payload_valid) {
     size_t stats_index = d->num_frames_collected;
     if (stats_index < num_frames_stats) {
@@ -108,6 +152,92 @@ static void decoder_collect_stats(decoder *d, framesyncstats_s stats, int payloa
     ring_writer_unlock(d->stats_ring);
 }
 
+// fold a copy which failed its checksum in to the mean of the copies of
+//   the same frame before it, then decode the mean
+// seq is the sequence number from the copy's frame header
+// averaging happens before demodulation, so the error correction sees
+//   symbols with the noise of the copies partly cancelled out
+// returns true if the mean passes its checksum, leaving the payload in
+//   combined_payload
+static bool decoder_combine(decoder *d, uint8_t seq, unsigned int payload_len,
+                            const framesyncstats_s *stats) {
+    if (!d->combiner || !stats->num_framesyms) {
+        return false;
+    }
+
+    // a copy of this frame already got through, so the rest aren't needed
+    if (d->has_repeat_seq && d->repeat_seq == seq) {
+        return false;
+    }
+
+    size_t num_symbols = stats->num_framesyms;
+    // copies are matched on their header's sequence number. copies of one
+    //   frame also always have the same shape, and anything else, or more
+    //   copies than the encoder sends, means the sequence number wrapped
+    bool is_same_frame = d->num_combined && d->combined_seq == seq &&
+                         d->num_combined <= d->opt.frame_repeats &&
+                         d->combined_stats.num_framesyms == num_symbols &&
+                         d->combined_payload_len == payload_len &&
+                         d->combined_stats.mod_scheme == stats->mod_scheme &&
+                         d->combined_stats.check == stats->check &&
+                         d->combined_stats.fec0 == stats->fec0 &&
+                         d->combined_stats.fec1 == stats->fec1;
+    if (!is_same_frame) {
+        if (num_symbols > d->combined_symbols_cap) {
+            float complex *symbols = realloc(d->combined_symbols, num_symbols * sizeof(float complex));
+            if (!symbols) {
+                d->num_combined = 0;
+                return false;
+            }
+            d->combined_symbols = symbols;
+            d->combined_symbols_cap = num_symbols;
+        }
+        memcpy(d->combined_symbols, stats->framesyms, num_symbols * sizeof(float complex));
+        d->combined_stats = *stats;
+        d->combined_payload_len = payload_len;
+        d->combined_seq = seq;
+        d->num_combined = 1;
+        return false;
+    }
+
+    d->num_combined++;
+    for (size_t i = 0; i < num_symbols; i++) {
+        d->combined_symbols[i] += (stats->framesyms[i] - d->combined_symbols[i]) / d->num_combined;
+    }
+
+    uint8_t *combined_payload = realloc(d->combined_payload, payload_len ? payload_len : 1);
+    if (!combined_payload) {
+        return false;
+    }
+    d->combined_payload = combined_payload;
+
+    qpacketmodem_configure(d->combiner, payload_len, stats->check, stats->fec0, stats->fec1,
+                           stats->mod_scheme);
+    if (qpacketmodem_get_frame_len(d->combiner) != num_symbols) {
+        return false;
+    }
+    if (!qpacketmodem_decode_soft(d->combiner, d->combined_symbols, d->combined_payload)) {
+        return false;
+    }
+    d->num_combined = 0;
+    d->combined_frames++;
+    return true;
+}
+
+// true for the first copy of a repeated frame to be received
+static bool decoder_is_new_repeat(decoder *d, const unsigned char *payload,
+                                  size_t payload_len) {
+    if (payload_len < REPEAT_HEADER_LEN) {
+        return false;
+    }
+    if (d->has_repeat_seq && d->repeat_seq == payload[0]) {
+        return false;
+    }
+    d->has_repeat_seq = true;
+    d->repeat_seq = payload[0];
+    return true;
+}
+
 static int decoder_on_decode(unsigned char *header, int header_valid, unsigned char *payload,
                              unsigned int payload_len, int payload_valid,
                              framesyncstats_s stats, void *dvoid) {
@@ -129,8 +259,108 @@ static int decoder_on_decode(unsigned char *header, int header_valid, unsigned c
 
     if (!payload_valid) {
         d->checksum_fails++;
-        return 1;
+        if (!d->opt.frame_repeats || !decoder_combine(d, header[0], payload_len, &stats)) {
+            return 1;
+        }
+        payload = d->combined_payload;
+    } else {
+        // once a copy gets through, the others aren't needed
+        d->num_combined = 0;
+    }
+
+    if (d->opt.frame_repeats) {
+        if (!decoder_is_new_repeat(d, payload, payload_len)) {
+            return 0;
+        }
+        payload += REPEAT_HEADER_LEN;
+        payload_len -= REPEAT_HEADER_LEN;
+    }
+
+    if (!d->opt.aggregate) {
+        decoder_deliver(d, payload, payload_len, stats);
+        return 0;
+    }
+
+    // split the frame back in to the messages that were packed in to it
+    // a length which runs past the end means the sender's framing doesn't
+    //   match ours, so the rest of the frame is dropped
+    size_t offset = 0;
+    while (offset + SUBFRAME_HEADER_LEN <= payload_len) {
+        size_t len = ((size_t)payload[offset] << 8) | payload[offset + 1];
+        offset += SUBFRAME_HEADER_LEN;
+        if (len > payload_len - offset) {
+            decoder_count_drop(d, payload_len - offset);
+            break;
+        }
+        decoder_deliver(d, payload + offset, len, stats);
+        offset += len;
     }
+    return 0;
+}
+
+// undo the compression stage, leaving the message in decompressframe
+//   unless it was sent as it is
+// returns NULL if the message is malformed
+static unsigned char *decoder_decompress(decoder *d, unsigned char *payload,
+                                         size_t *payload_len) {
+    if (*payload_len < COMPRESS_HEADER_LEN) {
+        return NULL;
+    }
+    switch (payload[0]) {
+    case compress_flag_raw:
+        *payload_len -= COMPRESS_HEADER_LEN;
+        return payload + COMPRESS_HEADER_LEN;
+    case compress_flag_lz:
+        if (!d->decompressframe) {
+            d->decompressframe = malloc(decoder_max_decompressed_len);
+            if (!d->decompressframe) {
+                return NULL;
+            }
+        }
+        ssize_t len = decompress_lz(d->compression_dict, d->compression_dict_len,
+                                    payload + COMPRESS_HEADER_LEN,
+                                    *payload_len - COMPRESS_HEADER_LEN, d->decompressframe,
+                                    decoder_max_decompressed_len);
+        if (len < 0) {
+            return NULL;
+        }
+        *payload_len = len;
+        return d->decompressframe;
+    }
+    return NULL;
+}
+
+// pass one received message to whichever consumer is attached
+static void decoder_deliver(decoder *d, unsigned char *payload, size_t payload_len,
+                            framesyncstats_s stats) {
+    if (d->opt.compress) {
+        unsigned char *message = decoder_decompress(d, payload, &payload_len);
+        if (!message) {
+            decoder_count_drop(d, payload_len);
+            return;
+        }
+        payload = message;
+    }
+
+    if (d->frame_callback) {
+        // hand the frame over without a copy. the payload belongs to
+        // liquid and is only valid until we return
+        quiet_decoder_frame_stats fstats = {
+            .symbols = NULL,
+            .num_symbols = 0,
+            .error_vector_magnitude = stats.evm,
+            .received_signal_strength_indicator = stats.rssi,
+            .checksum_passed = true,
+        };
+        d->frame_callback(d->frame_callback_ctx, payload, payload_len, &fstats);
+        return;
+    }
+
+#if QUIET_BROADCAST
+    if (broadcast_write(d->bcast, payload, payload_len)) {
+        return;
+    }
+#endif
 
     size_t framelen = payload_len + sizeof(size_t);
     if (framelen > d->writeframe_len) {
@@ -143,9 +373,21 @@ static int decoder_on_decode(unsigned char *header, int header_valid, unsigned c
     memcpy(d->writeframe + (sizeof(size_t)), payload, len);
 
     ring_writer_lock(d->buf);
-    ring_write(d->buf, d->writeframe, framelen);
+    ssize_t written = ring_write(d->buf, d->writeframe, framelen);
     ring_writer_unlock(d->buf);
-    return 0;
+
+    if (d->opt.overflow_policy == quiet_overflow_drop_oldest) {
+        while (written == RingErrorWouldBlock && decoder_drop_oldest(d)) {
+            ring_writer_lock(d->buf);
+            written = ring_write(d->buf, d->writeframe, framelen);
+            ring_writer_unlock(d->buf);
+        }
+    }
+
+    // 0 means the decoder was closed, which isn't a drop
+    if (written < 0) {
+        decoder_count_drop(d, payload_len);
+    }
 }
 
 static void decoder_ofdm_create(const decoder_options *opt, decoder *d) {
@@ -155,7 +397,7 @@ static void decoder_ofdm_create(const decoder_options *opt, decoder *d) {
     ofdm.framesync = ofdmflexframesync_create(
         opt->ofdmopt.num_subcarriers, opt->ofdmopt.cyclic_prefix_len,
         opt->ofdmopt.taper_len, subcarriers, decoder_on_decode, d);
-    ofdmflexframesync_set_header_len(ofdm.framesync, 0);
+    ofdmflexframesync_set_header_len(ofdm.framesync, opt->frame_repeats ? REPEAT_TAG_LEN : 0);
     if (opt->is_debug) {
         ofdmflexframesync_debug_enable(ofdm.framesync);
     }
@@ -186,7 +428,7 @@ static void decoder_modem_create(const decoder_options *opt, decoder *d) {
     modem_decoder modem;
 
     modem.framesync = flexframesync_create(decoder_on_decode, d);
-    flexframesync_set_header_len(modem.framesync, 0);
+    flexframesync_set_header_len(modem.framesync, opt->frame_repeats ? REPEAT_TAG_LEN : 0);
     if (opt->is_debug) {
         flexframesync_debug_enable(modem.framesync);
     }
@@ -213,7 +455,7 @@ static void decoder_gmsk_create(const decoder_options *opt, decoder *d) {
     gmsk_decoder gmsk;
 
     gmsk.framesync = gmskframesync_create(decoder_on_decode, d);
-    gmskframesync_set_header_len(gmsk.framesync, 0);
+    gmskframesync_set_header_len(gmsk.framesync, opt->frame_repeats ? REPEAT_TAG_LEN : 0);
 
     if (opt->is_debug) {
         gmskframesync_debug_enable(gmsk.framesync);
@@ -227,6 +469,13 @@ static void decoder_gmsk_create(const decoder_options *opt, decoder *d) {
 }
 
 decoder *quiet_decoder_create(const decoder_options *opt, float sample_rate) {
+#if !(RING_BLOCKING || RING_FUTEX)
+    if (opt->overflow_policy == quiet_overflow_block) {
+        quiet_set_last_error(quiet_decoder_bad_config);
+        return NULL;
+    }
+#endif
+
     decoder *d = malloc(sizeof(decoder));
 
     d->opt = *opt;
@@ -262,10 +511,57 @@ decoder *quiet_decoder_create(const decoder_options *opt, float sample_rate) {
     d->baserate_offset = 0;
 
     d->checksum_fails = 0;
-
-    d->buf = ring_create(decoder_default_buffer_len);
+    d->has_repeat_seq = false;
+    d->repeat_seq = 0;
+    d->combiner = NULL;
+    if (opt->frame_repeats && opt->encoding == modem_encoding) {
+        d->combiner = qpacketmodem_create();
+    }
+    d->combined_symbols = NULL;
+    d->combined_symbols_cap = 0;
+    d->num_combined = 0;
+    d->combined_seq = 0;
+    d->combined_payload_len = 0;
+    d->combined_payload = NULL;
+    d->combined_frames = 0;
+
+    d->buf = ring_create(opt->queue_len ? opt->queue_len : decoder_default_buffer_len);
+    if (d->buf) {
+        // frames are only ever written from the thread calling consume
+        ring_set_exclusive_writer(d->buf);
+        if (opt->overflow_policy == quiet_overflow_block) {
+            ring_set_writer_blocking(d->buf, 0, 0);
+        }
+    }
+    d->dropped_frames = 0;
+    d->dropped_bytes = 0;
     d->writeframe_len = 0;
     d->writeframe = NULL;
+    d->frame_callback = NULL;
+    d->frame_callback_ctx = NULL;
+    d->reassembler = sar_reassembler_create(
+        opt->reassembly_slots ? opt->reassembly_slots : decoder_default_reassembly_slots,
+        opt->reassembly_len ? opt->reassembly_len : decoder_default_reassembly_len);
+    d->segment = NULL;
+    d->segment_len = 0;
+    d->unsegmented_frames = 0;
+    d->compression_dict = NULL;
+    d->compression_dict_len = 0;
+    if (opt->compress && opt->compression_dictionary_len) {
+        d->compression_dict = malloc(opt->compression_dictionary_len);
+        memcpy(d->compression_dict, opt->compression_dictionary,
+               opt->compression_dictionary_len);
+        d->compression_dict_len = opt->compression_dictionary_len;
+    }
+    d->opt.compression_dictionary = NULL;
+    d->decompressframe = NULL;
+    atomic_init(&d->sense.is_busy, false);
+    atomic_init(&d->sense.now, 0);
+    d->sensed_samples = 0;
+#if QUIET_BROADCAST
+    d->bcast = broadcast_create(opt->broadcast_queue_len ? opt->broadcast_queue_len
+                                                         : decoder_default_broadcast_len);
+#endif
 
     d->stats_enabled = false;
     for (size_t i = 0; i < num_frames_stats; i++) {
@@ -276,6 +572,14 @@ decoder *quiet_decoder_create(const decoder_options *opt, float sample_rate) {
     d->stats_packed = NULL;
     d->stats_unpacked = NULL;
 
+    // a mirrored queue needs a memfd and two mappings, any of which may
+    //   fail, so only now that everything else is set up can we unwind
+    if (!d->buf) {
+        quiet_decoder_destroy(d);
+        quiet_set_last_error(quiet_mem_fail);
+        return NULL;
+    }
+
     return d;
 }
 
@@ -291,6 +595,103 @@ void quiet_decoder_set_nonblocking(quiet_decoder *d) {
     ring_reader_unlock(d->buf);
 }
 
+int quiet_decoder_get_fd(quiet_decoder *d) {
+    ring_reader_lock(d->buf);
+    int fd = ring_get_reader_fd(d->buf);
+    ring_reader_unlock(d->buf);
+    if (fd < 0) {
+        quiet_set_last_error(quiet_io);
+    }
+    return fd;
+}
+
+void quiet_decoder_set_frame_callback(quiet_decoder *d, quiet_decoder_frame_callback fn,
+                                      void *ctx) {
+    d->frame_callback = fn;
+    d->frame_callback_ctx = ctx;
+}
+
+#if QUIET_BROADCAST
+quiet_decoder_subscriber *quiet_decoder_subscribe(quiet_decoder *d, quiet_overflow_policy_t policy) {
+    if (policy != quiet_overflow_drop_oldest && policy != quiet_overflow_block) {
+        quiet_set_last_error(quiet_decoder_bad_config);
+        return NULL;
+    }
+    return broadcast_subscribe(d->bcast, policy);
+}
+
+void quiet_decoder_unsubscribe(quiet_decoder_subscriber *s) {
+    broadcast_unsubscribe(s);
+}
+
+ssize_t quiet_decoder_subscriber_recv(quiet_decoder_subscriber *s, const uint8_t **frame) {
+    ssize_t len = broadcast_recv(s, frame);
+    if (len < 0) {
+        switch (len) {
+            case RingErrorWouldBlock:
+                quiet_set_last_error(quiet_would_block);
+                break;
+            case RingErrorTimedout:
+                quiet_set_last_error(quiet_timedout);
+                break;
+            default:
+                quiet_set_last_error(quiet_io);
+        }
+        return -1;
+    }
+    return len;
+}
+
+void quiet_decoder_subscriber_release(quiet_decoder_subscriber *s) {
+    broadcast_release(s);
+}
+
+void quiet_decoder_subscriber_set_blocking(quiet_decoder_subscriber *s, time_t sec, long nano) {
+    broadcast_set_blocking(s, sec, nano);
+}
+
+void quiet_decoder_subscriber_set_nonblocking(quiet_decoder_subscriber *s) {
+    broadcast_set_nonblocking(s);
+}
+
+size_t quiet_decoder_subscriber_dropped_frames(quiet_decoder_subscriber *s) {
+    return broadcast_dropped_frames(s);
+}
+#else
+quiet_decoder_subscriber *quiet_decoder_subscribe(quiet_decoder *d, quiet_overflow_policy_t policy) {
+    quiet_set_last_error(quiet_decoder_bad_config);
+    return NULL;
+}
+
+// without pthread there is no way to get a subscriber, so these are unreachable
+void quiet_decoder_unsubscribe(quiet_decoder_subscriber *s) {
+    assert(false && "subscribers not supported by this version. please recompile with pthread support");
+}
+
+ssize_t quiet_decoder_subscriber_recv(quiet_decoder_subscriber *s, const uint8_t **frame) {
+    assert(false && "subscribers not supported by this version. please recompile with pthread support");
+    quiet_set_last_error(quiet_io);
+    return -1;
+}
+
+void quiet_decoder_subscriber_release(quiet_decoder_subscriber *s) {
+    assert(false && "subscribers not supported by this version. please recompile with pthread support");
+}
+
+void quiet_decoder_subscriber_set_blocking(quiet_decoder_subscriber *s, time_t sec, long nano) {
+    assert(false && "subscribers not supported by this version. please recompile with pthread support");
+}
+
+void quiet_decoder_subscriber_set_nonblocking(quiet_decoder_subscriber *s) {
+    assert(false && "subscribers not supported by this version. please recompile with pthread support");
+}
+
+size_t quiet_decoder_subscriber_dropped_frames(quiet_decoder_subscriber *s) {
+    assert(false && "subscribers not supported by this version. please recompile with pthread support");
+    return 0;
+}
+#endif
+
 void quiet_decoder_set_stats_blocking(quiet_decoder *d, time_t sec, long nano) {
     if (d->stats_ring) {
         ring_reader_lock(d->stats_ring);
@@ -316,7 +717,14 @@ void quiet_decoder_enable_stats(quiet_decoder *d) {
     }
     d->num_frames_collected = 0;
 
-    d->stats_ring = ring_create(decoder_default_stats_buffer_len);
+    d->stats_ring = ring_create(d->opt.stats_queue_len ? d->opt.stats_queue_len
+                                                       : decoder_default_stats_buffer_len);
+    if (!d->stats_ring) {
+        d->stats_enabled = false;
+        quiet_set_last_error(quiet_mem_fail);
+        return;
+    }
+    ring_set_exclusive_writer(d->stats_ring);
     d->stats_packed = NULL;
     d->stats_packed_len = 0;
     d->stats_unpacked = malloc(sizeof(quiet_decoder_frame_stats));
@@ -489,6 +897,37 @@ ssize_t quiet_decoder_recv(quiet_decoder *d, uint8_t *data, size_t len) {
     return len;
 }
 
+ssize_t quiet_decoder_recv_message(quiet_decoder *d, uint8_t *data, size_t len) {
+    if (!d->segment) {
+        // large enough for any segment an encoder will send
+        d->segment_len = SAR_HEADER_LEN + (1 << 16);
+        d->segment = malloc(d->segment_len);
+    }
+
+    while (true) {
+        ssize_t segment_len = quiet_decoder_recv(d, d->segment, d->segment_len);
+        if (segment_len <= 0) {
+            // quiet_decoder_recv has already set the error
+            return segment_len;
+        }
+        sar_header h;
+        if (segment_len < SAR_HEADER_LEN ||
+            !sar_header_read(d->segment, segment_len - SAR_HEADER_LEN, &h)) {
+            // most likely sent with quiet_encoder_send, and lost to us
+            d->unsegmented_frames++;
+            continue;
+        }
+        size_t msg_len;
+        if (sar_reassembler_add(d->reassembler, d->segment, segment_len, data, len, &msg_len)) {
+            return (msg_len < len) ? msg_len : len;
+        }
+    }
+}
+
+size_t quiet_decoder_dropped_messages(quiet_decoder *d) {
+    return d->reassembler->dropped_messages + d->unsegmented_frames;
+}
+
 static size_t decoder_max_len(decoder *d) {
     if (!d) {
         return 0;
@@ -595,9 +1034,42 @@ ssize_t quiet_decoder_consume(decoder *d, const sample_t *samplebuf, size_t samp
         }
     }
 
+    decoder_sense_channel(d, samplebuf, sample_len);
+
     return sample_len;
 }
 
+carrier_sense *decoder_carrier_sense(decoder *d) {
+    return &d->sense;
+}
+
+bool quiet_decoder_channel_busy(quiet_decoder *d) {
+    return atomic_load_explicit(&d->sense.is_busy, memory_order_acquire);
+}
+
+// listen to the block just consumed, for encoders sharing the channel
+// the channel is busy while a frame is being received, or while the block
+//   is louder than the threshold, which also catches frames too weak or
+//   too mangled to synchronize on
+static void decoder_sense_channel(decoder *d, const sample_t *samplebuf, size_t sample_len) {
+    float power = 0;
+    for (size_t i = 0; i < sample_len; i++) {
+        power += samplebuf[i] * samplebuf[i];
+    }
+    if (sample_len) {
+        power /= sample_len;
+    }
+    // options are zeroed by default, so 0dB itself stands for the default
+    float threshold = d->opt.carrier_sense_threshold ? d->opt.carrier_sense_threshold
+                                                     : decoder_default_carrier_sense_threshold;
+    bool is_loud = power > 0 && 10 * log10f(power) > threshold;
+    bool is_busy = is_loud || quiet_decoder_frame_in_progress(d);
+
+    d->sensed_samples += sample_len * d->resample_rate;
+    atomic_store_explicit(&d->sense.is_busy, is_busy, memory_order_release);
+    atomic_store_explicit(&d->sense.now, (uint64_t)d->sensed_samples, memory_order_release);
+}
+
 bool quiet_decoder_frame_in_progress(decoder *d) {
     switch (d->opt.encoding) {
     case ofdm_encoding:
@@ -693,6 +1165,10 @@ void quiet_decoder_close(decoder *d) {
         ring_close(d->stats_ring);
         ring_reader_unlock(d->stats_ring);
     }
+
+#if QUIET_BROADCAST
+    broadcast_close(d->bcast);
+#endif
 }
 
 void quiet_decoder_destroy(decoder *d) {
@@ -722,7 +1198,21 @@ void quiet_decoder_destroy(decoder *d) {
             free(d->stats_symbols[i]);
         }
     }
-    ring_destroy(d->buf);
+    if (d->combiner) {
+        qpacketmodem_destroy(d->combiner);
+    }
+    free(d->combined_symbols);
+    free(d->combined_payload);
+    if (d->buf) {
+        ring_destroy(d->buf);
+    }
+    sar_reassembler_destroy(d->reassembler);
+    free(d->segment);
+    free(d->compression_dict);
+    free(d->decompressframe);
+#if QUIET_BROADCAST
+    broadcast_destroy(d->bcast);
+#endif
     if (d->stats_ring) {
         ring_destroy(d->stats_ring);
     }
@@ -14,7 +14,7 @@ void encoder_ofdm_create(const encoder_options *opt, encoder *e) {
     ofdm.framegen = ofdmflexframegen_create(
         opt->ofdmopt.num_subcarriers, opt->ofdmopt.cyclic_prefix_len,
         opt->ofdmopt.taper_len, subcarriers, &props);
-    ofdmflexframegen_set_header_len(ofdm.framegen, 0);
+    ofdmflexframegen_set_header_len(ofdm.framegen, opt->frame_repeats ? REPEAT_TAG_LEN : 0);
     if (opt->header_override_defaults) {
         ofdmflexframegenprops_s header_props = {
             .check = opt->header_checksum_scheme,
@@ -47,7 +47,7 @@ void encoder_modem_create(const encoder_options *opt, encoder *e) {
     };
 
     modem.framegen = flexframegen_create(&props);
-    flexframegen_set_header_len(modem.framegen, 0);
+    flexframegen_set_header_len(modem.framegen, opt->frame_repeats ? REPEAT_TAG_LEN : 0);
     if (opt->header_override_defaults) {
         flexframegenprops_s header_props = {
             .check = opt->header_checksum_scheme,
@@ -68,7 +68,7 @@ void encoder_gmsk_create(const encoder_options *opt, encoder *e) {
     gmsk_encoder gmsk;
 
     gmsk.framegen = gmskframegen_create();
-    gmskframegen_set_header_len(gmsk.framegen, 0);
+    gmskframegen_set_header_len(gmsk.framegen, opt->frame_repeats ? REPEAT_TAG_LEN : 0);
 
     // we should eventually try to get gmskframegen to tell us about this
     // tldr gmskframegen writes *always* happen in lengths of 2 samples
@@ -80,12 +80,81 @@ void encoder_gmsk_create(const encoder_options *opt, encoder *e) {
     e->frame.gmsk = gmsk;
 }
 
+// bytes of each frame taken by the headers of the features in use, which
+//   leaves the rest for the message
+static size_t encoder_frame_overhead(const encoder_options *opt) {
+    size_t overhead = 0;
+    if (opt->aggregate) {
+        overhead += SUBFRAME_HEADER_LEN;
+    }
+    if (opt->frame_repeats) {
+        overhead += REPEAT_HEADER_LEN;
+    }
+    if (opt->compress) {
+        overhead += COMPRESS_HEADER_LEN;
+    }
+    return overhead;
+}
+
 encoder *quiet_encoder_create(const encoder_options *opt, float sample_rate) {
     if (opt->modopt.gain < 0 || opt->modopt.gain > 0.5) {
         quiet_set_last_error(quiet_encoder_bad_config);
         return NULL;
     }
 
+    // the queue must be able to hold at least one full-sized frame
+    if (opt->queue_len && opt->queue_len <= sizeof(encoder_frame_header) + opt->frame_len) {
+        quiet_set_last_error(quiet_encoder_bad_config);
+        return NULL;
+    }
+
+#if !(RING_BLOCKING || RING_FUTEX)
+    if (opt->overflow_policy == quiet_overflow_block) {
+        quiet_set_last_error(quiet_encoder_bad_config);
+        return NULL;
+    }
+#endif
+
+    if (opt->multi_producer && opt->overflow_policy != quiet_overflow_drop_newest) {
+        quiet_set_last_error(quiet_encoder_bad_config);
+        return NULL;
+    }
+
+    // each message in an aggregate needs room for its length, which must
+    //   fit in 16 bits
+    if (opt->aggregate && (opt->frame_len <= SUBFRAME_HEADER_LEN ||
+                           opt->frame_len - SUBFRAME_HEADER_LEN > 0xffff)) {
+        quiet_set_last_error(quiet_encoder_bad_config);
+        return NULL;
+    }
+
+    // a message needs room for at least one byte after all of the headers
+    size_t overhead = encoder_frame_overhead(opt);
+    if (overhead && opt->frame_len <= overhead) {
+        quiet_set_last_error(quiet_encoder_bad_config);
+        return NULL;
+    }
+
+    // bursts are built out of aggregates
+    if (opt->burst_frame_len && !opt->aggregate) {
+        quiet_set_last_error(quiet_encoder_bad_config);
+        return NULL;
+    }
+
+    if (opt->num_priorities > quiet_max_priorities ||
+        (opt->multi_producer && opt->num_priorities > 1)) {
+        quiet_set_last_error(quiet_encoder_bad_config);
+        return NULL;
+    }
+
+    // an encoder in tdma mode must own at least one slot of the cycle
+    if (opt->tdma_num_slots > encoder_tdma_max_slots ||
+        (opt->tdma_num_slots && !(opt->tdma_slot_mask &
+                                  (0xffffffffu >> (32 - opt->tdma_num_slots))))) {
+        quiet_set_last_error(quiet_encoder_bad_config);
+        return NULL;
+    }
+
     encoder *e = malloc(sizeof(encoder));
 
     e->opt = *opt;
@@ -114,6 +183,7 @@ encoder *quiet_encoder_create(const encoder_options *opt, float sample_rate) {
     e->payload = NULL;
     e->payload_length = 0;
     e->has_flushed = true;
+    e->is_modulator_reset = true;
     e->is_queue_closed = false;
 
     e->is_close_frame = false;
@@ -121,6 +191,62 @@ encoder *quiet_encoder_create(const encoder_options *opt, float sample_rate) {
     e->resample_rate = 1;
     e->resampler = NULL;
 
+    e->compression_dict = NULL;
+    e->compression_dict_len = 0;
+    if (opt->compress && opt->compression_dictionary_len) {
+        e->compression_dict = malloc(opt->compression_dictionary_len);
+        memcpy(e->compression_dict, opt->compression_dictionary,
+               opt->compression_dictionary_len);
+        e->compression_dict_len = opt->compression_dictionary_len;
+    }
+    e->opt.compression_dictionary = NULL;
+    // producers of an mpsc queue each compress in to a buffer of their own
+    e->compressframe = NULL;
+    if (opt->compress && !opt->multi_producer) {
+        e->compressframe = malloc(opt->frame_len);
+    }
+
+    e->num_levels = 1 + opt->num_adaptation_levels;
+    e->levels = malloc(e->num_levels * sizeof(quiet_adaptation_level));
+    e->levels[0] = (quiet_adaptation_level){
+        .checksum_scheme = opt->checksum_scheme,
+        .inner_fec_scheme = opt->inner_fec_scheme,
+        .outer_fec_scheme = opt->outer_fec_scheme,
+        .mod_scheme = opt->mod_scheme,
+    };
+    if (opt->num_adaptation_levels) {
+        memcpy(e->levels + 1, opt->adaptation_levels,
+               opt->num_adaptation_levels * sizeof(quiet_adaptation_level));
+    }
+    e->opt.adaptation_levels = NULL;
+    e->level = 0;
+    atomic_init(&e->next_level, 0);
+    e->reported_evm = 0;
+    e->has_reported_evm = false;
+
+    e->sense = NULL;
+    e->backoff_until = 0;
+    e->contention_window = encoder_csma_min_window;
+    e->backoff_rng = 1;
+    atomic_init(&e->backoffs, 0);
+    atomic_init(&e->backoff_samples, 0);
+
+    e->tdma_slot_len = 0;
+    e->tdma_clock = 0;
+    atomic_init(&e->tdma_owned_samples, 0);
+    atomic_init(&e->tdma_busy_samples, 0);
+
+    e->waveform_cache = NULL;
+    // each repeated frame carries a new sequence number, so its samples
+    //   are never seen again
+    if (opt->waveform_cache_len && !opt->frame_repeats) {
+        e->waveform_cache = waveform_cache_create(opt->waveform_cache_len);
+    }
+    e->is_cache_recording = false;
+    e->cache_record = NULL;
+    e->cache_record_len = 0;
+    e->cache_record_cap = 0;
+
     if (sample_rate != SAMPLE_RATE) {
         float rate = (float)sample_rate / (float)SAMPLE_RATE;
         e->resampler = resamp_rrrf_create(rate, opt->resampler.delay,
@@ -129,17 +255,121 @@ encoder *quiet_encoder_create(const encoder_options *opt, float sample_rate) {
         e->resample_rate = rate;
     }
 
-    e->buf = ring_create(encoder_default_buffer_len);
-    e->tempframe = malloc(sizeof(size_t) + e->opt.frame_len);
-    e->readframe = malloc(e->opt.frame_len);
+    size_t queue_len = opt->queue_len ? opt->queue_len : encoder_default_buffer_len;
+    e->mpsc = NULL;
+    e->num_priorities = 0;
+    if (opt->multi_producer) {
+        size_t num_slots = queue_len / (sizeof(mpsc_slot) + opt->frame_len);
+        e->mpsc = mpsc_create(num_slots, opt->frame_len);
+    } else {
+        e->num_priorities = opt->num_priorities ? opt->num_priorities : 1;
+    }
+    for (size_t i = 0; i < e->num_priorities; i++) {
+        // the reader side stays shared, as senders read from the queue when
+        //   they evict frames or purge it. emit only takes the reader lock
+        //   once per frame, so this costs very little
+        e->bufs[i] = ring_create(queue_len);
+        if (e->bufs[i] && opt->overflow_policy == quiet_overflow_block) {
+            ring_set_writer_blocking(e->bufs[i], 0, 0);
+        }
+        e->priority_credits[i] = opt->priority_weights[i];
+    }
+    e->dropped_frames = 0;
+    e->dropped_bytes = 0;
+    atomic_init(&e->expired_frames, 0);
+    atomic_init(&e->queued_frames, 0);
+    atomic_init(&e->queued_bytes, 0);
+    atomic_init(&e->is_purge_requested, false);
+    atomic_init(&e->pending_samples, 0);
+    atomic_init(&e->next_message_id, 0);
+    e->tempframe = malloc(sizeof(encoder_frame_header) + e->opt.frame_len);
+    // readframe and aggframe trade places, so both can hold a whole burst
+    size_t readframe_cap = encoder_max_frame_len(e);
+    e->readframe = malloc(readframe_cap);
+    e->readframe_cap = readframe_cap;
+    e->readframe_len = 0;
+    e->readframe_deadline = 0;
+    e->readframe_priority = 0;
+    e->readframe_started = false;
+    e->repeats_remaining = 0;
+    e->repeat_seq = 0;
+    e->aggframe = malloc(readframe_cap);
+    e->aggframe_len = 0;
+    e->aggframe_started = 0;
+    e->aggframe_deadlines = NULL;
+    e->aggframe_count = 0;
+    if (opt->aggregate) {
+        // every message takes at least its length prefix
+        e->aggframe_deadlines = malloc((readframe_cap / SUBFRAME_HEADER_LEN + 1) * sizeof(uint64_t));
+    }
+    e->stashframe = malloc(e->opt.frame_len);
+    e->stashframe_len = 0;
+    e->stashframe_deadline = 0;
+    e->stashframe_priority = 0;
+    e->has_stashed_frame = false;
+
+    encoder_build_airtime(e);
+
+    // sample length is nearly linear in frame length, so two points are
+    //   enough for an estimate
+    size_t short_samples = quiet_encoder_sample_len(e, 1);
+    size_t long_samples = quiet_encoder_sample_len(e, e->opt.frame_len);
+    e->airtime_per_byte = 0;
+    if (e->opt.frame_len > 1) {
+        e->airtime_per_byte = ((float)long_samples - (float)short_samples) / (e->opt.frame_len - 1);
+    }
+    e->airtime_per_frame = short_samples - e->airtime_per_byte;
+
+    // a mirrored queue needs a memfd and two mappings, any of which may
+    //   fail, so only now that everything else is set up can we unwind
+    for (size_t i = 0; i < e->num_priorities; i++) {
+        if (!e->bufs[i]) {
+            quiet_encoder_destroy(e);
+            quiet_set_last_error(quiet_mem_fail);
+            return NULL;
+        }
+    }
+
+    if (opt->tdma_num_slots) {
+        // the longest frame we send must fit in a slot between its guards
+        size_t min_slot_len = encoder_frame_output_len(e, encoder_max_frame_len(e)) +
+                              2 * opt->tdma_guard_len;
+        e->tdma_slot_len = opt->tdma_slot_len ? opt->tdma_slot_len : min_slot_len;
+        if (e->tdma_slot_len < min_slot_len) {
+            quiet_encoder_destroy(e);
+            quiet_set_last_error(quiet_encoder_bad_config);
+            return NULL;
+        }
+    }
 
     return e;
 }
 
-size_t quiet_encoder_get_frame_len(const encoder *e) {
+// longest frame the framegen may be handed, which is larger than frame_len
+//   if bursts are enabled
+static size_t encoder_max_frame_len(const encoder *e) {
+    if (e->opt.burst_frame_len > e->opt.frame_len) {
+        return e->opt.burst_frame_len;
+    }
     return e->opt.frame_len;
 }
 
+// bytes at the start of each frame used by the sequence number of
+//   repeated frames
+static size_t encoder_repeat_header_len(const encoder *e) {
+    return e->opt.frame_repeats ? REPEAT_HEADER_LEN : 0;
+}
+
+size_t quiet_encoder_get_frame_len(const encoder *e) {
+    // a message must leave room for the length prefix of aggregates, the
+    //   sequence number of repeats and the compression flag
+    size_t overhead = encoder_frame_overhead(&e->opt);
+    if (e->opt.frame_len <= overhead) {
+        return 0;
+    }
+    return e->opt.frame_len - overhead;
+}
+
 size_t quiet_encoder_clamp_frame_len(encoder *e, size_t sample_len) {
     e->is_close_frame = true;
 
@@ -154,46 +384,121 @@ size_t quiet_encoder_clamp_frame_len(encoder *e, size_t sample_len) {
     }
 
     // first, let's see if the current length will still work
+    // bursts would run past the end of the block, so they're turned off
+    if (e->opt.burst_frame_len > e->opt.frame_len) {
+        e->opt.burst_frame_len = e->opt.frame_len;
+    }
+
     size_t projected_sample_len = quiet_encoder_sample_len(e, e->opt.frame_len);
     if (projected_sample_len <= baserate_sample_len) {
-        return e->opt.frame_len;
+        return quiet_encoder_get_frame_len(e);
     }
 
     // we need to reduce frame_len
-
-    // do inverse calc from base rate sample len to frame length
-    // this has to be iterative as we don't have inverse func for this
-    // we'll start with the suggested length and then do binary search
-    // in this search, max_frame_len is known to be too long,
-    //      min_frame_len is known to be short enough to fit in sample_len
-    size_t max_frame_len = e->opt.frame_len;
-    size_t min_frame_len = 0;
-    size_t frame_len = max_frame_len / 2;
-    while (max_frame_len - min_frame_len > 1) {
-        size_t projected_sample_len = quiet_encoder_sample_len(e, frame_len);
-        if (projected_sample_len > baserate_sample_len) {
-            // this frame size was too big
-            max_frame_len = frame_len;
+    // samples only grow with length, so binary search for the first run
+    //   which is too long. everything before it fits, and the longest
+    //   frame that fits is the last length of the run before it
+    size_t lo = 0, hi = e->airtime_len;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (e->airtime[mid].samples > baserate_sample_len) {
+            hi = mid;
         } else {
-            // this frame size fit but maybe we can fit more
-            min_frame_len = frame_len;
+            lo = mid + 1;
         }
-        frame_len = (max_frame_len - min_frame_len) / 2 + min_frame_len;
+    }
+    size_t frame_len = lo ? e->airtime[lo - 1].max_len : 0;
+    if (frame_len > e->opt.frame_len) {
+        frame_len = e->opt.frame_len;
     }
     e->opt.frame_len = frame_len;
-    return frame_len;
+    e->opt.burst_frame_len = frame_len;
+    return quiet_encoder_get_frame_len(e);
 }
 
 void quiet_encoder_set_blocking(quiet_encoder *e, time_t sec, long nano) {
-    ring_writer_lock(e->buf);
-    ring_set_writer_blocking(e->buf, sec, nano);
-    ring_writer_unlock(e->buf);
+    if (e->opt.overflow_policy == quiet_overflow_drop_oldest) {
+        return;
+    }
+    for (size_t i = 0; i < e->num_priorities; i++) {
+        ring_writer_lock(e->bufs[i]);
+        ring_set_writer_blocking(e->bufs[i], sec, nano);
+        ring_writer_unlock(e->bufs[i]);
+    }
 }
 
 void quiet_encoder_set_nonblocking(quiet_encoder *e) {
-    ring_writer_lock(e->buf);
-    ring_set_writer_nonblocking(e->buf);
-    ring_writer_unlock(e->buf);
+    if (e->opt.overflow_policy == quiet_overflow_drop_oldest) {
+        return;
+    }
+    for (size_t i = 0; i < e->num_priorities; i++) {
+        ring_writer_lock(e->bufs[i]);
+        ring_set_writer_nonblocking(e->bufs[i]);
+        ring_writer_unlock(e->bufs[i]);
+    }
+}
+
+int quiet_encoder_get_fd(quiet_encoder *e) {
+    if (e->mpsc) {
+        quiet_set_last_error(quiet_io);
+        return -1;
+    }
+    ring *buf = e->bufs[e->num_priorities - 1];
+    ring_writer_lock(buf);
+    int fd = ring_get_writer_fd(buf, sizeof(encoder_frame_header) + e->opt.frame_len);
+    ring_writer_unlock(buf);
+    if (fd < 0) {
+        quiet_set_last_error(quiet_io);
+    }
+    return fd;
+}
+
+size_t quiet_encoder_dropped_frames(quiet_encoder *e) {
+    if (e->mpsc) {
+        return 0;
+    }
+    ring_reader_lock(e->bufs[0]);
+    size_t dropped = e->dropped_frames;
+    ring_reader_unlock(e->bufs[0]);
+    return dropped;
+}
+
+size_t quiet_encoder_dropped_bytes(quiet_encoder *e) {
+    if (e->mpsc) {
+        return 0;
+    }
+    ring_reader_lock(e->bufs[0]);
+    size_t dropped = e->dropped_bytes;
+    ring_reader_unlock(e->bufs[0]);
+    return dropped;
+}
+
+static void encoder_count_dequeued(encoder *e, size_t len) {
+    atomic_fetch_sub_explicit(&e->queued_frames, 1, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&e->queued_bytes, len, memory_order_relaxed);
+}
+
+// discard the oldest frame queued in buf to make room for a newer one
+// returns false if there was nothing left to discard
+static bool encoder_drop_oldest(encoder *e, ring *buf) {
+    ring_reader_lock(buf);
+    // writers only ever add to the queue, so anything we see here stays
+    //   readable while we hold the reader lock
+    if (ring_read_available(buf) < sizeof(encoder_frame_header)) {
+        ring_reader_unlock(buf);
+        return false;
+    }
+    encoder_frame_header header;
+    ring_read(buf, &header, sizeof(encoder_frame_header));
+    ring_advance_reader(buf, header.len);
+    ring_reader_unlock(buf);
+    encoder_count_dequeued(e, header.len);
+
+    ring_reader_lock(e->bufs[0]);
+    e->dropped_frames++;
+    e->dropped_bytes += header.len;
+    ring_reader_unlock(e->bufs[0]);
+    return true;
 }
 
 static int encoder_is_assembled(encoder *e) {
@@ -207,20 +512,253 @@ static int encoder_is_assembled(encoder *e) {
     }
 }
 
-ssize_t quiet_encoder_send(quiet_encoder *e, const void *buf, size_t len) {
-    if (len > e->opt.frame_len) {
-        quiet_set_last_error(quiet_msg_size);
-        return -1;
+size_t quiet_encoder_expired_frames(quiet_encoder *e) {
+    return atomic_load_explicit(&e->expired_frames, memory_order_relaxed);
+}
+
+size_t quiet_encoder_queued_frames(quiet_encoder *e) {
+    return atomic_load_explicit(&e->queued_frames, memory_order_relaxed);
+}
+
+size_t quiet_encoder_queued_bytes(quiet_encoder *e) {
+    return atomic_load_explicit(&e->queued_bytes, memory_order_relaxed);
+}
+
+size_t quiet_encoder_pending_samples(quiet_encoder *e) {
+    return atomic_load_explicit(&e->pending_samples, memory_order_acquire);
+}
+
+float quiet_encoder_estimated_drain_time(quiet_encoder *e) {
+    // each frame gains its sequence number when it's dequeued, and then
+    //   goes out once more for every repeat
+    float frame_samples = e->airtime_per_frame +
+                          encoder_repeat_header_len(e) * e->airtime_per_byte;
+    float samples = quiet_encoder_queued_frames(e) * frame_samples +
+                    quiet_encoder_queued_bytes(e) * e->airtime_per_byte;
+    return samples * (1 + e->opt.frame_repeats) / SAMPLE_RATE;
+}
+
+size_t quiet_encoder_purge(quiet_encoder *e) {
+    if (e->mpsc) {
+        atomic_store_explicit(&e->is_purge_requested, true, memory_order_release);
+        return 0;
+    }
+
+    size_t purged = 0;
+    for (size_t i = 0; i < e->num_priorities; i++) {
+        ring *buf = e->bufs[i];
+        ring_reader_lock(buf);
+        // as in encoder_drop_oldest, whatever we see here stays readable
+        while (ring_read_available(buf) >= sizeof(encoder_frame_header)) {
+            encoder_frame_header header;
+            ring_read(buf, &header, sizeof(encoder_frame_header));
+            ring_advance_reader(buf, header.len);
+            encoder_count_dequeued(e, header.len);
+            purged++;
+        }
+        ring_reader_unlock(buf);
+    }
+    return purged;
+}
+
+static uint64_t encoder_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+void quiet_encoder_set_carrier_sense(quiet_encoder *e, quiet_decoder *d) {
+    e->sense = d ? decoder_carrier_sense(d) : NULL;
+    e->backoff_until = 0;
+    e->contention_window = encoder_csma_min_window;
+    // encoders which start together must not back off in lockstep
+    e->backoff_rng = (uint32_t)(encoder_now() ^ (uintptr_t)e) | 1;
+}
+
+size_t quiet_encoder_backoffs(quiet_encoder *e) {
+    return atomic_load_explicit(&e->backoffs, memory_order_relaxed);
+}
+
+float quiet_encoder_backoff_time(quiet_encoder *e) {
+    return atomic_load_explicit(&e->backoff_samples, memory_order_relaxed) / SAMPLE_RATE;
+}
+
+// xorshift32, plenty for picking backoff slots
+static uint32_t encoder_backoff_random(encoder *e) {
+    uint32_t x = e->backoff_rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    e->backoff_rng = x;
+    return x;
+}
+
+static bool encoder_has_frame_waiting(encoder *e) {
+    return atomic_load_explicit(&e->queued_frames, memory_order_relaxed) > 0 ||
+           e->aggframe_len || e->repeats_remaining || e->has_stashed_frame;
+}
+
+// whether a new burst may start now
+// with carrier sense, a burst waits until the channel is clear. each time
+//   it finds the channel busy, it waits a random number of slots from a
+//   contention window which doubles each time, so that encoders which
+//   were all waiting on the same transmission don't all start together
+//   once it ends
+static bool encoder_may_transmit(encoder *e) {
+    if (!e->sense || !encoder_has_frame_waiting(e)) {
+        return true;
+    }
+
+    uint64_t now = atomic_load_explicit(&e->sense->now, memory_order_acquire);
+    if (now < e->backoff_until) {
+        return false;
+    }
+    if (!atomic_load_explicit(&e->sense->is_busy, memory_order_acquire)) {
+        e->contention_window = encoder_csma_min_window;
+        return true;
+    }
+
+    unsigned int slot_ms = e->opt.csma_slot_ms ? e->opt.csma_slot_ms : encoder_default_csma_slot_ms;
+    unsigned int max_window = e->opt.csma_max_window ? e->opt.csma_max_window
+                                                     : encoder_default_csma_max_window;
+    uint64_t slot_samples = (uint64_t)slot_ms * SAMPLE_RATE / 1000;
+    uint64_t backoff = (1 + encoder_backoff_random(e) % e->contention_window) * slot_samples;
+    e->backoff_until = now + backoff;
+    e->contention_window = (e->contention_window * 2 < max_window) ? e->contention_window * 2
+                                                                    : max_window;
+    atomic_fetch_add_explicit(&e->backoffs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&e->backoff_samples, backoff, memory_order_relaxed);
+    return false;
+}
+
+void quiet_encoder_set_tdma_clock(quiet_encoder *e, uint64_t sample_time) {
+    e->tdma_clock = sample_time;
+}
+
+size_t quiet_encoder_tdma_slot_len(const quiet_encoder *e) {
+    return e->tdma_slot_len;
+}
+
+float quiet_encoder_tdma_utilization(quiet_encoder *e) {
+    uint64_t owned = atomic_load_explicit(&e->tdma_owned_samples, memory_order_relaxed);
+    uint64_t busy = atomic_load_explicit(&e->tdma_busy_samples, memory_order_relaxed);
+    if (!owned) {
+        return 0;
+    }
+    // the tail of a resampled burst may spill a little past the guard
+    return (busy < owned) ? (float)busy / owned : 1;
+}
+
+static bool encoder_tdma_owns(const encoder *e, size_t slot) {
+    return (e->opt.tdma_slot_mask >> slot) & 1;
+}
+
+// samples of our own slots between the start of the tdma clock and t
+static uint64_t encoder_tdma_owned_before(const encoder *e, uint64_t t) {
+    uint64_t slot_len = e->tdma_slot_len;
+    uint64_t cycle_len = slot_len * e->opt.tdma_num_slots;
+    uint64_t owned = 0;
+    for (size_t i = 0; i < e->opt.tdma_num_slots; i++) {
+        if (!encoder_tdma_owns(e, i)) {
+            continue;
+        }
+        owned += (t / cycle_len) * slot_len;
+        uint64_t pos = t % cycle_len;
+        uint64_t slot_start = i * slot_len;
+        if (pos > slot_start) {
+            owned += (pos - slot_start < slot_len) ? pos - slot_start : slot_len;
+        }
+    }
+    return owned;
+}
+
+// samples to wait from now before the assembled frame may start, so that
+//   it falls within the guards of one of our slots
+static size_t encoder_tdma_wait(const encoder *e, uint64_t now) {
+    uint64_t slot_len = e->tdma_slot_len;
+    uint64_t guard_len = e->opt.tdma_guard_len;
+    size_t frame_output_len = encoder_frame_output_len(e, e->readframe_len);
+    uint64_t slot_start = now - now % slot_len;
+    size_t slot = (now / slot_len) % e->opt.tdma_num_slots;
+    // where the first of our slots to start from here begins, after its guard
+    uint64_t next_start = now;
+    bool has_next_start = false;
+    // the rest of this slot, and then every slot up to this one again
+    for (size_t i = 0; i <= e->opt.tdma_num_slots; i++) {
+        if (encoder_tdma_owns(e, slot)) {
+            uint64_t start = (now > slot_start + guard_len) ? now : slot_start + guard_len;
+            if (start + frame_output_len + guard_len <= slot_start + slot_len) {
+                return start - now;
+            }
+            if (!has_next_start && slot_start + guard_len >= now) {
+                next_start = slot_start + guard_len;
+                has_next_start = true;
+            }
+        }
+        slot_start += slot_len;
+        slot = (slot + 1) % e->opt.tdma_num_slots;
+    }
+    // create made sure every frame fits in a whole slot, so this is only
+    //   reached if that estimate was wrong. the frame still starts in one
+    //   of our own slots, at its beginning so that it overruns the least
+    return next_start - now;
+}
+
+static void encoder_tdma_advance(encoder *e, size_t written, size_t silent_len) {
+    uint64_t end = e->tdma_clock + written;
+    uint64_t owned = encoder_tdma_owned_before(e, end) - encoder_tdma_owned_before(e, e->tdma_clock);
+    e->tdma_clock = end;
+    atomic_fetch_add_explicit(&e->tdma_owned_samples, owned, memory_order_relaxed);
+    atomic_fetch_add_explicit(&e->tdma_busy_samples, written - silent_len, memory_order_relaxed);
+}
+
+static ssize_t encoder_enqueue(encoder *e, const void *buf, size_t len, size_t priority,
+                               uint64_t deadline) {
+    if (e->mpsc) {
+        // producers copy straight in to their own slot, no tempframe needed
+        atomic_fetch_add_explicit(&e->queued_frames, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&e->queued_bytes, len, memory_order_relaxed);
+        ssize_t res = mpsc_enqueue(e->mpsc, buf, len, deadline);
+        if (res != 1) {
+            encoder_count_dequeued(e, len);
+        }
+        if (res == RingErrorWouldBlock) {
+            quiet_set_last_error(quiet_would_block);
+            return -1;
+        }
+        return (res == 1) ? (ssize_t)len : 0;
     }
 
     // it's painful to do this copy which could then fail, but we need to write atomically
     // TODO peek, decide if we have room, then abort if not
-    memcpy(e->tempframe, &len, sizeof(size_t));
-    memcpy(e->tempframe + (sizeof(size_t)), buf, len);
+    encoder_frame_header header = {
+        .len = len,
+        .deadline = deadline,
+    };
+    size_t recordlen = sizeof(encoder_frame_header) + len;
+    memcpy(e->tempframe, &header, sizeof(encoder_frame_header));
+    memcpy(e->tempframe + sizeof(encoder_frame_header), buf, len);
+
+    // count the frame first so that emit never takes it before it's counted
+    atomic_fetch_add_explicit(&e->queued_frames, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&e->queued_bytes, len, memory_order_relaxed);
+
+    ring *queue = e->bufs[priority];
+    ring_writer_lock(queue);
+    ssize_t written = ring_write(queue, e->tempframe, recordlen);
+    ring_writer_unlock(queue);
+
+    if (e->opt.overflow_policy == quiet_overflow_drop_oldest) {
+        while (written == RingErrorWouldBlock && encoder_drop_oldest(e, queue)) {
+            ring_writer_lock(queue);
+            written = ring_write(queue, e->tempframe, recordlen);
+            ring_writer_unlock(queue);
+        }
+    }
 
-    ring_writer_lock(e->buf);
-    ssize_t written = ring_write(e->buf, e->tempframe, sizeof(size_t) + len);
-    ring_writer_unlock(e->buf);
+    if (written <= 0) {
+        encoder_count_dequeued(e, len);
+    }
     if (written == 0) {
         return 0;
     }
@@ -237,40 +775,458 @@ ssize_t quiet_encoder_send(quiet_encoder *e, const void *buf, size_t len) {
         }
         return -1;
     }
-    return written - sizeof(size_t);
+    return written - sizeof(encoder_frame_header);
+}
+
+// write buf in to frame behind a flag which says how it's coded. it's only
+//   kept compressed if that makes it shorter
+static size_t encoder_compress(encoder *e, const uint8_t *buf, size_t len, uint8_t *frame) {
+    size_t compressed_len = compress_lz(e->compression_dict, e->compression_dict_len, buf, len,
+                                        frame + COMPRESS_HEADER_LEN, len ? len - 1 : 0);
+    if (compressed_len) {
+        frame[0] = compress_flag_lz;
+        return COMPRESS_HEADER_LEN + compressed_len;
+    }
+    frame[0] = compress_flag_raw;
+    memcpy(frame + COMPRESS_HEADER_LEN, buf, len);
+    return COMPRESS_HEADER_LEN + len;
+}
+
+static ssize_t encoder_send(encoder *e, const void *buf, size_t len, size_t priority,
+                            uint64_t deadline) {
+    if (len > quiet_encoder_get_frame_len(e)) {
+        quiet_set_last_error(quiet_msg_size);
+        return -1;
+    }
+
+    if (!e->opt.compress) {
+        return encoder_enqueue(e, buf, len, priority, deadline);
+    }
+
+    uint8_t *frame = e->compressframe;
+    if (e->mpsc) {
+        frame = malloc(COMPRESS_HEADER_LEN + len);
+        if (!frame) {
+            quiet_set_last_error(quiet_mem_fail);
+            return -1;
+        }
+    }
+    size_t framelen = encoder_compress(e, buf, len, frame);
+    ssize_t res = encoder_enqueue(e, frame, framelen, priority, deadline);
+    if (e->mpsc) {
+        free(frame);
+    }
+    // the caller only sees its own bytes
+    return (res > 0) ? (ssize_t)len : res;
+}
+
+ssize_t quiet_encoder_send(quiet_encoder *e, const void *buf, size_t len) {
+    // bulk traffic goes to the least urgent class
+    return encoder_send(e, buf, len, e->num_priorities ? e->num_priorities - 1 : 0, 0);
+}
+
+ssize_t quiet_encoder_send_message(quiet_encoder *e, const void *buf, size_t len) {
+    size_t frame_len = quiet_encoder_get_frame_len(e);
+    if (frame_len <= SAR_HEADER_LEN) {
+        quiet_set_last_error(quiet_msg_size);
+        return -1;
+    }
+    size_t max_segment_len = frame_len - SAR_HEADER_LEN;
+    size_t count = len ? (len + max_segment_len - 1) / max_segment_len : 1;
+    // an empty message has nothing to protect
+    size_t parity = len ? (count * e->opt.message_parity_percent + 99) / 100 : 0;
+    if (count > UINT16_MAX || len > UINT32_MAX ||
+        (parity && count + parity > ERASURE_MAX_BLOCKS)) {
+        quiet_set_last_error(quiet_msg_size);
+        return -1;
+    }
+
+    const uint8_t *msg = buf;
+    sar_header h = {
+        .id = atomic_fetch_add_explicit(&e->next_message_id, 1, memory_order_relaxed),
+        .count = count,
+        .parity = parity,
+        .len = len,
+        .crc = sar_crc32(msg, len),
+    };
+    size_t stride = sar_segment_stride(&h);
+
+    // with parity, the data is laid out at a full stride per segment so
+    //   that the last one is padded with zeros, followed by room for the
+    //   parity segments
+    uint8_t *coded = NULL;
+    if (parity) {
+        coded = calloc((count + parity) * stride, 1);
+        if (!coded) {
+            quiet_set_last_error(quiet_mem_fail);
+            return -1;
+        }
+        memcpy(coded, msg, len);
+        erasure_encode(coded, count, parity, stride, coded + count * stride);
+    }
+
+    uint8_t *segment = malloc(frame_len);
+    if (!segment) {
+        free(coded);
+        quiet_set_last_error(quiet_mem_fail);
+        return -1;
+    }
+
+    size_t priority = e->num_priorities ? e->num_priorities - 1 : 0;
+    ssize_t res = len;
+    for (size_t i = 0; i < count + parity; i++) {
+        h.index = i;
+        size_t segment_len = sar_segment_len(&h, h.index);
+        const uint8_t *src = (i < count) ? msg : coded;
+        sar_header_write(segment, &h);
+        memcpy(segment + SAR_HEADER_LEN, src + sar_segment_offset(&h, h.index), segment_len);
+        ssize_t sent = encoder_send(e, segment, SAR_HEADER_LEN + segment_len, priority, 0);
+        if (sent <= 0) {
+            res = sent;
+            break;
+        }
+    }
+    free(segment);
+    free(coded);
+    return res;
+}
+
+ssize_t quiet_encoder_send_priority(quiet_encoder *e, const void *buf, size_t len,
+                                    unsigned int priority) {
+    if (priority >= (e->num_priorities ? e->num_priorities : 1)) {
+        quiet_set_last_error(quiet_invalid_argument);
+        return -1;
+    }
+    return encoder_send(e, buf, len, priority, 0);
+}
+
+ssize_t quiet_encoder_send_ttl(quiet_encoder *e, const void *buf, size_t len, time_t sec,
+                               long nano) {
+    uint64_t deadline = encoder_now() + (uint64_t)sec * 1000000000ull + nano;
+    return encoder_send(e, buf, len, e->num_priorities ? e->num_priorities - 1 : 0, deadline);
 }
 
 void quiet_encoder_close(quiet_encoder *e) {
-    ring_writer_lock(e->buf);
-    ring_close(e->buf);
-    ring_writer_unlock(e->buf);
+    if (e->mpsc) {
+        mpsc_close(e->mpsc);
+        return;
+    }
+    for (size_t i = 0; i < e->num_priorities; i++) {
+        ring_writer_lock(e->bufs[i]);
+        ring_close(e->bufs[i]);
+        ring_writer_unlock(e->bufs[i]);
+    }
 }
 
-static bool encoder_read_next_frame(encoder *e) {
+// take the next frame of one priority class in to readframe
+// returns 1 on success, 0 if the class is closed and empty, or a RingError
+static ssize_t encoder_read_class(encoder *e, size_t priority) {
+    if (e->has_stashed_frame && e->stashframe_priority == priority) {
+        uint8_t *swap = e->readframe;
+        e->readframe = e->stashframe;
+        e->stashframe = swap;
+        e->readframe_len = e->stashframe_len;
+        e->readframe_deadline = e->stashframe_deadline;
+        e->has_stashed_frame = false;
+        return 1;
+    }
+
+    ring *buf = e->bufs[priority];
+    ring_reader_lock(buf);
+    encoder_frame_header header;
+    ssize_t nread = ring_read(buf, (uint8_t*)(&header), sizeof(encoder_frame_header));
+    if (nread <= 0) {
+        ring_reader_unlock(buf);
+        return nread;
+    }
+    e->readframe_len = header.len;
+    e->readframe_deadline = header.deadline;
+    encoder_count_dequeued(e, header.len);
+    ssize_t read = ring_read(buf, e->readframe, e->readframe_len);
+    ring_reader_unlock(buf);
+    if (read <= 0) {
+        assert(false && "ring buffer failed: frame not written atomically?");
+    }
+    return 1;
+}
+
+// pick the priority class to send from and read its next frame
+// weighted classes get up to their weight in frames each round, most
+//   urgent first, and a new round starts once none of them can send.
+//   classes without weight only send when the weighted ones are empty,
+//   which makes all-zero weights strict priority
+static bool encoder_read_prioritized(encoder *e) {
+    // every class is tried at least once before we give up, so this
+    //   ends up with every class's bit set only if all are closed
+    unsigned int closed = 0;
+    for (size_t round = 0; round < 2; round++) {
+        for (size_t i = 0; i < e->num_priorities; i++) {
+            // a stashed frame was charged when it was first dequeued
+            bool is_stashed = e->has_stashed_frame && e->stashframe_priority == i;
+            if (!e->opt.priority_weights[i] || (!e->priority_credits[i] && !is_stashed)) {
+                continue;
+            }
+            ssize_t res = encoder_read_class(e, i);
+            if (res > 0) {
+                if (!is_stashed) {
+                    e->priority_credits[i]--;
+                }
+                e->readframe_priority = i;
+                return true;
+            }
+            if (res == 0) {
+                closed |= 1u << i;
+            }
+        }
+        for (size_t i = 0; i < e->num_priorities; i++) {
+            e->priority_credits[i] = e->opt.priority_weights[i];
+        }
+    }
+
+    for (size_t i = 0; i < e->num_priorities; i++) {
+        if (e->opt.priority_weights[i]) {
+            continue;
+        }
+        ssize_t res = encoder_read_class(e, i);
+        if (res > 0) {
+            e->readframe_priority = i;
+            return true;
+        }
+        if (res == 0) {
+            closed |= 1u << i;
+        }
+    }
+
+    if (closed == (1u << e->num_priorities) - 1) {
+        e->is_queue_closed = true;
+    }
+    return false;
+}
+
+// take the next frame from whichever queue is in use
+static bool encoder_dequeue(encoder *e) {
+    if (e->mpsc) {
+        if (atomic_exchange_explicit(&e->is_purge_requested, false, memory_order_acquire)) {
+            size_t len;
+            uint64_t deadline;
+            while (mpsc_dequeue(e->mpsc, e->readframe, e->readframe_cap, &len, &deadline) == 1) {
+                encoder_count_dequeued(e, len);
+            }
+        }
+        ssize_t res = mpsc_dequeue(e->mpsc, e->readframe, e->readframe_cap,
+                                   &e->readframe_len, &e->readframe_deadline);
+        if (res <= 0) {
+            if (res == 0) {
+                e->is_queue_closed = true;
+            }
+            return false;
+        }
+        encoder_count_dequeued(e, e->readframe_len);
+        return true;
+    }
+    return encoder_read_prioritized(e);
+}
+
+// take the next frame which hasn't outlived its deadline
+// stale frames are skipped here, before any airtime is spent on them
+static bool encoder_dequeue_live(encoder *e) {
     if (e->is_queue_closed) {
         return false;
     }
-    size_t framelen;
-    ring_reader_lock(e->buf);
-    ssize_t nread = ring_read(e->buf, (uint8_t*)(&framelen), sizeof(size_t));
-    if (nread <= 0) {
-        ring_reader_unlock(e->buf);
-        if (nread == 0) {
-            e->is_queue_closed = true;
+
+    uint64_t now = 0;
+    while (true) {
+        if (!encoder_dequeue(e)) {
+            return false;
+        }
+        if (!e->readframe_deadline) {
+            return true;
+        }
+        if (!now) {
+            now = encoder_now();
+        }
+        if (now < e->readframe_deadline) {
+            return true;
+        }
+        atomic_fetch_add_explicit(&e->expired_frames, 1, memory_order_relaxed);
+    }
+}
+
+static void encoder_write_subframe_len(uint8_t *dst, size_t len) {
+    dst[0] = (len >> 8) & 0xff;
+    dst[1] = len & 0xff;
+}
+
+// drop messages which expired while they waited in aggframe, as
+//   encoder_dequeue_live would have dropped them from the queue
+static void encoder_expire_subframes(encoder *e) {
+    uint64_t now = 0;
+    size_t src = 0, dst = 0, kept = 0;
+    for (size_t i = 0; i < e->aggframe_count; i++) {
+        size_t len = ((size_t)e->aggframe[src] << 8) | e->aggframe[src + 1];
+        size_t subframe_len = SUBFRAME_HEADER_LEN + len;
+        uint64_t deadline = e->aggframe_deadlines[i];
+        if (deadline && !now) {
+            now = encoder_now();
+        }
+        if (deadline && now >= deadline) {
+            atomic_fetch_add_explicit(&e->expired_frames, 1, memory_order_relaxed);
+        } else {
+            memmove(e->aggframe + dst, e->aggframe + src, subframe_len);
+            e->aggframe_deadlines[kept++] = deadline;
+            dst += subframe_len;
+        }
+        src += subframe_len;
+    }
+    e->aggframe_len = dst;
+    e->aggframe_count = kept;
+}
+
+// pack queued messages in to aggframe and move it to readframe once it's
+//   full, or once its first message has lingered long enough
+// messages are never split, so one which doesn't fit starts the next
+//   aggregate instead
+// with bursts enabled, messages which are already queued keep being packed
+//   past frame_len, up to burst_frame_len, so that a backed up queue goes
+//   out with one preamble for many messages
+static bool encoder_read_aggregate(encoder *e) {
+    size_t max_len = encoder_max_frame_len(e) - encoder_repeat_header_len(e);
+    while (encoder_dequeue_live(e)) {
+        size_t len = e->readframe_len;
+        uint64_t deadline = e->readframe_deadline;
+        if (e->aggframe_len &&
+            e->aggframe_len + SUBFRAME_HEADER_LEN + len > max_len) {
+            // the aggregate is going out, without whatever expired in it
+            encoder_expire_subframes(e);
+        }
+        if (e->aggframe_len &&
+            e->aggframe_len + SUBFRAME_HEADER_LEN + len > max_len) {
+            uint8_t *swap = e->readframe;
+            e->readframe = e->aggframe;
+            e->aggframe = swap;
+            e->readframe_len = e->aggframe_len;
+
+            memmove(e->aggframe + SUBFRAME_HEADER_LEN, e->aggframe, len);
+            encoder_write_subframe_len(e->aggframe, len);
+            e->aggframe_len = SUBFRAME_HEADER_LEN + len;
+            e->aggframe_deadlines[0] = deadline;
+            e->aggframe_count = 1;
+            e->aggframe_started = encoder_now();
+            return true;
         }
+
+        if (!e->aggframe_len) {
+            e->aggframe_started = encoder_now();
+        }
+        encoder_write_subframe_len(e->aggframe + e->aggframe_len, len);
+        memcpy(e->aggframe + e->aggframe_len + SUBFRAME_HEADER_LEN, e->readframe, len);
+        e->aggframe_len += SUBFRAME_HEADER_LEN + len;
+        e->aggframe_deadlines[e->aggframe_count++] = deadline;
+    }
+
+    if (!e->aggframe_len) {
         return false;
     }
-    ssize_t read = ring_read(e->buf, e->readframe, framelen);
-    ring_reader_unlock(e->buf);
-    if (read <= 0) {
-        assert(false && "ring buffer failed: frame not written atomically?");
+
+    // wait for more only if another message could still fit
+    bool has_room = e->aggframe_len + SUBFRAME_HEADER_LEN + encoder_repeat_header_len(e) <
+                    e->opt.frame_len;
+    uint64_t linger = (uint64_t)e->opt.aggregation_linger_ms * 1000000ull;
+    if (has_room && !e->is_queue_closed && encoder_now() - e->aggframe_started < linger) {
+        return false;
+    }
+
+    encoder_expire_subframes(e);
+    if (!e->aggframe_len) {
+        return false;
+    }
+
+    uint8_t *swap = e->readframe;
+    e->readframe = e->aggframe;
+    e->aggframe = swap;
+    e->readframe_len = e->aggframe_len;
+    e->aggframe_len = 0;
+    e->aggframe_count = 0;
+    return true;
+}
+
+// configure the framegen with the schemes of one level
+static void encoder_set_level_props(encoder *e, size_t level) {
+    const quiet_adaptation_level *l = &e->levels[level];
+    switch (e->opt.encoding) {
+    case ofdm_encoding: {
+        ofdmflexframegenprops_s props = {
+            .check = l->checksum_scheme,
+            .fec0 = l->inner_fec_scheme,
+            .fec1 = l->outer_fec_scheme,
+            .mod_scheme = l->mod_scheme,
+        };
+        ofdmflexframegen_setprops(e->frame.ofdm.framegen, &props);
+        break;
+    }
+    case modem_encoding: {
+        flexframegenprops_s props = {
+            .check = l->checksum_scheme,
+            .fec0 = l->inner_fec_scheme,
+            .fec1 = l->outer_fec_scheme,
+            .mod_scheme = l->mod_scheme,
+        };
+        flexframegen_setprops(e->frame.modem.framegen, &props);
+        break;
+    }
+    case gmsk_encoding:
+        // gmskframegen takes its schemes with each frame
+        break;
+    }
+}
+
+// switch the framegen to the level chosen for new frames, if it changed
+static void encoder_adapt(encoder *e) {
+    size_t level = atomic_load_explicit(&e->next_level, memory_order_relaxed);
+    if (level == e->level) {
+        return;
+    }
+    e->level = level;
+    encoder_set_level_props(e, level);
+
+    // cached frames were rendered with the old schemes
+    if (e->waveform_cache) {
+        waveform_cache_clear(e->waveform_cache);
     }
+}
 
-    uint8_t header[1];
+static bool encoder_read_next_frame(encoder *e) {
+    if (e->repeats_remaining) {
+        // send the same frame again, sequence number and all
+        e->repeats_remaining--;
+    } else {
+        bool have_frame = e->opt.aggregate ? encoder_read_aggregate(e) : encoder_dequeue_live(e);
+        if (!have_frame) {
+            return false;
+        }
+        if (e->opt.frame_repeats) {
+            memmove(e->readframe + REPEAT_HEADER_LEN, e->readframe, e->readframe_len);
+            e->readframe[0] = e->repeat_seq++;
+            e->readframe_len += REPEAT_HEADER_LEN;
+            e->repeats_remaining = e->opt.frame_repeats;
+        }
+        // copies of a frame keep its schemes, so only new frames adapt
+        encoder_adapt(e);
+    }
+    size_t framelen = e->readframe_len;
+
+    // the header repeats the sequence number for the decoder's combiner
+    uint8_t header[1] = {0};
+    if (e->opt.frame_repeats) {
+        header[0] = e->readframe[0];
+    }
     switch (e->opt.encoding) {
     case ofdm_encoding:
         ofdmflexframegen_assemble(e->frame.ofdm.framegen, header, e->readframe,
                                   framelen);
+        e->frame.ofdm.symbols_remaining =
+            ofdmflexframegen_getframelen(e->frame.ofdm.framegen) *
+            (e->opt.ofdmopt.num_subcarriers + e->opt.ofdmopt.cyclic_prefix_len);
         break;
     case modem_encoding:
         flexframegen_assemble(e->frame.modem.framegen, header, e->readframe,
@@ -281,18 +1237,117 @@ static bool encoder_read_next_frame(encoder *e) {
     case gmsk_encoding:
         gmskframegen_reset(e->frame.gmsk.framegen);
         gmskframegen_assemble(e->frame.gmsk.framegen, header, e->readframe,
-                              framelen, (crc_scheme)e->opt.checksum_scheme,
-                              (fec_scheme)e->opt.inner_fec_scheme, (fec_scheme)e->opt.outer_fec_scheme);
+                              framelen, (crc_scheme)e->levels[e->level].checksum_scheme,
+                              (fec_scheme)e->levels[e->level].inner_fec_scheme,
+                              (fec_scheme)e->levels[e->level].outer_fec_scheme);
+        e->frame.gmsk.samples_remaining =
+            gmskframegen_getframelen(e->frame.gmsk.framegen);
         break;
     }
 
     e->has_flushed = false;
+    e->readframe_started = false;
     return true;
 }
 
-static size_t quiet_encoder_sample_len(encoder *e, size_t data_len) {
-    uint8_t *empty = calloc(data_len, sizeof(uint8_t));
-    uint8_t header[1];
+void quiet_encoder_report_frame_stats(quiet_encoder *e, const quiet_decoder_frame_stats *stats) {
+    if (e->num_levels < 2) {
+        return;
+    }
+
+    size_t level = atomic_load_explicit(&e->next_level, memory_order_relaxed);
+    if (!stats->checksum_passed) {
+        if (level) {
+            atomic_store_explicit(&e->next_level, level - 1, memory_order_relaxed);
+        }
+        return;
+    }
+
+    float evm = stats->error_vector_magnitude;
+    if (e->has_reported_evm) {
+        e->reported_evm += encoder_adaptation_smoothing * (evm - e->reported_evm);
+    } else {
+        e->reported_evm = evm;
+        e->has_reported_evm = true;
+    }
+
+    // the fastest level whose limit the channel meets, with a margin on
+    //   the way up
+    size_t next = 0;
+    for (size_t i = 1; i < e->num_levels; i++) {
+        float limit = e->levels[i].max_error_vector_magnitude;
+        if (i > level) {
+            limit -= encoder_adaptation_hysteresis;
+        }
+        if (e->reported_evm <= limit) {
+            next = i;
+        }
+    }
+    atomic_store_explicit(&e->next_level, next, memory_order_relaxed);
+}
+
+size_t quiet_encoder_adaptation_level(quiet_encoder *e) {
+    return atomic_load_explicit(&e->next_level, memory_order_relaxed);
+}
+
+// drop the assembled frame, if any
+static void encoder_reset_framegen(encoder *e) {
+    switch (e->opt.encoding) {
+    case ofdm_encoding:
+        ofdmflexframegen_reset(e->frame.ofdm.framegen);
+        break;
+    case modem_encoding:
+        flexframegen_reset(e->frame.modem.framegen);
+        break;
+    case gmsk_encoding:
+        gmskframegen_reset(e->frame.gmsk.framegen);
+        break;
+    }
+}
+
+// put back an assembled frame which hasn't started sending if a more
+//   urgent class now has a frame queued. the frame goes to the front of
+//   its class, and the scheduler picks again
+// returns false if that leaves no frame assembled
+static bool encoder_preempt(encoder *e) {
+    // an aggregate may hold messages from several classes, so it's sent
+    //   as it is. the copies of a repeated frame also stay together
+    if (e->num_priorities < 2 || !e->readframe_priority || e->has_stashed_frame ||
+        e->opt.aggregate || e->opt.frame_repeats) {
+        return true;
+    }
+
+    bool is_urgent_queued = false;
+    for (size_t i = 0; i < e->readframe_priority && !is_urgent_queued; i++) {
+        ring_reader_lock(e->bufs[i]);
+        is_urgent_queued = ring_read_available(e->bufs[i]) > 0;
+        ring_reader_unlock(e->bufs[i]);
+    }
+    if (!is_urgent_queued) {
+        return true;
+    }
+
+    uint8_t *swap = e->stashframe;
+    e->stashframe = e->readframe;
+    e->readframe = swap;
+    e->stashframe_len = e->readframe_len;
+    e->stashframe_deadline = e->readframe_deadline;
+    e->stashframe_priority = e->readframe_priority;
+    e->has_stashed_frame = true;
+
+    encoder_reset_framegen(e);
+    // the stashed frame is there to fall back on, but it and the urgent
+    //   frame may both have expired by now, leaving nothing assembled
+    return encoder_read_next_frame(e);
+}
+
+// assemble a frame of data_len bytes at one level to find its length
+// this resets the frame generator, so it must not be used while a frame
+//   is being sent
+static size_t encoder_trial_level_sample_len(encoder *e, const uint8_t *empty,
+                                             size_t data_len, size_t level) {
+    const quiet_adaptation_level *l = &e->levels[level];
+    uint8_t header[1] = {0};
     size_t num_symbols;
     switch (e->opt.encoding) {
     case ofdm_encoding:
@@ -300,7 +1355,8 @@ static size_t quiet_encoder_sample_len(encoder *e, size_t data_len) {
                                   data_len);  // TODO actual calculation?
         size_t num_ofdm_blocks =
             ofdmflexframegen_getframelen(e->frame.ofdm.framegen);
-        num_symbols = num_ofdm_blocks * e->symbolbuf_len;
+        num_symbols = num_ofdm_blocks *
+                      (e->opt.ofdmopt.num_subcarriers + e->opt.ofdmopt.cyclic_prefix_len);
         ofdmflexframegen_reset(e->frame.ofdm.framegen);
         break;
     case modem_encoding:
@@ -310,26 +1366,128 @@ static size_t quiet_encoder_sample_len(encoder *e, size_t data_len) {
         break;
     case gmsk_encoding:
         gmskframegen_assemble(e->frame.gmsk.framegen, header, empty, data_len,
-                              (crc_scheme)e->opt.checksum_scheme, (fec_scheme)e->opt.inner_fec_scheme,
-                              (fec_scheme)e->opt.outer_fec_scheme);
+                              (crc_scheme)l->checksum_scheme, (fec_scheme)l->inner_fec_scheme,
+                              (fec_scheme)l->outer_fec_scheme);
         num_symbols = gmskframegen_getframelen(e->frame.gmsk.framegen);
         gmskframegen_reset(e->frame.gmsk.framegen);
         break;
     }
-    free(empty);
     return modulator_sample_len(e->mod, num_symbols);
 }
 
+// length of a frame of data_len bytes at whichever level makes it longest,
+//   so that airtime estimates hold for every level adaptation may pick
+static size_t encoder_trial_sample_len(encoder *e, const uint8_t *empty, size_t data_len) {
+    if (e->num_levels == 1) {
+        return encoder_trial_level_sample_len(e, empty, data_len, 0);
+    }
+    size_t longest = 0;
+    for (size_t level = 0; level < e->num_levels; level++) {
+        encoder_set_level_props(e, level);
+        size_t samples = encoder_trial_level_sample_len(e, empty, data_len, level);
+        longest = (samples > longest) ? samples : longest;
+    }
+    encoder_set_level_props(e, e->level);
+    return longest;
+}
+
+static void encoder_airtime_push(encoder *e, size_t max_len, size_t samples) {
+    if (e->airtime_len && e->airtime[e->airtime_len - 1].samples == samples) {
+        e->airtime[e->airtime_len - 1].max_len = max_len;
+        return;
+    }
+    if (e->airtime_len == e->airtime_cap) {
+        e->airtime_cap = e->airtime_cap ? 2 * e->airtime_cap : 16;
+        e->airtime = realloc(e->airtime, e->airtime_cap * sizeof(encoder_airtime_run));
+    }
+    e->airtime[e->airtime_len].max_len = max_len;
+    e->airtime[e->airtime_len].samples = samples;
+    e->airtime_len++;
+}
+
+// find every length in [lo, hi] where the sample length steps up
+// lengths between two with equal sample lengths must match them too, so
+//   only ranges which contain a step get split. runs are pushed in order
+static void encoder_airtime_bisect(encoder *e, const uint8_t *empty, size_t lo,
+                                   size_t lo_samples, size_t hi, size_t hi_samples) {
+    if (lo_samples == hi_samples) {
+        return;
+    }
+    if (hi - lo == 1) {
+        encoder_airtime_push(e, lo, lo_samples);
+        return;
+    }
+    size_t mid = lo + (hi - lo) / 2;
+    size_t mid_samples = encoder_trial_sample_len(e, empty, mid);
+    encoder_airtime_bisect(e, empty, lo, lo_samples, mid, mid_samples);
+    encoder_airtime_bisect(e, empty, mid, mid_samples, hi, hi_samples);
+}
+
+static void encoder_build_airtime(encoder *e) {
+    e->airtime = NULL;
+    e->airtime_len = 0;
+    e->airtime_cap = 0;
+
+    size_t max_len = encoder_max_frame_len(e);
+    if (!max_len) {
+        max_len = 1;
+    }
+    uint8_t *empty = calloc(max_len, sizeof(uint8_t));
+    size_t lo_samples = encoder_trial_sample_len(e, empty, 1);
+    size_t hi_samples = encoder_trial_sample_len(e, empty, max_len);
+    encoder_airtime_bisect(e, empty, 1, lo_samples, max_len, hi_samples);
+    encoder_airtime_push(e, max_len, hi_samples);
+    free(empty);
+}
+
+// base rate samples needed for a frame of data_len bytes
+// lengths past the table (which can't be sent anyway) get the longest entry
+static size_t quiet_encoder_sample_len(const encoder *e, size_t data_len) {
+    size_t lo = 0, hi = e->airtime_len - 1;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (e->airtime[mid].max_len < data_len) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return e->airtime[lo].samples;
+}
+
+float quiet_encoder_frame_airtime(const quiet_encoder *e, size_t frame_len) {
+    return (float)quiet_encoder_sample_len(e, frame_len) / SAMPLE_RATE;
+}
+
 static size_t encoder_fillsymbols(encoder *e, size_t requested_length) {
-    size_t ofdmwritelen;
     switch (e->opt.encoding) {
     case ofdm_encoding:
-        // ofdm can't control the size of its blocks, so it ignores
-        // requested_length
-        // XXX ofdm now can, update this to take advantage of that
-        ofdmwritelen = e->opt.ofdmopt.num_subcarriers + e->opt.ofdmopt.cyclic_prefix_len;
-        ofdmflexframegen_write(e->frame.ofdm.framegen, e->symbolbuf, ofdmwritelen);
-        return ofdmwritelen;
+        // the framegen keeps its place within an ofdm block between
+        //   writes, so we can stop anywhere and fill exactly what was asked
+        if (requested_length > e->frame.ofdm.symbols_remaining) {
+            requested_length = e->frame.ofdm.symbols_remaining;
+        }
+        if (!requested_length) {
+            // our count ran out before the framegen finished, so fall back
+            //   to a whole block rather than stalling
+            requested_length = e->opt.ofdmopt.num_subcarriers + e->opt.ofdmopt.cyclic_prefix_len;
+        }
+
+        if (requested_length > e->symbolbuf_len) {
+            e->symbolbuf =
+                realloc(e->symbolbuf,
+                        requested_length *
+                            sizeof(float complex));  // XXX check malloc result
+            e->symbolbuf_len = requested_length;
+        }
+
+        ofdmflexframegen_write(e->frame.ofdm.framegen, e->symbolbuf, requested_length);
+        if (requested_length < e->frame.ofdm.symbols_remaining) {
+            e->frame.ofdm.symbols_remaining -= requested_length;
+        } else {
+            e->frame.ofdm.symbols_remaining = 0;
+        }
+        return requested_length;
     case modem_encoding:
         if (requested_length > e->frame.modem.symbols_remaining) {
             requested_length = e->frame.modem.symbols_remaining;
@@ -360,6 +1518,22 @@ static size_t encoder_fillsymbols(encoder *e, size_t requested_length) {
             e->symbolbuf_len = requested_length;
         }
 
+#if QUIET_HAVE_GMSK_WRITE
+        // render the whole request in one call rather than one stride at
+        //   a time. stop at the end of the frame so that we don't pick up
+        //   the zero padding written after it
+        if (requested_length > e->frame.gmsk.samples_remaining) {
+            requested_length = e->frame.gmsk.samples_remaining;
+        }
+        if (requested_length) {
+            gmskframegen_write(e->frame.gmsk.framegen, e->symbolbuf, requested_length);
+            e->frame.gmsk.samples_remaining -= requested_length;
+            return requested_length;
+        }
+        // our count ran out before the framegen finished, so fall back to
+        //   the stride loop until it does
+        requested_length = e->frame.gmsk.stride;
+#endif
         size_t i;
         for (i = 0; i < requested_length; i += e->frame.gmsk.stride) {
             int finished = gmskframegen_write_samples(e->frame.gmsk.framegen, e->symbolbuf + i);
@@ -367,16 +1541,125 @@ static size_t encoder_fillsymbols(encoder *e, size_t requested_length) {
                 break;
             }
         }
+        if (i < e->frame.gmsk.samples_remaining) {
+            e->frame.gmsk.samples_remaining -= i;
+        } else {
+            e->frame.gmsk.samples_remaining = 0;
+        }
         return i;
     }
 }
 
+// symbols left to write for the frame currently assembled
+static size_t encoder_symbols_remaining(encoder *e) {
+    if (!encoder_is_assembled(e)) {
+        return 0;
+    }
+    switch (e->opt.encoding) {
+    case ofdm_encoding:
+        return e->frame.ofdm.symbols_remaining;
+    case modem_encoding:
+        return e->frame.modem.symbols_remaining;
+    case gmsk_encoding:
+        return e->frame.gmsk.samples_remaining;
+    }
+    return 0;
+}
+
+// render the tail of the modulator and resampler into samplebuf and reset
+//   the modulator for the next burst
+static void encoder_flush(encoder *e) {
+    e->samplebuf_len = modulator_flush(e->mod, e->samplebuf);
+    if (e->resampler) {
+        for (size_t i = 0; i < e->opt.resampler.delay; i++) {
+            e->samplebuf[i + e->samplebuf_len] = 0;
+        }
+        e->samplebuf_len += e->opt.resampler.delay;
+    }
+    modulator_reset(e->mod);
+    e->has_flushed = true;
+    e->is_modulator_reset = true;
+}
+
+// a frame which starts from a reset modulator and ends with a flush always
+//   renders to the same samples, so those frames are served from the
+//   cache when we have them and recorded when we don't
+// returns true if samplebuf now holds the whole frame
+static bool encoder_replay_cached(encoder *e) {
+    if (!e->waveform_cache || !e->is_modulator_reset) {
+        return false;
+    }
+
+    const waveform_cache_entry *entry =
+        waveform_cache_get(e->waveform_cache, e->readframe, e->readframe_len);
+    if (!entry) {
+        e->is_cache_recording = true;
+        e->cache_record_len = 0;
+        return false;
+    }
+
+    if (entry->samples_len > e->samplebuf_cap) {
+        e->samplebuf = realloc(e->samplebuf,
+                               entry->samples_len * sizeof(sample_t));  // XXX check malloc result
+        e->samplebuf_cap = entry->samples_len;
+    }
+    memcpy(e->samplebuf, entry->samples, entry->samples_len * sizeof(sample_t));
+    e->samplebuf_len = entry->samples_len;
+    e->samplebuf_offset = 0;
+
+    // the cached samples already include the flush, and the modulator
+    //   hasn't been touched, so it's still reset for the next frame
+    encoder_reset_framegen(e);
+    e->has_flushed = true;
+    return true;
+}
+
+static void encoder_record_samples(encoder *e) {
+    size_t needed = e->cache_record_len + e->samplebuf_len;
+    if (needed > e->cache_record_cap) {
+        size_t cap = e->cache_record_cap ? e->cache_record_cap : e->samplebuf_cap;
+        while (cap < needed) {
+            cap *= 2;
+        }
+        e->cache_record = realloc(e->cache_record, cap * sizeof(sample_t));  // XXX check malloc result
+        e->cache_record_cap = cap;
+    }
+    memcpy(e->cache_record + e->cache_record_len, e->samplebuf,
+           e->samplebuf_len * sizeof(sample_t));
+    e->cache_record_len = needed;
+}
+
+// output samples needed to send a whole frame of frame_len bytes from
+//   idle, including the flush which follows it
+static size_t encoder_frame_output_len(const encoder *e, size_t frame_len) {
+    size_t baserate_len = quiet_encoder_sample_len(e, frame_len) +
+                          modulator_flush_sample_len(e->mod);
+    if (e->resampler) {
+        baserate_len += e->opt.resampler.delay;
+    }
+    return ceilf(baserate_len * e->resample_rate);
+}
+
+// output samples which will come out of emit before anything still queued
+static size_t encoder_pending_samples(encoder *e) {
+    size_t baserate_len = e->samplebuf_len +
+                          modulator_sample_len(e->mod, encoder_symbols_remaining(e));
+    if (!e->has_flushed) {
+        baserate_len += modulator_flush_sample_len(e->mod);
+        if (e->resampler) {
+            baserate_len += e->opt.resampler.delay;
+        }
+    }
+    return ceilf(baserate_len * e->resample_rate);
+}
+
 ssize_t quiet_encoder_emit(encoder *e, sample_t *samplebuf, size_t samplebuf_len) {
     if (!e) {
         return 0;
     }
 
     ssize_t written = 0;
+    size_t silent_len = 0;
     bool frame_closed = false;
     while (written < samplebuf_len) {
         size_t remaining = samplebuf_len - written;
@@ -411,26 +1694,47 @@ ssize_t quiet_encoder_emit(encoder *e, sample_t *samplebuf, size_t samplebuf_len
             break;
         }
 
+        if (e->is_cache_recording && !encoder_is_assembled(e)) {
+            // a recorded frame always ends with a flush so that the next
+            //   frame starts from a reset modulator, which keeps replays
+            //   continuous with whatever follows them
+            encoder_flush(e);
+            encoder_record_samples(e);
+            waveform_cache_put(e->waveform_cache, e->readframe, e->readframe_len,
+                               e->cache_record, e->cache_record_len);
+            e->is_cache_recording = false;
+            continue;
+        }
+
         if (!(encoder_is_assembled(e))) {
             // if we are in close-frame mode, and we've already written this time, then
             //    close out the buffer
             // also close it out if we are out of frames to write
             bool do_close_frame = e->is_close_frame && written > 0;
-            bool have_another_frame = encoder_read_next_frame(e);
+            // a frame which would start a new burst defers to carrier sense
+            bool have_another_frame = (!e->has_flushed || encoder_may_transmit(e)) &&
+                                      encoder_read_next_frame(e);
+
+            // in low latency mode, a frame which would run past the end of
+            //   this block but fits in a whole one waits for the next call,
+            //   so that it is handed over in one piece
+            bool is_deferred = false;
+            if (e->opt.low_latency && have_another_frame && written > 0) {
+                size_t frame_output_len = encoder_frame_output_len(e, e->readframe_len);
+                if (frame_output_len > remaining && frame_output_len <= samplebuf_len) {
+                    do_close_frame = true;
+                    is_deferred = true;
+                }
+            }
 
             if (do_close_frame || !have_another_frame) {
                 if (e->has_flushed) {
+                    // a deferred frame still leaves the block ending in
+                    //   silence rather than cut short
+                    frame_closed = is_deferred;
                     break;
                 }
-                e->samplebuf_len = modulator_flush(e->mod, e->samplebuf);
-                if (e->resampler) {
-                    for (size_t i = 0; i < e->opt.resampler.delay; i++) {
-                        e->samplebuf[i + e->samplebuf_len] = 0;
-                    }
-                    e->samplebuf_len += e->opt.resampler.delay;
-                }
-                modulator_reset(e->mod);
-                e->has_flushed = true;
+                encoder_flush(e);
                 if (do_close_frame && have_another_frame) {
                     // set this flag here so that we don't re-attempt the next frame check
                     // this is hacky and this logic needs cleanup
@@ -447,6 +1751,34 @@ ssize_t quiet_encoder_emit(encoder *e, sample_t *samplebuf, size_t samplebuf_len
         // we're going to write into our baserate samples buffer and then restart loop
         // once we do, we'll resample (if desired) and write to output buffer
 
+        if (!e->readframe_started) {
+            if (!encoder_preempt(e)) {
+                // go back to finding a frame, or to silence if there is none
+                continue;
+            }
+            if (e->opt.tdma_num_slots) {
+                size_t wait = encoder_tdma_wait(e, e->tdma_clock + written);
+                if (wait) {
+                    // finish the burst before this frame, then stay silent
+                    //   until the frame's slot comes round
+                    if (!e->has_flushed) {
+                        encoder_flush(e);
+                        continue;
+                    }
+                    size_t idle = (wait < remaining) ? wait : remaining;
+                    memset(samplebuf, 0, idle * sizeof(sample_t));
+                    samplebuf += idle;
+                    written += idle;
+                    silent_len += idle;
+                    continue;
+                }
+            }
+            e->readframe_started = true;
+            if (encoder_replay_cached(e)) {
+                continue;
+            }
+        }
+
         size_t baserate_samples_wanted = (size_t)(ceilf(remaining / e->resample_rate));
         size_t symbols_wanted = modulator_symbol_len(e->mod, baserate_samples_wanted);
         if (baserate_samples_wanted % e->mod->opt.samples_per_symbol) {
@@ -466,6 +1798,10 @@ ssize_t quiet_encoder_emit(encoder *e, sample_t *samplebuf, size_t samplebuf_len
         e->samplebuf_len =
             modulator_emit(e->mod, e->symbolbuf, symbols_written, e->samplebuf);
         e->has_flushed = false;
+        e->is_modulator_reset = false;
+        if (e->is_cache_recording) {
+            encoder_record_samples(e);
+        }
     }
 
     if (frame_closed) {
@@ -474,6 +1810,19 @@ ssize_t quiet_encoder_emit(encoder *e, sample_t *samplebuf, size_t samplebuf_len
             samplebuf[i] = 0;
             written++;
         }
+        silent_len += zerolen;
+    }
+
+    if (e->opt.tdma_num_slots) {
+        // our clock is the samples we write, so it only keeps up with the
+        //   channel if we write silence rather than nothing
+        if (!e->is_queue_closed && written < samplebuf_len) {
+            size_t zerolen = samplebuf_len - written;
+            memset(samplebuf, 0, zerolen * sizeof(sample_t));
+            written += zerolen;
+            silent_len += zerolen;
+        }
+        encoder_tdma_advance(e, written, silent_len);
     }
 
     if (written == 0 && !e->is_queue_closed) {
@@ -483,6 +1832,8 @@ ssize_t quiet_encoder_emit(encoder *e, sample_t *samplebuf, size_t samplebuf_len
         written = -1;
     }
 
+    atomic_store_explicit(&e->pending_samples, encoder_pending_samples(e), memory_order_release);
+
     return written;
 }
 
@@ -508,8 +1859,24 @@ void quiet_encoder_destroy(encoder *e) {
     modulator_destroy(e->mod);
     free(e->symbolbuf);
     free(e->samplebuf);
-    ring_destroy(e->buf);
+    if (e->mpsc) {
+        mpsc_destroy(e->mpsc);
+    }
+    for (size_t i = 0; i < e->num_priorities; i++) {
+        if (e->bufs[i]) {
+            ring_destroy(e->bufs[i]);
+        }
+    }
     free(e->tempframe);
     free(e->readframe);
+    free(e->stashframe);
+    free(e->aggframe);
+    free(e->aggframe_deadlines);
+    free(e->airtime);
+    waveform_cache_destroy(e->waveform_cache);
+    free(e->cache_record);
+    free(e->compression_dict);
+    free(e->compressframe);
+    free(e->levels);
     free(e);
 }
@@ -0,0 +1,115 @@
+#include "quiet/mpsc.h"
+
+static mpsc_slot *mpsc_slot_at(const mpsc_queue *q, size_t pos) {
+    return (mpsc_slot *)(q->slots + (pos & q->mask) * q->slot_stride);
+}
+
+mpsc_queue *mpsc_create(size_t num_slots, size_t max_len) {
+    mpsc_queue *q;
+    if (posix_memalign((void **)&q, MPSC_CACHE_LINE, sizeof(mpsc_queue))) {
+        return NULL;
+    }
+
+    size_t rounded = 2;
+    while (rounded < num_slots) {
+        rounded <<= 1;
+    }
+    q->num_slots = rounded;
+    q->mask = rounded - 1;
+    q->max_len = max_len;
+
+    // keep each slot header aligned for its atomic
+    size_t align = sizeof(mpsc_slot);
+    q->slot_stride = ((sizeof(mpsc_slot) + max_len + align - 1) / align) * align;
+    q->slots = malloc(q->num_slots * q->slot_stride);
+    if (!q->slots) {
+        free(q);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < q->num_slots; i++) {
+        mpsc_slot *slot = mpsc_slot_at(q, i);
+        atomic_init(&slot->seq, i);
+        slot->len = 0;
+    }
+
+    atomic_init(&q->enqueue.pos, 0);
+    q->dequeue.pos = 0;
+    atomic_init(&q->is_closed, false);
+    return q;
+}
+
+void mpsc_destroy(mpsc_queue *q) {
+    free(q->slots);
+    free(q);
+}
+
+ssize_t mpsc_enqueue(mpsc_queue *q, const void *buf, size_t len, uint64_t deadline) {
+    if (atomic_load_explicit(&q->is_closed, memory_order_relaxed)) {
+        return 0;
+    }
+
+    if (len > q->max_len) {
+        return RingErrorIO;
+    }
+
+    size_t pos = atomic_load_explicit(&q->enqueue.pos, memory_order_relaxed);
+    mpsc_slot *slot;
+    while (true) {
+        slot = mpsc_slot_at(q, pos);
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        ptrdiff_t diff = (ptrdiff_t)seq - (ptrdiff_t)pos;
+        if (diff == 0) {
+            // the slot is free, try to claim it
+            // on failure pos is reloaded with the current position
+            if (atomic_compare_exchange_weak_explicit(&q->enqueue.pos, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // the consumer hasn't emptied this slot from the last lap yet
+            return RingErrorWouldBlock;
+        } else {
+            // another producer claimed this slot first
+            pos = atomic_load_explicit(&q->enqueue.pos, memory_order_relaxed);
+        }
+    }
+
+    slot->len = len;
+    slot->deadline = deadline;
+    memcpy((uint8_t *)slot + sizeof(mpsc_slot), buf, len);
+    // this release publishes the frame to the consumer
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    return 1;
+}
+
+ssize_t mpsc_dequeue(mpsc_queue *q, void *dst, size_t dst_len, size_t *len, uint64_t *deadline) {
+    size_t pos = q->dequeue.pos;
+    mpsc_slot *slot = mpsc_slot_at(q, pos);
+    if (atomic_load_explicit(&slot->seq, memory_order_acquire) != pos + 1) {
+        // a producer which claimed this slot before the close may still
+        //   be copying, in which case its frame is lost along with the
+        //   close, just as a send racing quiet_encoder_close would be
+        if (atomic_load_explicit(&q->is_closed, memory_order_acquire)) {
+            return 0;
+        }
+        return RingErrorWouldBlock;
+    }
+
+    if (slot->len > dst_len) {
+        return RingErrorIO;
+    }
+    *len = slot->len;
+    *deadline = slot->deadline;
+    memcpy(dst, (uint8_t *)slot + sizeof(mpsc_slot), *len);
+
+    // hand the slot back to producers for their next lap
+    atomic_store_explicit(&slot->seq, pos + q->num_slots, memory_order_release);
+    q->dequeue.pos = pos + 1;
+    return 1;
+}
+
+void mpsc_close(mpsc_queue *q) {
+    atomic_store_explicit(&q->is_closed, true, memory_order_release);
+}
@@ -1,6 +1,23 @@
 #include "quiet/common.h"
 #include <jansson.h>
 
+// returns false for anything but the names of the policies
+static bool profile_overflow_policy(const char *name, quiet_overflow_policy_t *policy) {
+    if (!name) {
+        return false;
+    }
+    if (strcmp(name, "drop_newest") == 0) {
+        *policy = quiet_overflow_drop_newest;
+    } else if (strcmp(name, "drop_oldest") == 0) {
+        *policy = quiet_overflow_drop_oldest;
+    } else if (strcmp(name, "block") == 0) {
+        *policy = quiet_overflow_block;
+    } else {
+        return false;
+    }
+    return true;
+}
+
 encoder_options *encoder_profile(json_t *root, const char *profilename) {
     json_t *profile = json_object_get(root, profilename);
     if (!profile) {
@@ -59,6 +76,66 @@ encoder_options *encoder_profile(json_t *root, const char *profilename) {
     if ((v = json_object_get(profile, "frame_length"))) {
         opt->frame_len = json_integer_value(v);
     }
+    if ((v = json_object_get(profile, "queue_length"))) {
+        opt->queue_len = json_integer_value(v);
+    }
+    if ((v = json_object_get(profile, "overflow_policy"))) {
+        if (!profile_overflow_policy(json_string_value(v), &opt->overflow_policy)) {
+            free(opt);
+            quiet_set_last_error(quiet_profile_invalid_profile);
+            return NULL;
+        }
+    }
+    if ((v = json_object_get(profile, "priority_classes"))) {
+        opt->num_priorities = json_integer_value(v);
+    }
+    if ((v = json_object_get(profile, "priority_weights"))) {
+        for (size_t i = 0; i < json_array_size(v) && i < quiet_max_priorities; i++) {
+            opt->priority_weights[i] = json_integer_value(json_array_get(v, i));
+        }
+    }
+    if ((v = json_object_get(profile, "low_latency"))) {
+        opt->low_latency = json_is_true(v);
+    }
+    if ((v = json_object_get(profile, "waveform_cache_length"))) {
+        opt->waveform_cache_len = json_integer_value(v);
+    }
+    if ((v = json_object_get(profile, "aggregate"))) {
+        opt->aggregate = json_is_true(v);
+    }
+    if ((v = json_object_get(profile, "aggregation_linger_ms"))) {
+        opt->aggregation_linger_ms = json_integer_value(v);
+    }
+    if ((v = json_object_get(profile, "burst_frame_length"))) {
+        opt->burst_frame_len = json_integer_value(v);
+    }
+    if ((v = json_object_get(profile, "message_parity_percent"))) {
+        opt->message_parity_percent = json_integer_value(v);
+    }
+    if ((v = json_object_get(profile, "frame_repeats"))) {
+        opt->frame_repeats = json_integer_value(v);
+    }
+    if ((v = json_object_get(profile, "compress"))) {
+        opt->compress = json_is_true(v);
+    }
+    if ((v = json_object_get(profile, "csma_slot_ms"))) {
+        opt->csma_slot_ms = json_integer_value(v);
+    }
+    if ((v = json_object_get(profile, "csma_max_window"))) {
+        opt->csma_max_window = json_integer_value(v);
+    }
+    if ((v = json_object_get(profile, "tdma_num_slots"))) {
+        opt->tdma_num_slots = json_integer_value(v);
+    }
+    if ((v = json_object_get(profile, "tdma_slot_mask"))) {
+        opt->tdma_slot_mask = json_integer_value(v);
+    }
+    if ((v = json_object_get(profile, "tdma_slot_length"))) {
+        opt->tdma_slot_len = json_integer_value(v);
+    }
+    if ((v = json_object_get(profile, "tdma_guard_length"))) {
+        opt->tdma_guard_len = json_integer_value(v);
+    }
     if ((v = json_object_get(profile, "ofdm"))) {
         if (opt->encoding == gmsk_encoding) {
             free(opt);
@@ -288,6 +365,40 @@ decoder_options *decoder_profile(json_t *root, const char *profilename) {
     } else { 
         opt->demodopt.samples_per_symbol = 1;
     }
+    if ((v = json_object_get(profile, "queue_length"))) {
+        opt->queue_len = json_integer_value(v);
+    }
+    if ((v = json_object_get(profile, "stats_queue_length"))) {
+        opt->stats_queue_len = json_integer_value(v);
+    }
+    if ((v = json_object_get(profile, "broadcast_queue_length"))) {
+        opt->broadcast_queue_len = json_integer_value(v);
+    }
+    if ((v = json_object_get(profile, "aggregate"))) {
+        opt->aggregate = json_is_true(v);
+    }
+    if ((v = json_object_get(profile, "frame_repeats"))) {
+        opt->frame_repeats = json_integer_value(v);
+    }
+    if ((v = json_object_get(profile, "compress"))) {
+        opt->compress = json_is_true(v);
+    }
+    if ((v = json_object_get(profile, "carrier_sense_threshold"))) {
+        opt->carrier_sense_threshold = json_number_value(v);
+    }
+    if ((v = json_object_get(profile, "reassembly_slots"))) {
+        opt->reassembly_slots = json_integer_value(v);
+    }
+    if ((v = json_object_get(profile, "reassembly_length"))) {
+        opt->reassembly_len = json_integer_value(v);
+    }
+    if ((v = json_object_get(profile, "overflow_policy"))) {
+        if (!profile_overflow_policy(json_string_value(v), &opt->overflow_policy)) {
+            free(opt);
+            quiet_set_last_error(quiet_profile_invalid_profile);
+            return NULL;
+        }
+    }
     if ((v = json_object_get(profile, "resampler"))) {
         json_t *vv;
         if ((vv = json_object_get(v, "delay"))) {
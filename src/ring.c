@@ -1,10 +1,22 @@
 #include "quiet/ring.h"
 
+#if RING_MIRROR
+#include "quiet/ring_mirror.h"
+#endif
+
 ring *ring_create(size_t length) {
     ring *r = malloc(sizeof(ring));
 
-    r->length = length;
+#if RING_MIRROR
+    r->base = ring_mirror_create(&length);
+    if (!r->base) {
+        free(r);
+        return NULL;
+    }
+#else
     r->base = malloc(length);
+#endif
+    r->length = length;
     r->reader = r->base;
     r->writer = r->base;
 
@@ -20,7 +32,11 @@ ring *ring_create(size_t length) {
 // write == read - 1 -- can read all, write none
 
 void ring_destroy(ring *r) {
+#if RING_MIRROR
+    ring_mirror_destroy(r->base, r->length);
+#else
     free(r->base);
+#endif
     free(r);
 }
 
@@ -62,6 +78,10 @@ ssize_t ring_write(ring *r, const void *vbuf, size_t len) {
         return RingErrorWouldBlock;
     }
 
+#if RING_MIRROR
+    // the second mapping makes the whole span contiguous
+    memcpy(r->writer, buf, len);
+#else
     // how far do we write before the end of the ring?
     size_t prewrap = ring_calculate_distance(r, r->writer, r->base + r->length);
     prewrap = (prewrap > len) ? len : prewrap;
@@ -70,6 +90,7 @@ ssize_t ring_write(ring *r, const void *vbuf, size_t len) {
     if (prewrap < len) {
         memcpy(r->base, buf + prewrap, len - prewrap);
     }
+#endif
 
     r->writer = ring_calculate_advance(r, r->writer, len);
     return len;
@@ -88,6 +109,9 @@ ssize_t ring_read(ring *r, void *vdst, size_t len) {
 
     const uint8_t *dst = (const uint8_t *)vdst;
 
+#if RING_MIRROR
+    memcpy(dst, r->reader, len);
+#else
     size_t prewrap = ring_calculate_distance(r, r->reader, r->base + r->length);
     prewrap = (prewrap > len) ? len : prewrap;
     memcpy(dst, r->reader, prewrap);
@@ -95,6 +119,7 @@ ssize_t ring_read(ring *r, void *vdst, size_t len) {
     if (prewrap < len) {
         memcpy(dst + prewrap, r->base, len - prewrap);
     }
+#endif
 
     r->reader = ring_calculate_advance(r, r->reader, len);
     return len;
@@ -112,6 +137,10 @@ void ring_advance_reader(ring *r, size_t len) {
     r->reader = ring_calculate_advance(r, r->reader, len);
 }
 
+size_t ring_read_available(ring *r) {
+    return ring_calculate_distance(r, r->reader, r->writer);
+}
+
 ssize_t ring_write_partial_init(ring *r, size_t len) {
     if (r->is_closed) {
         return 0;
@@ -156,6 +185,9 @@ ssize_t ring_write_partial(ring *r, const void *vbuf, size_t len) {
 
     const uint8_t *buf = (const uint8_t *)vbuf;
 
+#if RING_MIRROR
+    memcpy(r->partial_writer, buf, len);
+#else
     // how far do we write before the end of the ring?
     size_t prewrap = ring_calculate_distance(r, r->partial_writer, r->base + r->length);
     prewrap = (prewrap > len) ? len : prewrap;
@@ -164,6 +196,7 @@ ssize_t ring_write_partial(ring *r, const void *vbuf, size_t len) {
     if (prewrap < len) {
         memcpy(r->base, buf + prewrap, len - prewrap);
     }
+#endif
 
     r->partial_writer = ring_calculate_advance(r, r->partial_writer, len);
     r->partial_write_length -= len;
@@ -205,6 +238,16 @@ void ring_writer_set_nonblocking(ring *r) {
     return;
 }
 
+int ring_get_reader_fd(ring *r) {
+    assert(false && "pollable descriptors not supported by this version. please recompile with pthread support");
+    return -1;
+}
+
+int ring_get_writer_fd(ring *r, size_t threshold) {
+    assert(false && "pollable descriptors not supported by this version. please recompile with pthread support");
+    return -1;
+}
+
 void ring_reader_lock(ring *r) {
     return;
 }
@@ -220,3 +263,11 @@ void ring_writer_lock(ring *r) {
 void ring_writer_unlock(ring *r) {
     return;
 }
+
+void ring_set_exclusive_writer(ring *r) {
+    return;
+}
+
+void ring_set_exclusive_reader(ring *r) {
+    return;
+}
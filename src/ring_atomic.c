@@ -1,252 +1,306 @@
 #include "quiet/ring_atomic.h"
 
+#if RING_MIRROR
+#include "quiet/ring_mirror.h"
+#endif
+
+static size_t ring_round_length(size_t length) {
+    size_t rounded = 1;
+    while (rounded < length) {
+        rounded <<= 1;
+    }
+    return rounded;
+}
+
 ring *ring_create(size_t length) {
-    ring *r = malloc(sizeof(ring));
-
-    r->length = length;
-    r->base = malloc(length);
-    atomic_init(&r->reader, (uintptr_t)r->base);
-    atomic_init(&r->writer, (uintptr_t)r->base);
-    pthread_mutex_init(&r->reader_mutex, NULL);
-    pthread_mutex_init(&r->writer_mutex, NULL);
-    atomic_init(&r->is_closed, false);
+    ring *r;
+    // keep the reader and writer state aligned to their own cache lines
+    if (posix_memalign((void **)&r, RING_CACHE_LINE, sizeof(ring))) {
+        return NULL;
+    }
 
-    r->partial_write_in_progress = false;
-    r->partial_write_length = 0;
+    r->length = ring_round_length(length);
+    r->mask = r->length - 1;
+#if RING_MIRROR
+    // pages are a power of two, so the mirrored length still is too
+    r->base = ring_mirror_create(&r->length);
+    if (!r->base) {
+        free(r);
+        return NULL;
+    }
+    r->mask = r->length - 1;
+#else
+    r->base = malloc(r->length);
+#endif
+
+    ring_writer_state *w = &r->writer.w;
+    atomic_init(&w->writer, 0);
+    w->reader_cache = 0;
+    w->partial_write_length = 0;
+    w->partial_writer = 0;
+    w->partial_write_in_progress = false;
+    w->is_shared = true;
+    pthread_mutex_init(&w->mutex, NULL);
+
+    ring_reader_state *rd = &r->reader.r;
+    atomic_init(&rd->reader, 0);
+    rd->writer_cache = 0;
+    rd->is_shared = true;
+    pthread_mutex_init(&rd->mutex, NULL);
+
+    atomic_init(&r->is_closed, false);
 
     return r;
 }
 
-// pointers equal -- can write all, read none
-// write == read - 1 -- can read all, write none
+// writer == reader -- can write all, read none
+// writer == reader + length -- can read all, write none
 
 void ring_destroy(ring *r) {
-    pthread_mutex_destroy(&r->reader_mutex);
-    pthread_mutex_destroy(&r->writer_mutex);
+    pthread_mutex_destroy(&r->writer.w.mutex);
+    pthread_mutex_destroy(&r->reader.r.mutex);
+#if RING_MIRROR
+    ring_mirror_destroy(r->base, r->length);
+#else
     free(r->base);
+#endif
     free(r);
 }
 
-size_t ring_calculate_distance(const ring *r, const uint8_t *src, const uint8_t *dst) {
-    dst = (dst < src) ? (dst + r->length) : dst;
-    return dst - src;
+// copy len bytes in to the ring starting at free-running position pos
+static void ring_copy_in(ring *r, size_t pos, const uint8_t *buf, size_t len) {
+    size_t offset = pos & r->mask;
+#if RING_MIRROR
+    // the second mapping makes the whole span contiguous
+    memcpy(r->base + offset, buf, len);
+#else
+    // how far do we write before the end of the ring?
+    size_t prewrap = r->length - offset;
+    if (len <= prewrap) {
+        memcpy(r->base + offset, buf, len);
+        return;
+    }
+    memcpy(r->base + offset, buf, prewrap);
+    memcpy(r->base, buf + prewrap, len - prewrap);
+#endif
 }
 
-uint8_t *ring_calculate_advance(const ring *r, uint8_t *p, size_t adv) {
-    uint8_t *end = p + adv;
-    return (end < (r->base + r->length)) ? end : (end - r->length);
+// copy len bytes out of the ring starting at free-running position pos
+static void ring_copy_out(const ring *r, size_t pos, uint8_t *dst, size_t len) {
+    size_t offset = pos & r->mask;
+#if RING_MIRROR
+    memcpy(dst, r->base + offset, len);
+#else
+    size_t prewrap = r->length - offset;
+    if (len <= prewrap) {
+        memcpy(dst, r->base + offset, len);
+        return;
+    }
+    memcpy(dst, r->base + offset, prewrap);
+    memcpy(dst + prewrap, r->base, len - prewrap);
+#endif
+}
+
+// check if len bytes can be written at writer
+// the reader's position is only loaded if our cached copy says there isn't
+//   room, which keeps the writer off of the reader's cache line in the
+//   common case
+static bool ring_writer_has_room(ring *r, size_t writer, size_t len) {
+    ring_writer_state *w = &r->writer.w;
+    if (len <= r->length - (writer - w->reader_cache)) {
+        return true;
+    }
+
+    // atomic note: the reader may advance right after this load, but it
+    // can only move forward, so we're always allowed to use at least as
+    // much space as we calculate here
+    w->reader_cache = atomic_load_explicit(&r->reader.r.reader, memory_order_acquire);
+    return len <= r->length - (writer - w->reader_cache);
 }
 
 ssize_t ring_write(ring *r, const void *vbuf, size_t len) {
-    bool is_closed = (bool)atomic_load(&r->is_closed);
-    if (is_closed) {
+    ring_writer_state *w = &r->writer.w;
+    if (atomic_load_explicit(&r->is_closed, memory_order_relaxed)) {
         return 0;
     }
 
-    if (r->partial_write_in_progress) {
+    if (w->partial_write_in_progress) {
         return RingErrorPartialWriteInProgress;
     }
 
-    const uint8_t *buf = (const uint8_t *)vbuf;
-
-    uint8_t *r_copy = (uint8_t*)atomic_load(&r->reader);
-    uint8_t *w_copy = (uint8_t*)atomic_load(&r->writer);
-    // first find if we have the available space
-    size_t distance = ring_calculate_distance(r, w_copy, r_copy);
-
-    // the writer pointer points to the next block to be written,
-    //      and reader to next block to be read
-    // if they have no distance between them, it tells us the reader
-    //      has read everything written
-    // otherwise, we have to make sure not to overwrite the next block
-    //      that the reader will read, so we subtract 1
-    // in other words, the reader may catch up to the writer,
-    //      but the writer must not catch up to the reader
-    size_t avail = distance ? (distance - 1) : (r->length - 1);
-
-    if (avail < len) {
+    // only the writer stores to writer, so a relaxed load sees our own value
+    size_t writer = atomic_load_explicit(&w->writer, memory_order_relaxed);
+    if (!ring_writer_has_room(r, writer, len)) {
         return RingErrorWouldBlock;
     }
 
-    // atomic note: r may change (ring_read could also occur right now)
-    // however, that's ok, because it can only advance reader ptr forward,
-    // not backward, so we're always allowed to use at least as much space
-    // as we calculated above
-
-    // how far do we write before the end of the ring?
-    size_t prewrap = ring_calculate_distance(r, w_copy, r->base + r->length);
-    prewrap = (prewrap > len) ? len : prewrap;
-
-    // this copy will be serialized by the atomic_store on this side and
-    //   atomic_load on the other side
-    memcpy(w_copy, buf, prewrap);
-
-    if (prewrap < len) {
-        memcpy(r->base, buf + prewrap, len - prewrap);
-    }
-
-    atomic_thread_fence(memory_order_release);
+    ring_copy_in(r, writer, (const uint8_t *)vbuf, len);
 
-    w_copy = ring_calculate_advance(r, w_copy, len);
-    atomic_store(&r->writer, (uintptr_t)w_copy);
+    // this release publishes the copy above to the reader's acquire load
+    atomic_store_explicit(&w->writer, writer + len, memory_order_release);
     return len;
 }
 
 ssize_t ring_read(ring *r, void *vdst, size_t len) {
-    uint8_t *r_copy = (uint8_t*)atomic_load(&r->reader);
-    uint8_t *w_copy = (uint8_t*)atomic_load(&r->writer);
-    // n.b. regarding comments in ring_write
-    // if r->reader == r->writer, then the reader is caught up, so we are done
-    size_t avail = ring_calculate_distance(r, r_copy, w_copy);
-    if (avail < len) {
-        bool is_closed = (bool)atomic_load(&r->is_closed);
-        if (is_closed) {
-            return 0;
+    ring_reader_state *rd = &r->reader.r;
+    size_t reader = atomic_load_explicit(&rd->reader, memory_order_relaxed);
+
+    if (rd->writer_cache - reader < len) {
+        rd->writer_cache = atomic_load_explicit(&r->writer.w.writer, memory_order_acquire);
+        if (rd->writer_cache - reader < len) {
+            // if the ring is closed, then allow reads to continue until ring is empty
+            // once it's empty, then notify of its closed state
+            // we look at the writer once more after seeing the close so that
+            //   a write which happened just before closing isn't lost
+            if (!atomic_load_explicit(&r->is_closed, memory_order_acquire)) {
+                return RingErrorWouldBlock;
+            }
+            rd->writer_cache = atomic_load_explicit(&r->writer.w.writer, memory_order_acquire);
+            if (rd->writer_cache - reader < len) {
+                return 0;
+            }
         }
-        return RingErrorWouldBlock;
     }
 
-    uint8_t *dst = (uint8_t *)vdst;
+    ring_copy_out(r, reader, (uint8_t *)vdst, len);
 
-    atomic_thread_fence(memory_order_acquire);
-
-    size_t prewrap = ring_calculate_distance(r, r_copy, r->base + r->length);
-    prewrap = (prewrap > len) ? len : prewrap;
-    memcpy(dst, r_copy, prewrap);
-
-    if (prewrap < len) {
-        memcpy(dst + prewrap, r->base, len - prewrap);
-    }
-
-    r_copy = ring_calculate_advance(r, r_copy, len);
-    atomic_store(&r->reader, (uintptr_t)r_copy);
+    // this release hands the space back to the writer only after our copy
+    atomic_store_explicit(&rd->reader, reader + len, memory_order_release);
     return len;
 }
 
 void ring_close(ring *r) {
-    atomic_store(&r->is_closed, true);
+    atomic_store_explicit(&r->is_closed, true, memory_order_release);
 }
 
 bool ring_is_closed(ring *r) {
-    return (bool)atomic_load(&r->is_closed);
+    return atomic_load_explicit(&r->is_closed, memory_order_acquire);
 }
 
 void ring_advance_reader(ring *r, size_t len) {
-    uint8_t *r_copy = (uint8_t*)atomic_load(&r->reader);
-    r_copy = ring_calculate_advance(r, r_copy, len);
-    atomic_store(&r->reader, (uintptr_t)r_copy);
+    ring_reader_state *rd = &r->reader.r;
+    size_t reader = atomic_load_explicit(&rd->reader, memory_order_relaxed);
+    atomic_store_explicit(&rd->reader, reader + len, memory_order_release);
+}
+
+size_t ring_read_available(ring *r) {
+    size_t writer = atomic_load_explicit(&r->writer.w.writer, memory_order_acquire);
+    return writer - atomic_load_explicit(&r->reader.r.reader, memory_order_relaxed);
 }
 
 ssize_t ring_write_partial_init(ring *r, size_t len) {
-    bool is_closed = (bool)atomic_load(&r->is_closed);
-    if (is_closed) {
+    ring_writer_state *w = &r->writer.w;
+    if (atomic_load_explicit(&r->is_closed, memory_order_relaxed)) {
         return 0;
     }
 
-    if (r->partial_write_in_progress) {
+    if (w->partial_write_in_progress) {
         return RingErrorPartialWriteInProgress;
     }
 
-    uint8_t *r_copy = (uint8_t*)atomic_load(&r->reader);
-    uint8_t *w_copy = (uint8_t*)atomic_load(&r->writer);
-    // first find if we have the available space
-    size_t distance = ring_calculate_distance(r, w_copy, r_copy);
-
-    // the writer pointer points to the next block to be written,
-    //      and reader to next block to be read
-    // if they have no distance between them, it tells us the reader
-    //      has read everything written
-    // otherwise, we have to make sure not to overwrite the next block
-    //      that the reader will read, so we subtract 1
-    // in other words, the reader may catch up to the writer,
-    //      but the writer must not catch up to the reader
-    size_t avail = distance ? (distance - 1) : (r->length - 1);
-
-    if (avail < len) {
+    size_t writer = atomic_load_explicit(&w->writer, memory_order_relaxed);
+    if (!ring_writer_has_room(r, writer, len)) {
         return RingErrorWouldBlock;
     }
 
-    r->partial_write_length = len;
-    r->partial_writer = w_copy;
-    r->partial_write_in_progress = true;
+    w->partial_write_length = len;
+    w->partial_writer = writer;
+    w->partial_write_in_progress = true;
 
     return len;
 }
 
 ssize_t ring_write_partial(ring *r, const void *vbuf, size_t len) {
-    if (r->is_closed) {
+    ring_writer_state *w = &r->writer.w;
+    if (atomic_load_explicit(&r->is_closed, memory_order_relaxed)) {
         return 0;
     }
 
-    if (len > r->partial_write_length) {
+    if (len > w->partial_write_length) {
         return RingErrorPartialWriteLengthMismatch;
     }
 
-    const uint8_t *buf = (const uint8_t *)vbuf;
-
-    // how far do we write before the end of the ring?
-    size_t prewrap = ring_calculate_distance(r, r->partial_writer, r->base + r->length);
-    prewrap = (prewrap > len) ? len : prewrap;
-    memcpy(r->partial_writer, buf, prewrap);
-
-    if (prewrap < len) {
-        memcpy(r->base, buf + prewrap, len - prewrap);
-    }
+    ring_copy_in(r, w->partial_writer, (const uint8_t *)vbuf, len);
 
-    r->partial_writer = ring_calculate_advance(r, r->partial_writer, len);
-    r->partial_write_length -= len;
+    w->partial_writer += len;
+    w->partial_write_length -= len;
     return len;
 }
 
 ssize_t ring_write_partial_commit(ring *r) {
-    if (r->is_closed) {
+    ring_writer_state *w = &r->writer.w;
+    if (atomic_load_explicit(&r->is_closed, memory_order_relaxed)) {
         return 0;
     }
 
-    if (!r->partial_write_in_progress) {
+    if (!w->partial_write_in_progress) {
         return RingErrorPartialWriteLengthMismatch;
     }
 
-    if (r->partial_write_length) {
+    if (w->partial_write_length) {
         return RingErrorPartialWriteLengthMismatch;
     }
 
-    atomic_thread_fence(memory_order_release);
-
-    atomic_store(&r->writer, (uintptr_t)r->partial_writer);
-    r->partial_write_in_progress = false;
+    atomic_store_explicit(&w->writer, w->partial_writer, memory_order_release);
+    w->partial_write_in_progress = false;
 
     return 0;
 }
 
-void ring_reader_set_blocking(ring *r, time_t sec, long nano) {
+void ring_set_reader_blocking(ring *r, time_t sec, long nano) {
     assert(false && "blocking mode not supported by this version. please recompile with pthread support");
 }
 
-void ring_reader_set_nonblocking(ring *r) {
+void ring_set_reader_nonblocking(ring *r) {
     return;
 }
 
-void ring_writer_set_blocking(ring *r, time_t sec, long nano) {
+void ring_set_writer_blocking(ring *r, time_t sec, long nano) {
     assert(false && "blocking mode not supported by this version. please recompile with pthread support");
 }
 
-void ring_writer_set_nonblocking(ring *r) {
+void ring_set_writer_nonblocking(ring *r) {
     return;
 }
 
+int ring_get_reader_fd(ring *r) {
+    // the lock-free ring has no wakeups to hang a descriptor on
+    return -1;
+}
+
+int ring_get_writer_fd(ring *r, size_t threshold) {
+    // the lock-free ring has no wakeups to hang a descriptor on
+    return -1;
+}
+
 void ring_writer_lock(ring *r) {
-    pthread_mutex_lock(&r->writer_mutex);
+    if (r->writer.w.is_shared) {
+        pthread_mutex_lock(&r->writer.w.mutex);
+    }
 }
 
 void ring_writer_unlock(ring *r) {
-    pthread_mutex_unlock(&r->writer_mutex);
+    if (r->writer.w.is_shared) {
+        pthread_mutex_unlock(&r->writer.w.mutex);
+    }
 }
 
 void ring_reader_lock(ring *r) {
-    pthread_mutex_lock(&r->reader_mutex);
+    if (r->reader.r.is_shared) {
+        pthread_mutex_lock(&r->reader.r.mutex);
+    }
 }
 
 void ring_reader_unlock(ring *r) {
-    pthread_mutex_unlock(&r->reader_mutex);
+    if (r->reader.r.is_shared) {
+        pthread_mutex_unlock(&r->reader.r.mutex);
+    }
+}
+
+void ring_set_exclusive_writer(ring *r) {
+    r->writer.w.is_shared = false;
+}
+
+void ring_set_exclusive_reader(ring *r) {
+    r->reader.r.is_shared = false;
 }
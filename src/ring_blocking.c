@@ -1,14 +1,92 @@
 #include "quiet/ring_blocking.h"
 
+#if RING_MIRROR
+#include "quiet/ring_mirror.h"
+#endif
+
 static ring_wait_t *ring_wait_create() {
     ring_wait_t *w = malloc(sizeof(ring_wait_t));
     w->is_blocking = false;
     pthread_cond_init(&w->cond, NULL);
+    w->notify_fd = -1;
+    w->notify_write_fd = -1;
+    w->notify_is_set = false;
+    w->notify_threshold = 1;
     return w;
 }
 
 static void ring_wait_destroy(ring_wait_t *w) {
     pthread_cond_destroy(&w->cond);
+    if (w->notify_fd >= 0) {
+        close(w->notify_fd);
+    }
+    if (w->notify_write_fd >= 0 && w->notify_write_fd != w->notify_fd) {
+        close(w->notify_write_fd);
+    }
+    free(w);
+}
+
+static int ring_wait_notify_open(ring_wait_t *w, size_t threshold) {
+    w->notify_threshold = threshold;
+    if (w->notify_fd >= 0) {
+        return w->notify_fd;
+    }
+#if QUIET_HAVE_EVENTFD
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    w->notify_fd = fd;
+    w->notify_write_fd = fd;
+#else
+    int fds[2];
+    if (pipe(fds)) {
+        return -1;
+    }
+    for (size_t i = 0; i < 2; i++) {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    w->notify_fd = fds[0];
+    w->notify_write_fd = fds[1];
+#endif
+    w->notify_is_set = false;
+    return w->notify_fd;
+}
+
+// make notify_fd readable if avail meets the threshold, drain it otherwise
+// we track the state ourselves so that the syscall only happens on transitions
+static void ring_wait_notify_update(ring_wait_t *w, size_t avail, bool force) {
+    if (w->notify_fd < 0) {
+        return;
+    }
+
+    bool ready = force || (avail >= w->notify_threshold);
+    if (ready == w->notify_is_set) {
+        return;
+    }
+
+    ssize_t res;
+    if (ready) {
+#if QUIET_HAVE_EVENTFD
+        uint64_t one = 1;
+        res = write(w->notify_write_fd, &one, sizeof(one));
+#else
+        uint8_t one = 1;
+        res = write(w->notify_write_fd, &one, sizeof(one));
+#endif
+    } else {
+#if QUIET_HAVE_EVENTFD
+        uint64_t count;
+        res = read(w->notify_fd, &count, sizeof(count));
+#else
+        uint8_t drain[16];
+        while ((res = read(w->notify_fd, drain, sizeof(drain))) == sizeof(drain)) {
+        }
+#endif
+    }
+    (void)res;
+    w->notify_is_set = ready;
 }
 
 static void ring_wait_set_blocking(ring_wait_t *w, time_t sec, long nano) {
@@ -68,8 +146,16 @@ static void ring_wait_signal(ring_wait_t *w) {
 ring *ring_create(size_t length) {
     ring *r = malloc(sizeof(ring));
 
-    r->length = length;
+#if RING_MIRROR
+    r->base = ring_mirror_create(&length);
+    if (!r->base) {
+        free(r);
+        return NULL;
+    }
+#else
     r->base = malloc(length);
+#endif
+    r->length = length;
     r->reader = r->base;
     r->writer = r->base;
     pthread_mutex_init(&r->mutex, NULL);
@@ -89,7 +175,11 @@ void ring_destroy(ring *r) {
     ring_wait_destroy(r->read_wait);
     ring_wait_destroy(r->write_wait);
     pthread_mutex_destroy(&r->mutex);
+#if RING_MIRROR
+    ring_mirror_destroy(r->base, r->length);
+#else
     free(r->base);
+#endif
     free(r);
 }
 
@@ -103,6 +193,28 @@ uint8_t *ring_calculate_advance(const ring *r, uint8_t *p, size_t adv) {
     return (end < (r->base + r->length)) ? end : (end - r->length);
 }
 
+// must be called with lock held
+static void ring_notify(ring *r) {
+    size_t readable = ring_calculate_distance(r, r->reader, r->writer);
+    size_t writable = r->length - 1 - readable;
+    ring_wait_notify_update(r->read_wait, readable, r->is_closed);
+    ring_wait_notify_update(r->write_wait, writable, r->is_closed);
+}
+
+// must be called with lock held
+int ring_get_reader_fd(ring *r) {
+    int fd = ring_wait_notify_open(r->read_wait, 1);
+    ring_notify(r);
+    return fd;
+}
+
+// must be called with lock held
+int ring_get_writer_fd(ring *r, size_t threshold) {
+    int fd = ring_wait_notify_open(r->write_wait, threshold);
+    ring_notify(r);
+    return fd;
+}
+
 // must be called with lock held
 void ring_set_reader_blocking(ring *r, time_t sec, long nano) {
     ring_wait_set_blocking(r->read_wait, sec, nano);
@@ -174,6 +286,10 @@ ssize_t ring_write(ring *r, const void *vbuf, size_t len) {
         }
     }
 
+#if RING_MIRROR
+    // the second mapping makes the whole span contiguous
+    memcpy(writer, buf, len);
+#else
     // how far do we write before the end of the ring?
     size_t prewrap = ring_calculate_distance(r, writer, r->base + r->length);
     prewrap = (prewrap > len) ? len : prewrap;
@@ -183,9 +299,11 @@ ssize_t ring_write(ring *r, const void *vbuf, size_t len) {
     if (prewrap < len) {
         memcpy(r->base, buf + prewrap, len - prewrap);
     }
+#endif
 
     r->writer = ring_calculate_advance(r, writer, len);
     ring_wait_signal(r->read_wait);
+    ring_notify(r);
     return len;
 }
 
@@ -255,6 +373,9 @@ ssize_t ring_write_partial(ring *r, const void *vbuf, size_t len) {
 
     const uint8_t *buf = (const uint8_t *)vbuf;
 
+#if RING_MIRROR
+    memcpy(r->partial_writer, buf, len);
+#else
     // how far do we write before the end of the ring?
     size_t prewrap = ring_calculate_distance(r, r->partial_writer, r->base + r->length);
     prewrap = (prewrap > len) ? len : prewrap;
@@ -263,6 +384,7 @@ ssize_t ring_write_partial(ring *r, const void *vbuf, size_t len) {
     if (prewrap < len) {
         memcpy(r->base, buf + prewrap, len - prewrap);
     }
+#endif
 
     r->partial_writer = ring_calculate_advance(r, r->partial_writer, len);
     r->partial_write_length -= len;
@@ -285,6 +407,7 @@ ssize_t ring_write_partial_commit(ring *r) {
     r->writer = r->partial_writer;
     r->partial_write_in_progress = false;
     ring_wait_signal(r->read_wait);
+    ring_notify(r);
 
     return 0;
 }
@@ -330,6 +453,9 @@ ssize_t ring_read(ring *r, void *vdst, size_t len) {
         }
     }
 
+#if RING_MIRROR
+    memcpy(dst, reader, len);
+#else
     size_t prewrap = ring_calculate_distance(r, reader, r->base + r->length);
     prewrap = (prewrap > len) ? len : prewrap;
     memcpy(dst, reader, prewrap);
@@ -337,9 +463,11 @@ ssize_t ring_read(ring *r, void *vdst, size_t len) {
     if (prewrap < len) {
         memcpy(dst + prewrap, r->base, len - prewrap);
     }
+#endif
 
     r->reader = ring_calculate_advance(r, reader, len);
     ring_wait_signal(r->write_wait);
+    ring_notify(r);
     return len;
 }
 
@@ -348,11 +476,18 @@ void ring_close(ring *r) {
     r->is_closed = true;
     ring_wait_broadcast(r->write_wait);
     ring_wait_broadcast(r->read_wait);
+    ring_notify(r);
 }
 
 // must be called with lock held
 void ring_advance_reader(ring *r, size_t len) {
     r->reader = ring_calculate_advance(r, r->reader, len);
+    ring_notify(r);
+}
+
+// must be called with lock held
+size_t ring_read_available(ring *r) {
+    return ring_calculate_distance(r, r->reader, r->writer);
 }
 
 // must be called with lock held
@@ -375,3 +510,11 @@ void ring_writer_lock(ring *r) {
 void ring_writer_unlock(ring *r) {
     pthread_mutex_unlock(&r->mutex);
 }
+
+void ring_set_exclusive_writer(ring *r) {
+    return;
+}
+
+void ring_set_exclusive_reader(ring *r) {
+    return;
+}
@@ -0,0 +1,667 @@
+// syscall() is not part of posix
+#define _GNU_SOURCE
+#include "quiet/ring_futex.h"
+
+#if RING_MIRROR
+#include "quiet/ring_mirror.h"
+#endif
+
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+// longest a side will poll the other's index before sleeping
+// the budget adapts between RING_FUTEX_MIN_SPIN and this depending on
+//   whether recent waits were satisfied while spinning
+#define RING_FUTEX_MAX_SPIN 4096
+#define RING_FUTEX_MIN_SPIN 16
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ring_cpu_relax() __builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define ring_cpu_relax() __asm__ __volatile__("yield")
+#else
+#define ring_cpu_relax() atomic_signal_fence(memory_order_seq_cst)
+#endif
+
+static long ring_futex(_Atomic uint32_t *word, int op, uint32_t val, const struct timespec *timeout) {
+    return syscall(SYS_futex, (uint32_t *)word, op | FUTEX_PRIVATE_FLAG, val, timeout, NULL, FUTEX_BITSET_MATCH_ANY);
+}
+
+static size_t ring_round_length(size_t length) {
+    size_t rounded = 1;
+    while (rounded < length) {
+        rounded <<= 1;
+    }
+    return rounded;
+}
+
+static void ring_wait_init(ring_futex_wait_t *w, unsigned int max_spin) {
+    atomic_init(&w->seq, 0);
+    atomic_init(&w->sleeping, 0);
+    w->is_blocking = false;
+    w->timeout.tv_sec = 0;
+    w->timeout.tv_nsec = 0;
+    w->spin = max_spin / 4;
+}
+
+static void ring_notify_init(ring_futex_notify_t *n) {
+    n->fd = -1;
+    n->write_fd = -1;
+    n->is_set = false;
+    n->threshold = 1;
+}
+
+static void ring_notify_destroy(ring_futex_notify_t *n) {
+    if (n->fd >= 0) {
+        close(n->fd);
+    }
+    if (n->write_fd >= 0 && n->write_fd != n->fd) {
+        close(n->write_fd);
+    }
+}
+
+ring *ring_create(size_t length) {
+    ring *r;
+    // keep the reader and writer state aligned to their own cache lines
+    if (posix_memalign((void **)&r, RING_CACHE_LINE, sizeof(ring))) {
+        return NULL;
+    }
+
+    r->length = ring_round_length(length);
+    r->mask = r->length - 1;
+#if RING_MIRROR
+    // pages are a power of two, so the mirrored length still is too
+    r->base = ring_mirror_create(&r->length);
+    if (!r->base) {
+        free(r);
+        return NULL;
+    }
+    r->mask = r->length - 1;
+#else
+    r->base = malloc(r->length);
+#endif
+
+    // spinning only helps if the other side can run at the same time
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    r->max_spin = (ncpu > 1) ? RING_FUTEX_MAX_SPIN : 0;
+
+    ring_writer_state *w = &r->writer.w;
+    atomic_init(&w->writer, 0);
+    w->reader_cache = 0;
+    w->partial_write_length = 0;
+    w->partial_writer = 0;
+    w->partial_write_in_progress = false;
+    w->is_shared = true;
+    pthread_mutex_init(&w->mutex, NULL);
+    ring_wait_init(&w->wait, r->max_spin);
+
+    ring_reader_state *rd = &r->reader.r;
+    atomic_init(&rd->reader, 0);
+    rd->writer_cache = 0;
+    rd->is_shared = true;
+    pthread_mutex_init(&rd->mutex, NULL);
+    ring_wait_init(&rd->wait, r->max_spin);
+
+    atomic_init(&r->is_closed, false);
+
+    atomic_init(&r->notify_enabled, false);
+    pthread_mutex_init(&r->notify_mutex, NULL);
+    ring_notify_init(&r->read_notify);
+    ring_notify_init(&r->write_notify);
+
+    return r;
+}
+
+void ring_destroy(ring *r) {
+    pthread_mutex_destroy(&r->writer.w.mutex);
+    pthread_mutex_destroy(&r->reader.r.mutex);
+    pthread_mutex_destroy(&r->notify_mutex);
+    ring_notify_destroy(&r->read_notify);
+    ring_notify_destroy(&r->write_notify);
+#if RING_MIRROR
+    ring_mirror_destroy(r->base, r->length);
+#else
+    free(r->base);
+#endif
+    free(r);
+}
+
+static void ring_wait_set_blocking(ring_futex_wait_t *w, time_t sec, long nano) {
+    w->is_blocking = true;
+    w->timeout.tv_sec = sec;
+    w->timeout.tv_nsec = nano;
+}
+
+static void ring_wait_set_nonblocking(ring_futex_wait_t *w) {
+    w->is_blocking = false;
+}
+
+// absolute CLOCK_MONOTONIC deadline, or zero to wait forever
+static struct timespec ring_wait_calculate_deadline(ring_futex_wait_t *w) {
+    struct timespec deadline;
+    deadline.tv_sec = 0;
+    deadline.tv_nsec = 0;
+    if (w->timeout.tv_sec == 0 && w->timeout.tv_nsec == 0) {
+        return deadline;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += w->timeout.tv_sec;
+    deadline.tv_nsec += w->timeout.tv_nsec;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    return deadline;
+}
+
+// announce that we're about to sleep
+// the returned sequence number is passed to ring_wait_sleep, which will not
+//   sleep if the other side has woken us in between. the caller must look
+//   at the other side's index once more after this
+static uint32_t ring_wait_prepare(ring_futex_wait_t *w) {
+    uint32_t seq = atomic_load_explicit(&w->seq, memory_order_acquire);
+    atomic_store_explicit(&w->sleeping, 1, memory_order_relaxed);
+    // pairs with the fence in ring_wait_wake. either we see the other
+    //   side's new index or it sees sleeping set
+    atomic_thread_fence(memory_order_seq_cst);
+    return seq;
+}
+
+// sleep until woken or deadline passes
+// a shared side's lock is released while sleeping so that the other
+//   threads on this side, and ring_close, can make progress
+static int ring_wait_sleep(ring_futex_wait_t *w, uint32_t seq, pthread_mutex_t *mu,
+                           bool is_shared, const struct timespec *deadline) {
+    if (is_shared) {
+        pthread_mutex_unlock(mu);
+    }
+
+    const struct timespec *timeout = NULL;
+    if (deadline->tv_sec != 0 || deadline->tv_nsec != 0) {
+        timeout = deadline;
+    }
+
+    int res = 0;
+    if (ring_futex(&w->seq, FUTEX_WAIT_BITSET, seq, timeout) == -1) {
+        // EAGAIN means we were woken before we got here, EINTR is a signal
+        // either way we go back and look at the ring again
+        if (errno == ETIMEDOUT) {
+            res = RingErrorTimedout;
+        } else if (errno != EAGAIN && errno != EINTR) {
+            res = RingErrorIO;
+        }
+    }
+
+    if (is_shared) {
+        pthread_mutex_lock(mu);
+    }
+    return res;
+}
+
+// wake anyone sleeping on w
+// must be called after the index which they are waiting on has been stored
+// sleeping is cleared here rather than by the sleepers so that a writer
+//   which outpaces a waking reader only makes the syscall once. a sleeper
+//   which timed out or never slept leaves it set, which costs one
+//   unneeded wake at worst
+static void ring_wait_wake(ring_futex_wait_t *w) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&w->sleeping, memory_order_relaxed) == 0) {
+        return;
+    }
+    if (atomic_exchange_explicit(&w->sleeping, 0, memory_order_relaxed) == 0) {
+        return;
+    }
+    atomic_fetch_add_explicit(&w->seq, 1, memory_order_release);
+    ring_futex(&w->seq, FUTEX_WAKE, INT_MAX, NULL);
+}
+
+// grow the spin budget when spinning paid off, shrink it when we had to
+//   sleep anyway
+static void ring_wait_adapt(ring_futex_wait_t *w, unsigned int max_spin, bool slept) {
+    if (!max_spin) {
+        return;
+    }
+    if (slept) {
+        w->spin = (w->spin / 2 > RING_FUTEX_MIN_SPIN) ? w->spin / 2 : RING_FUTEX_MIN_SPIN;
+    } else {
+        w->spin = (w->spin * 2 < max_spin) ? w->spin * 2 : max_spin;
+    }
+}
+
+static int ring_notify_open(ring_futex_notify_t *n, size_t threshold) {
+    n->threshold = threshold;
+    if (n->fd >= 0) {
+        return n->fd;
+    }
+#if QUIET_HAVE_EVENTFD
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    n->fd = fd;
+    n->write_fd = fd;
+#else
+    int fds[2];
+    if (pipe(fds)) {
+        return -1;
+    }
+    for (size_t i = 0; i < 2; i++) {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    n->fd = fds[0];
+    n->write_fd = fds[1];
+#endif
+    n->is_set = false;
+    return n->fd;
+}
+
+// make fd readable if avail meets the threshold, drain it otherwise
+// we track the state ourselves so that the syscall only happens on transitions
+static void ring_notify_update(ring_futex_notify_t *n, size_t avail, bool force) {
+    if (n->fd < 0) {
+        return;
+    }
+
+    bool ready = force || (avail >= n->threshold);
+    if (ready == n->is_set) {
+        return;
+    }
+
+    ssize_t res;
+    if (ready) {
+#if QUIET_HAVE_EVENTFD
+        uint64_t one = 1;
+        res = write(n->write_fd, &one, sizeof(one));
+#else
+        uint8_t one = 1;
+        res = write(n->write_fd, &one, sizeof(one));
+#endif
+    } else {
+#if QUIET_HAVE_EVENTFD
+        uint64_t count;
+        res = read(n->fd, &count, sizeof(count));
+#else
+        uint8_t drain[16];
+        while ((res = read(n->fd, drain, sizeof(drain))) == sizeof(drain)) {
+        }
+#endif
+    }
+    (void)res;
+    n->is_set = ready;
+}
+
+// bring the descriptors up to date with the ring
+// callers have already issued the seq_cst fence in ring_wait_wake, which
+//   orders their index store before our load of notify_enabled
+static void ring_notify(ring *r) {
+    if (!atomic_load_explicit(&r->notify_enabled, memory_order_relaxed)) {
+        return;
+    }
+    pthread_mutex_lock(&r->notify_mutex);
+    size_t writer = atomic_load_explicit(&r->writer.w.writer, memory_order_acquire);
+    size_t reader = atomic_load_explicit(&r->reader.r.reader, memory_order_acquire);
+    bool closed = atomic_load_explicit(&r->is_closed, memory_order_acquire);
+    size_t readable = writer - reader;
+    ring_notify_update(&r->read_notify, readable, closed);
+    ring_notify_update(&r->write_notify, r->length - readable, closed);
+    pthread_mutex_unlock(&r->notify_mutex);
+}
+
+static int ring_notify_enable(ring *r, ring_futex_notify_t *n, size_t threshold) {
+    pthread_mutex_lock(&r->notify_mutex);
+    int fd = ring_notify_open(n, threshold);
+    pthread_mutex_unlock(&r->notify_mutex);
+    atomic_store_explicit(&r->notify_enabled, true, memory_order_seq_cst);
+    atomic_thread_fence(memory_order_seq_cst);
+    ring_notify(r);
+    return fd;
+}
+
+int ring_get_reader_fd(ring *r) {
+    return ring_notify_enable(r, &r->read_notify, 1);
+}
+
+int ring_get_writer_fd(ring *r, size_t threshold) {
+    return ring_notify_enable(r, &r->write_notify, threshold);
+}
+
+// must be called with reader lock held
+void ring_set_reader_blocking(ring *r, time_t sec, long nano) {
+    ring_wait_set_blocking(&r->reader.r.wait, sec, nano);
+}
+
+// must be called with reader lock held
+void ring_set_reader_nonblocking(ring *r) {
+    ring_wait_set_nonblocking(&r->reader.r.wait);
+}
+
+// must be called with writer lock held
+void ring_set_writer_blocking(ring *r, time_t sec, long nano) {
+    ring_wait_set_blocking(&r->writer.w.wait, sec, nano);
+}
+
+// must be called with writer lock held
+void ring_set_writer_nonblocking(ring *r) {
+    ring_wait_set_nonblocking(&r->writer.w.wait);
+}
+
+// copy len bytes in to the ring starting at free-running position pos
+static void ring_copy_in(ring *r, size_t pos, const uint8_t *buf, size_t len) {
+    size_t offset = pos & r->mask;
+#if RING_MIRROR
+    // the second mapping makes the whole span contiguous
+    memcpy(r->base + offset, buf, len);
+#else
+    // how far do we write before the end of the ring?
+    size_t prewrap = r->length - offset;
+    if (len <= prewrap) {
+        memcpy(r->base + offset, buf, len);
+        return;
+    }
+    memcpy(r->base + offset, buf, prewrap);
+    memcpy(r->base, buf + prewrap, len - prewrap);
+#endif
+}
+
+// copy len bytes out of the ring starting at free-running position pos
+static void ring_copy_out(const ring *r, size_t pos, uint8_t *dst, size_t len) {
+    size_t offset = pos & r->mask;
+#if RING_MIRROR
+    memcpy(dst, r->base + offset, len);
+#else
+    size_t prewrap = r->length - offset;
+    if (len <= prewrap) {
+        memcpy(dst, r->base + offset, len);
+        return;
+    }
+    memcpy(dst, r->base + offset, prewrap);
+    memcpy(dst + prewrap, r->base, len - prewrap);
+#endif
+}
+
+// check if len bytes can be written at writer
+// the reader's position is only loaded if our cached copy says there isn't room
+static bool ring_writer_has_room(ring *r, size_t writer, size_t len) {
+    ring_writer_state *w = &r->writer.w;
+    if (len <= r->length - (writer - w->reader_cache)) {
+        return true;
+    }
+    w->reader_cache = atomic_load_explicit(&r->reader.r.reader, memory_order_acquire);
+    return len <= r->length - (writer - w->reader_cache);
+}
+
+// check if len bytes can be read at reader
+static bool ring_reader_has_data(ring *r, size_t reader, size_t len) {
+    ring_reader_state *rd = &r->reader.r;
+    if (rd->writer_cache - reader >= len) {
+        return true;
+    }
+    rd->writer_cache = atomic_load_explicit(&r->writer.w.writer, memory_order_acquire);
+    return rd->writer_cache - reader >= len;
+}
+
+// wait until len bytes can be written, returning the writer position
+// on failure, returns a value <= 0 in *res
+static size_t ring_writer_wait(ring *r, size_t len, ssize_t *res) {
+    ring_writer_state *w = &r->writer.w;
+    ring_futex_wait_t *wait = &w->wait;
+    bool is_blocking = wait->is_blocking;
+    struct timespec deadline;
+    if (is_blocking) {
+        deadline = ring_wait_calculate_deadline(wait);
+    }
+
+    unsigned int spun = 0;
+    bool slept = false;
+    *res = 1;
+    while (true) {
+        // if the ring is closed, then writing will always fail
+        if (atomic_load_explicit(&r->is_closed, memory_order_acquire)) {
+            *res = 0;
+            return 0;
+        }
+
+        // reloaded every time around, since another writer may have run
+        //   while our lock was released
+        size_t writer = atomic_load_explicit(&w->writer, memory_order_relaxed);
+        if (ring_writer_has_room(r, writer, len)) {
+            if (is_blocking) {
+                ring_wait_adapt(wait, r->max_spin, slept);
+            }
+            return writer;
+        }
+
+        if (!is_blocking) {
+            *res = RingErrorWouldBlock;
+            return 0;
+        }
+
+        if (spun < wait->spin) {
+            spun++;
+            ring_cpu_relax();
+            continue;
+        }
+
+        uint32_t seq = ring_wait_prepare(wait);
+        w->reader_cache = atomic_load_explicit(&r->reader.r.reader, memory_order_acquire);
+        if (len <= r->length - (writer - w->reader_cache) ||
+            atomic_load_explicit(&r->is_closed, memory_order_relaxed)) {
+            continue;
+        }
+        slept = true;
+        int wait_res = ring_wait_sleep(wait, seq, &w->mutex, w->is_shared, &deadline);
+        if (wait_res) {
+            ring_wait_adapt(wait, r->max_spin, true);
+            *res = wait_res;
+            return 0;
+        }
+    }
+}
+
+// must be called with writer lock held
+ssize_t ring_write(ring *r, const void *vbuf, size_t len) {
+    ring_writer_state *w = &r->writer.w;
+    if (w->partial_write_in_progress) {
+        return RingErrorPartialWriteInProgress;
+    }
+
+    ssize_t res;
+    size_t writer = ring_writer_wait(r, len, &res);
+    if (res <= 0) {
+        return res;
+    }
+
+    ring_copy_in(r, writer, (const uint8_t *)vbuf, len);
+
+    // this release publishes the copy above to the reader's acquire load
+    atomic_store_explicit(&w->writer, writer + len, memory_order_release);
+    ring_wait_wake(&r->reader.r.wait);
+    ring_notify(r);
+    return len;
+}
+
+// must be called with writer lock held
+ssize_t ring_write_partial_init(ring *r, size_t len) {
+    ring_writer_state *w = &r->writer.w;
+    if (w->partial_write_in_progress) {
+        return RingErrorPartialWriteInProgress;
+    }
+
+    ssize_t res;
+    size_t writer = ring_writer_wait(r, len, &res);
+    if (res <= 0) {
+        return res;
+    }
+
+    w->partial_write_length = len;
+    w->partial_writer = writer;
+    w->partial_write_in_progress = true;
+
+    return len;
+}
+
+ssize_t ring_write_partial(ring *r, const void *vbuf, size_t len) {
+    ring_writer_state *w = &r->writer.w;
+    if (atomic_load_explicit(&r->is_closed, memory_order_relaxed)) {
+        return 0;
+    }
+
+    if (len > w->partial_write_length) {
+        return RingErrorPartialWriteLengthMismatch;
+    }
+
+    ring_copy_in(r, w->partial_writer, (const uint8_t *)vbuf, len);
+
+    w->partial_writer += len;
+    w->partial_write_length -= len;
+    return len;
+}
+
+ssize_t ring_write_partial_commit(ring *r) {
+    ring_writer_state *w = &r->writer.w;
+    if (atomic_load_explicit(&r->is_closed, memory_order_relaxed)) {
+        return 0;
+    }
+
+    if (!w->partial_write_in_progress) {
+        return RingErrorPartialWriteLengthMismatch;
+    }
+
+    if (w->partial_write_length) {
+        return RingErrorPartialWriteLengthMismatch;
+    }
+
+    atomic_store_explicit(&w->writer, w->partial_writer, memory_order_release);
+    w->partial_write_in_progress = false;
+    ring_wait_wake(&r->reader.r.wait);
+    ring_notify(r);
+
+    return 0;
+}
+
+// must be called with reader lock held
+ssize_t ring_read(ring *r, void *vdst, size_t len) {
+    ring_reader_state *rd = &r->reader.r;
+    ring_futex_wait_t *wait = &rd->wait;
+    bool is_blocking = wait->is_blocking;
+    struct timespec deadline;
+    if (is_blocking) {
+        deadline = ring_wait_calculate_deadline(wait);
+    }
+
+    unsigned int spun = 0;
+    bool slept = false;
+    size_t reader;
+    while (true) {
+        reader = atomic_load_explicit(&rd->reader, memory_order_relaxed);
+        if (ring_reader_has_data(r, reader, len)) {
+            break;
+        }
+
+        // if the ring is closed, then allow reads to continue until ring is empty
+        // once it's empty, then notify of its closed state
+        // we look at the writer once more after seeing the close so that
+        //   a write which happened just before closing isn't lost
+        if (atomic_load_explicit(&r->is_closed, memory_order_acquire)) {
+            if (ring_reader_has_data(r, reader, len)) {
+                break;
+            }
+            return 0;
+        }
+
+        if (!is_blocking) {
+            return RingErrorWouldBlock;
+        }
+
+        if (spun < wait->spin) {
+            spun++;
+            ring_cpu_relax();
+            continue;
+        }
+
+        uint32_t seq = ring_wait_prepare(wait);
+        rd->writer_cache = atomic_load_explicit(&r->writer.w.writer, memory_order_acquire);
+        if (rd->writer_cache - reader >= len ||
+            atomic_load_explicit(&r->is_closed, memory_order_relaxed)) {
+            continue;
+        }
+        slept = true;
+        int res = ring_wait_sleep(wait, seq, &rd->mutex, rd->is_shared, &deadline);
+        if (res) {
+            ring_wait_adapt(wait, r->max_spin, true);
+            return res;
+        }
+    }
+
+    if (is_blocking) {
+        ring_wait_adapt(wait, r->max_spin, slept);
+    }
+
+    ring_copy_out(r, reader, (uint8_t *)vdst, len);
+
+    // this release hands the space back to the writer only after our copy
+    atomic_store_explicit(&rd->reader, reader + len, memory_order_release);
+    ring_wait_wake(&r->writer.w.wait);
+    ring_notify(r);
+    return len;
+}
+
+// must be called with reader lock held
+void ring_advance_reader(ring *r, size_t len) {
+    ring_reader_state *rd = &r->reader.r;
+    size_t reader = atomic_load_explicit(&rd->reader, memory_order_relaxed);
+    atomic_store_explicit(&rd->reader, reader + len, memory_order_release);
+    ring_wait_wake(&r->writer.w.wait);
+    ring_notify(r);
+}
+
+size_t ring_read_available(ring *r) {
+    size_t writer = atomic_load_explicit(&r->writer.w.writer, memory_order_acquire);
+    return writer - atomic_load_explicit(&r->reader.r.reader, memory_order_relaxed);
+}
+
+void ring_close(ring *r) {
+    atomic_store_explicit(&r->is_closed, true, memory_order_release);
+    ring_wait_wake(&r->writer.w.wait);
+    ring_wait_wake(&r->reader.r.wait);
+    ring_notify(r);
+}
+
+bool ring_is_closed(ring *r) {
+    return atomic_load_explicit(&r->is_closed, memory_order_acquire);
+}
+
+void ring_writer_lock(ring *r) {
+    if (r->writer.w.is_shared) {
+        pthread_mutex_lock(&r->writer.w.mutex);
+    }
+}
+
+void ring_writer_unlock(ring *r) {
+    if (r->writer.w.is_shared) {
+        pthread_mutex_unlock(&r->writer.w.mutex);
+    }
+}
+
+void ring_reader_lock(ring *r) {
+    if (r->reader.r.is_shared) {
+        pthread_mutex_lock(&r->reader.r.mutex);
+    }
+}
+
+void ring_reader_unlock(ring *r) {
+    if (r->reader.r.is_shared) {
+        pthread_mutex_unlock(&r->reader.r.mutex);
+    }
+}
+
+void ring_set_exclusive_writer(ring *r) {
+    r->writer.w.is_shared = false;
+}
+
+void ring_set_exclusive_reader(ring *r) {
+    r->reader.r.is_shared = false;
+}
@@ -0,0 +1,51 @@
+// memfd_create() is not part of posix
+#define _GNU_SOURCE
+#include "quiet/ring_mirror.h"
+
+#include <unistd.h>
+#include <sys/mman.h>
+
+uint8_t *ring_mirror_create(size_t *length) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t len = ((*length + page - 1) / page) * page;
+    if (len == 0) {
+        len = page;
+    }
+
+    int fd = memfd_create("quiet-ring", MFD_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    if (ftruncate(fd, len)) {
+        close(fd);
+        return NULL;
+    }
+
+    // reserve both halves at once so that nothing else can land in between
+    uint8_t *base = mmap(NULL, 2 * len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < 2; i++) {
+        void *half = mmap(base + i * len, len, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_FIXED, fd, 0);
+        if (half == MAP_FAILED) {
+            munmap(base, 2 * len);
+            close(fd);
+            return NULL;
+        }
+    }
+
+    // the mappings keep the memory alive
+    close(fd);
+
+    *length = len;
+    return base;
+}
+
+void ring_mirror_destroy(uint8_t *base, size_t length) {
+    munmap(base, 2 * length);
+}
@@ -0,0 +1,290 @@
+#include "quiet/sar.h"
+
+// reflected crc32 (ieee 802.3), a nibble at a time to keep the table small
+static const uint32_t sar_crc32_table[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4,
+    0x4db26158, 0x5005713c, 0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+    0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+};
+
+uint32_t sar_crc32(const uint8_t *buf, size_t len) {
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= buf[i];
+        crc = (crc >> 4) ^ sar_crc32_table[crc & 0x0f];
+        crc = (crc >> 4) ^ sar_crc32_table[crc & 0x0f];
+    }
+    return crc ^ 0xffffffff;
+}
+
+static void sar_write_u16(uint8_t *dst, uint16_t v) {
+    dst[0] = v >> 8;
+    dst[1] = v & 0xff;
+}
+
+static void sar_write_u32(uint8_t *dst, uint32_t v) {
+    dst[0] = v >> 24;
+    dst[1] = (v >> 16) & 0xff;
+    dst[2] = (v >> 8) & 0xff;
+    dst[3] = v & 0xff;
+}
+
+static uint16_t sar_read_u16(const uint8_t *src) {
+    return ((uint16_t)src[0] << 8) | src[1];
+}
+
+static uint32_t sar_read_u32(const uint8_t *src) {
+    return ((uint32_t)src[0] << 24) | ((uint32_t)src[1] << 16) |
+           ((uint32_t)src[2] << 8) | src[3];
+}
+
+void sar_header_write(uint8_t *dst, const sar_header *h) {
+    sar_write_u16(dst, h->id);
+    sar_write_u16(dst + 2, h->index);
+    sar_write_u16(dst + 4, h->count);
+    dst[6] = h->parity;
+    sar_write_u32(dst + 7, h->len);
+    sar_write_u32(dst + 11, h->crc);
+}
+
+size_t sar_segment_stride(const sar_header *h) {
+    return ((size_t)h->len + h->count - 1) / h->count;
+}
+
+size_t sar_segment_offset(const sar_header *h, uint16_t index) {
+    return (size_t)index * sar_segment_stride(h);
+}
+
+size_t sar_segment_len(const sar_header *h, uint16_t index) {
+    size_t stride = sar_segment_stride(h);
+    if (index >= h->count) {
+        return stride;
+    }
+    size_t offset = sar_segment_offset(h, index);
+    if (offset >= h->len) {
+        return 0;
+    }
+    return (h->len - offset < stride) ? h->len - offset : stride;
+}
+
+bool sar_header_read(const uint8_t *src, size_t seg_len, sar_header *h) {
+    h->id = sar_read_u16(src);
+    h->index = sar_read_u16(src + 2);
+    h->count = sar_read_u16(src + 4);
+    h->parity = src[6];
+    h->len = sar_read_u32(src + 7);
+    h->crc = sar_read_u32(src + 11);
+
+    if (!h->count || h->index >= (size_t)h->count + h->parity) {
+        return false;
+    }
+    if (h->parity && (size_t)h->count + h->parity > ERASURE_MAX_BLOCKS) {
+        return false;
+    }
+    return sar_segment_len(h, h->index) == seg_len;
+}
+
+sar_reassembler *sar_reassembler_create(size_t num_slots, size_t max_bytes) {
+    sar_reassembler *r = malloc(sizeof(sar_reassembler));
+    if (!r) {
+        return NULL;
+    }
+    r->slots = calloc(num_slots, sizeof(sar_slot));
+    if (!r->slots) {
+        free(r);
+        return NULL;
+    }
+    r->num_slots = num_slots;
+    r->max_bytes = max_bytes;
+    r->bytes_in_use = 0;
+    r->tick = 0;
+    r->dropped_messages = 0;
+    for (size_t i = 0; i < SAR_RECENT_LEN; i++) {
+        r->recent[i].is_set = false;
+    }
+    r->recent_next = 0;
+    return r;
+}
+
+static void sar_slot_release(sar_reassembler *r, sar_slot *slot) {
+    free(slot->data);
+    free(slot->received_map);
+    slot->data = NULL;
+    slot->received_map = NULL;
+    r->bytes_in_use -= slot->size;
+    slot->in_use = false;
+}
+
+void sar_reassembler_destroy(sar_reassembler *r) {
+    if (!r) {
+        return;
+    }
+    for (size_t i = 0; i < r->num_slots; i++) {
+        if (r->slots[i].in_use) {
+            sar_slot_release(r, &r->slots[i]);
+        }
+    }
+    free(r->slots);
+    free(r);
+}
+
+static sar_slot *sar_find_slot(sar_reassembler *r, const sar_header *h) {
+    for (size_t i = 0; i < r->num_slots; i++) {
+        sar_slot *slot = &r->slots[i];
+        if (slot->in_use && slot->id == h->id && slot->count == h->count &&
+            slot->parity == h->parity && slot->len == h->len && slot->crc == h->crc) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+static bool sar_is_recent(const sar_reassembler *r, const sar_header *h) {
+    for (size_t i = 0; i < SAR_RECENT_LEN; i++) {
+        const sar_recent *recent = &r->recent[i];
+        if (recent->is_set && recent->id == h->id && recent->len == h->len &&
+            recent->crc == h->crc) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void sar_add_recent(sar_reassembler *r, const sar_header *h) {
+    sar_recent *recent = &r->recent[r->recent_next];
+    recent->is_set = true;
+    recent->id = h->id;
+    recent->len = h->len;
+    recent->crc = h->crc;
+    r->recent_next = (r->recent_next + 1) % SAR_RECENT_LEN;
+}
+
+// make room for a message, abandoning the least recently active messages
+//   as needed
+// returns NULL if it can never fit
+static sar_slot *sar_claim_slot(sar_reassembler *r, const sar_header *h) {
+    size_t size = h->len;
+    if (h->parity) {
+        size = sar_segment_stride(h) * ((size_t)h->count + h->parity);
+    }
+    if (!r->num_slots || size > r->max_bytes) {
+        return NULL;
+    }
+
+    while (true) {
+        sar_slot *free_slot = NULL;
+        sar_slot *oldest = NULL;
+        for (size_t i = 0; i < r->num_slots; i++) {
+            sar_slot *slot = &r->slots[i];
+            if (!slot->in_use) {
+                free_slot = free_slot ? free_slot : slot;
+            } else if (!oldest || slot->last_used < oldest->last_used) {
+                oldest = slot;
+            }
+        }
+        if (free_slot && r->bytes_in_use + size <= r->max_bytes) {
+            // zeroed, as parity treats the last data segment as padded
+            free_slot->data = calloc(size ? size : 1, 1);
+            free_slot->received_map = calloc(((size_t)h->count + h->parity + 7) / 8, 1);
+            if (!free_slot->data || !free_slot->received_map) {
+                free(free_slot->data);
+                free(free_slot->received_map);
+                free_slot->data = NULL;
+                free_slot->received_map = NULL;
+                return NULL;
+            }
+            free_slot->in_use = true;
+            free_slot->id = h->id;
+            free_slot->count = h->count;
+            free_slot->parity = h->parity;
+            free_slot->received = 0;
+            free_slot->len = h->len;
+            free_slot->crc = h->crc;
+            free_slot->size = size;
+            r->bytes_in_use += size;
+            return free_slot;
+        }
+        // oldest can't be NULL here, as an empty reassembler always has
+        //   a free slot and room for anything up to max_bytes
+        sar_slot_release(r, oldest);
+        r->dropped_messages++;
+    }
+}
+
+static bool sar_finish(sar_reassembler *r, const uint8_t *data, size_t len, uint32_t crc,
+                       uint8_t *dst, size_t dst_len, size_t *msg_len) {
+    if (sar_crc32(data, len) != crc) {
+        r->dropped_messages++;
+        return false;
+    }
+    memcpy(dst, data, (len < dst_len) ? len : dst_len);
+    *msg_len = len;
+    return true;
+}
+
+bool sar_reassembler_add(sar_reassembler *r, const uint8_t *segment, size_t segment_len,
+                         uint8_t *dst, size_t dst_len, size_t *msg_len) {
+    if (segment_len < SAR_HEADER_LEN) {
+        return false;
+    }
+    sar_header h;
+    const uint8_t *payload = segment + SAR_HEADER_LEN;
+    size_t payload_len = segment_len - SAR_HEADER_LEN;
+    if (!sar_header_read(segment, payload_len, &h)) {
+        return false;
+    }
+
+    if (sar_is_recent(r, &h)) {
+        return false;
+    }
+
+    // short messages don't need a slot
+    if (h.count == 1 && h.index == 0) {
+        sar_add_recent(r, &h);
+        return sar_finish(r, payload, payload_len, h.crc, dst, dst_len, msg_len);
+    }
+
+    sar_slot *slot = sar_find_slot(r, &h);
+    if (!slot) {
+        slot = sar_claim_slot(r, &h);
+        if (!slot) {
+            // only count each message once
+            if (h.index == 0) {
+                r->dropped_messages++;
+            }
+            return false;
+        }
+    }
+    slot->last_used = ++r->tick;
+
+    uint8_t bit = 1u << (h.index % 8);
+    if (slot->received_map[h.index / 8] & bit) {
+        return false;
+    }
+    slot->received_map[h.index / 8] |= bit;
+    memcpy(slot->data + sar_segment_offset(&h, h.index), payload, payload_len);
+    slot->received++;
+
+    if (slot->received < slot->count) {
+        return false;
+    }
+
+    sar_add_recent(r, &h);
+    bool done = true;
+    if (slot->parity) {
+        bool present[ERASURE_MAX_BLOCKS];
+        for (size_t i = 0; i < (size_t)slot->count + slot->parity; i++) {
+            present[i] = slot->received_map[i / 8] & (1u << (i % 8));
+        }
+        done = erasure_decode(slot->data, present, slot->count, slot->parity,
+                              sar_segment_stride(&h));
+        if (!done) {
+            r->dropped_messages++;
+        }
+    }
+    if (done) {
+        done = sar_finish(r, slot->data, slot->len, slot->crc, dst, dst_len, msg_len);
+    }
+    sar_slot_release(r, slot);
+    return done;
+}
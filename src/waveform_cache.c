@@ -0,0 +1,105 @@
+#include "quiet/waveform_cache.h"
+
+// fnv-1a. only used to skip most of the memcmps, so collisions are fine
+static uint64_t waveform_cache_hash(const uint8_t *payload, size_t payload_len) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < payload_len; i++) {
+        hash ^= payload[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+waveform_cache *waveform_cache_create(size_t num_entries) {
+    waveform_cache *c = malloc(sizeof(waveform_cache));
+    if (!c) {
+        return NULL;
+    }
+    c->entries = calloc(num_entries, sizeof(waveform_cache_entry));
+    if (!c->entries) {
+        free(c);
+        return NULL;
+    }
+    c->num_entries = num_entries;
+    c->tick = 0;
+    return c;
+}
+
+void waveform_cache_destroy(waveform_cache *c) {
+    if (!c) {
+        return;
+    }
+    for (size_t i = 0; i < c->num_entries; i++) {
+        free(c->entries[i].payload);
+        free(c->entries[i].samples);
+    }
+    free(c->entries);
+    free(c);
+}
+
+void waveform_cache_clear(waveform_cache *c) {
+    for (size_t i = 0; i < c->num_entries; i++) {
+        waveform_cache_entry *entry = &c->entries[i];
+        free(entry->payload);
+        free(entry->samples);
+        entry->payload = NULL;
+        entry->samples = NULL;
+        entry->last_used = 0;
+    }
+}
+
+const waveform_cache_entry *waveform_cache_get(waveform_cache *c, const uint8_t *payload,
+                                               size_t payload_len) {
+    uint64_t hash = waveform_cache_hash(payload, payload_len);
+    for (size_t i = 0; i < c->num_entries; i++) {
+        waveform_cache_entry *entry = &c->entries[i];
+        if (!entry->last_used || entry->hash != hash ||
+            entry->payload_len != payload_len) {
+            continue;
+        }
+        if (memcmp(entry->payload, payload, payload_len)) {
+            continue;
+        }
+        entry->last_used = ++c->tick;
+        return entry;
+    }
+    return NULL;
+}
+
+bool waveform_cache_put(waveform_cache *c, const uint8_t *payload, size_t payload_len,
+                        const sample_t *samples, size_t samples_len) {
+    if (!c->num_entries) {
+        return false;
+    }
+
+    // empty entries have last_used == 0, so they're always picked first
+    waveform_cache_entry *victim = &c->entries[0];
+    for (size_t i = 1; i < c->num_entries; i++) {
+        if (c->entries[i].last_used < victim->last_used) {
+            victim = &c->entries[i];
+        }
+    }
+
+    free(victim->payload);
+    free(victim->samples);
+    victim->last_used = 0;
+
+    // malloc(0) may return NULL, so always ask for at least a byte
+    victim->payload = malloc(payload_len ? payload_len : 1);
+    victim->samples = malloc(samples_len * sizeof(sample_t));
+    if (!victim->payload || (samples_len && !victim->samples)) {
+        free(victim->payload);
+        free(victim->samples);
+        victim->payload = NULL;
+        victim->samples = NULL;
+        return false;
+    }
+
+    memcpy(victim->payload, payload, payload_len);
+    memcpy(victim->samples, samples, samples_len * sizeof(sample_t));
+    victim->hash = waveform_cache_hash(payload, payload_len);
+    victim->payload_len = payload_len;
+    victim->samples_len = samples_len;
+    victim->last_used = ++c->tick;
+    return true;
+}
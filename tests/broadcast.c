@@ -0,0 +1,149 @@
+#include "quiet/broadcast.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+
+const uint32_t num_frames = 1 << 16;
+
+typedef struct {
+    broadcast_subscriber *s;
+    bool slow;
+    int res;
+} arg_t;
+
+// every frame carries its sequence number, repeated out to a length
+//   which depends on it
+static size_t frame_len(uint32_t seq) {
+    return sizeof(uint32_t) * (1 + seq % 16);
+}
+
+static bool frame_is_valid(const uint8_t *frame, size_t len, uint32_t *seq) {
+    memcpy(seq, frame, sizeof(uint32_t));
+    if (len != frame_len(*seq)) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i += sizeof(uint32_t)) {
+        if (memcmp(frame + i, seq, sizeof(uint32_t))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void *subscribe_sequence(void *arg_void) {
+    arg_t *arg = (arg_t*)arg_void;
+    uint32_t next = 0;
+    size_t received = 0;
+    arg->res = 0;
+    while (true) {
+        const uint8_t *frame;
+        ssize_t len = broadcast_recv(arg->s, &frame);
+        if (len == 0) {
+            break;
+        }
+        if (len < 0) {
+            printf("recv failed: %zd\n", len);
+            arg->res = 1;
+            break;
+        }
+        uint32_t seq;
+        if (!frame_is_valid(frame, len, &seq)) {
+            printf("corrupt frame after %u\n", next);
+            arg->res = 1;
+            break;
+        }
+        // a lagging subscriber may skip frames, but never goes backwards
+        bool in_order = arg->slow ? (seq >= next) : (seq == next);
+        if (!in_order) {
+            printf("frame %u out of order, expected %u\n", seq, next);
+            arg->res = 1;
+            break;
+        }
+        if (arg->slow && seq % 1024 == 0) {
+            // hold the frame while the writer laps us, it must not change
+            struct timespec delay = { .tv_sec = 0, .tv_nsec = 1000000 };
+            nanosleep(&delay, NULL);
+            uint32_t check;
+            if (!frame_is_valid(frame, len, &check) || check != seq) {
+                printf("held frame %u was overwritten\n", seq);
+                arg->res = 1;
+                break;
+            }
+        }
+        next = seq + 1;
+        received++;
+    }
+    broadcast_release(arg->s);
+
+    if (!arg->slow && received != num_frames) {
+        printf("blocking subscriber received %zu of %u frames\n", received, num_frames);
+        arg->res = 1;
+    }
+    if (arg->slow && received + broadcast_dropped_frames(arg->s) != num_frames) {
+        printf("lagging subscriber received %zu and dropped %zu of %u frames\n",
+               received, broadcast_dropped_frames(arg->s), num_frames);
+        arg->res = 1;
+    }
+    return NULL;
+}
+
+int test_subscribers() {
+    broadcast *b = broadcast_create(16);
+    uint8_t frame[sizeof(uint32_t) * 16];
+
+    // nobody is listening yet, so frames are refused
+    int res = broadcast_write(b, frame, sizeof(uint32_t));
+
+    arg_t args[3] = {
+        { .s = broadcast_subscribe(b, quiet_overflow_block), .slow = false },
+        { .s = broadcast_subscribe(b, quiet_overflow_block), .slow = false },
+        { .s = broadcast_subscribe(b, quiet_overflow_drop_oldest), .slow = true },
+    };
+    pthread_t threads[3];
+    for (size_t i = 0; i < 3; i++) {
+        broadcast_set_blocking(args[i].s, 0, 0);
+        pthread_create(&threads[i], NULL, subscribe_sequence, &args[i]);
+    }
+
+    for (uint32_t seq = 0; seq < num_frames; seq++) {
+        for (size_t i = 0; i < frame_len(seq); i += sizeof(uint32_t)) {
+            memcpy(frame + i, &seq, sizeof(uint32_t));
+        }
+        res |= !broadcast_write(b, frame, frame_len(seq));
+    }
+    broadcast_close(b);
+
+    for (size_t i = 0; i < 3; i++) {
+        pthread_join(threads[i], NULL);
+        res |= args[i].res;
+    }
+    printf("lagging subscriber dropped %zu frames\n", broadcast_dropped_frames(args[2].s));
+
+    broadcast_unsubscribe(args[0].s);
+    broadcast_destroy(b);
+    return res;
+}
+
+int test_timeout() {
+    broadcast *b = broadcast_create(4);
+    broadcast_subscriber *s = broadcast_subscribe(b, quiet_overflow_drop_oldest);
+    const uint8_t *frame;
+    int res = (broadcast_recv(s, &frame) != RingErrorWouldBlock);
+    broadcast_set_blocking(s, 0, 20000000);
+    res |= (broadcast_recv(s, &frame) != RingErrorTimedout);
+    broadcast_destroy(b);
+    return res;
+}
+
+int main() {
+    int res = test_subscribers();
+    printf("3 subscriber test passed: %s\n", res ? "FALSE" : "TRUE");
+
+    int timeout_res = test_timeout();
+    printf("timeout test passed: %s\n", timeout_res ? "FALSE" : "TRUE");
+    res = res ? res : timeout_res;
+
+    return res;
+}
@@ -0,0 +1,108 @@
+#include "quiet/compress.h"
+
+#include <stdio.h>
+
+static bool round_trips(const uint8_t *dict, size_t dict_len, const uint8_t *msg, size_t len,
+                        size_t *compressed_len) {
+    uint8_t packed[512], unpacked[512];
+    *compressed_len = compress_lz(dict, dict_len, msg, len, packed, sizeof(packed));
+    if (!*compressed_len) {
+        return false;
+    }
+    ssize_t unpacked_len = decompress_lz(dict, dict_len, packed, *compressed_len, unpacked,
+                                         sizeof(unpacked));
+    return unpacked_len == (ssize_t)len && !memcmp(msg, unpacked, len);
+}
+
+int test_round_trip() {
+    const char *text = "{\"temp\": 21.5, \"humidity\": 40, \"temp_max\": 22.5, "
+                       "\"humidity_max\": 44, \"status\": \"ok\", \"status_prev\": \"ok\"}";
+    size_t compressed_len;
+    int res = 0;
+
+    res |= !round_trips(NULL, 0, (const uint8_t *)text, strlen(text), &compressed_len);
+    res |= compressed_len >= strlen(text);
+
+    // long runs need the extended lengths
+    uint8_t run[400];
+    memset(run, 'a', sizeof(run));
+    for (size_t i = 0; i < 20; i++) {
+        run[i * 20] = i;
+    }
+    res |= !round_trips(NULL, 0, run, sizeof(run), &compressed_len);
+    res |= compressed_len >= sizeof(run) / 2;
+
+    res |= !round_trips(NULL, 0, run, 0, &compressed_len);
+    res |= !round_trips(NULL, 0, run, 3, &compressed_len);
+
+    // noise doesn't shrink, and is refused if there's no room for it
+    uint8_t noise[200];
+    uint32_t x = 1;
+    for (size_t i = 0; i < sizeof(noise); i++) {
+        x = x * 1103515245 + 12345;
+        noise[i] = x >> 24;
+    }
+    res |= !round_trips(NULL, 0, noise, sizeof(noise), &compressed_len);
+    res |= compressed_len <= sizeof(noise);
+    uint8_t packed[sizeof(noise)];
+    res |= compress_lz(NULL, 0, noise, sizeof(noise), packed, sizeof(packed)) != 0;
+
+    return res;
+}
+
+int test_dictionary() {
+    const char *dict = "{\"temp\": , \"humidity\": , \"status\": \"ok\"}";
+    const char *msg = "{\"temp\": 19, \"humidity\": 51, \"status\": \"ok\"}";
+    size_t plain_len, dict_compressed_len;
+    int res = 0;
+
+    res |= !round_trips(NULL, 0, (const uint8_t *)msg, strlen(msg), &plain_len);
+    res |= !round_trips((const uint8_t *)dict, strlen(dict), (const uint8_t *)msg, strlen(msg),
+                        &dict_compressed_len);
+    res |= dict_compressed_len >= plain_len;
+    res |= dict_compressed_len >= strlen(msg) / 2;
+
+    // without the dictionary, the matches in to it are out of range
+    uint8_t packed[128], unpacked[128];
+    size_t len = compress_lz((const uint8_t *)dict, strlen(dict), (const uint8_t *)msg,
+                             strlen(msg), packed, sizeof(packed));
+    res |= decompress_lz(NULL, 0, packed, len, unpacked, sizeof(unpacked)) != -1;
+    return res;
+}
+
+int test_malformed() {
+    const char *text = "abcdabcdabcdabcdabcdabcd";
+    uint8_t packed[64], unpacked[64];
+    size_t len = compress_lz(NULL, 0, (const uint8_t *)text, strlen(text), packed, sizeof(packed));
+    int res = 0;
+
+    // too small to hold the output
+    res |= decompress_lz(NULL, 0, packed, len, unpacked, strlen(text) - 1) != -1;
+    // cut short, which may still parse if it ends after a literal run,
+    //   but never as the whole message
+    for (size_t i = 0; i < len; i++) {
+        res |= decompress_lz(NULL, 0, packed, i, unpacked, sizeof(unpacked)) == (ssize_t)strlen(text);
+    }
+    // an offset reaching before the start
+    const uint8_t bad_offset[] = { 0x10, 'a', 0x00, 0x02, 0x00 };
+    res |= decompress_lz(NULL, 0, bad_offset, sizeof(bad_offset), unpacked, sizeof(unpacked)) != -1;
+    return res;
+}
+
+int main() {
+    int res = 0;
+
+    int round_trip_res = test_round_trip();
+    printf("round trip test passed: %s\n", round_trip_res ? "FALSE" : "TRUE");
+    res = res ? res : round_trip_res;
+
+    int dict_res = test_dictionary();
+    printf("dictionary test passed: %s\n", dict_res ? "FALSE" : "TRUE");
+    res = res ? res : dict_res;
+
+    int malformed_res = test_malformed();
+    printf("malformed input test passed: %s\n", malformed_res ? "FALSE" : "TRUE");
+    res = res ? res : malformed_res;
+
+    return res;
+}
@@ -1,4 +1,5 @@
 #include <math.h>
+#include <string.h>
 #include <time.h>
 
 #include "quiet.h"
@@ -110,6 +111,1126 @@ int test_payload(const char *profile_name,
     return 0;
 }
 
+quiet_encoder_options *load_encoder_opt(const char *profile_name) {
+    fseek(profiles_f, 0, SEEK_SET);
+    return quiet_encoder_profile_file(profiles_f, profile_name);
+}
+
+quiet_decoder_options *load_decoder_opt(const char *profile_name) {
+    fseek(profiles_f, 0, SEEK_SET);
+    return quiet_decoder_profile_file(profiles_f, profile_name);
+}
+
+void fill_random(uint8_t *buf, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = rand() & 0xff;
+    }
+}
+
+// give d enough silence to finish the last frame it was given
+void finish_decoding(quiet_decoder *d) {
+    size_t silence_len = 16384;
+    quiet_sample_t *silence = calloc(silence_len, sizeof(quiet_sample_t));
+    quiet_decoder_consume(d, silence, silence_len);
+    quiet_decoder_flush(d);
+    free(silence);
+}
+
+// emit everything queued in e in to d
+void loopback(quiet_encoder *e, quiet_decoder *d) {
+    size_t samplebuf_len = 16384;
+    quiet_sample_t *samplebuf = malloc(samplebuf_len * sizeof(quiet_sample_t));
+    for (;;) {
+        ssize_t written = quiet_encoder_emit(e, samplebuf, samplebuf_len);
+        if (written <= 0) {
+            break;
+        }
+        quiet_decoder_consume(d, samplebuf, written);
+    }
+    finish_decoding(d);
+    free(samplebuf);
+}
+
+// receive one frame from d and check that it is payload
+int recv_expect(quiet_decoder *d, const uint8_t *payload, size_t payload_len) {
+    uint8_t buf[1 << 14];
+    ssize_t read = quiet_decoder_recv(d, buf, sizeof(buf));
+    if (read < 0) {
+        printf("failed, expected a frame of %zu bytes, got none\n", payload_len);
+        return 1;
+    }
+    if ((size_t)read != payload_len || compare_chunk(payload, buf, payload_len)) {
+        printf("failed, expected a frame of %zu bytes, got a different one of %zd bytes\n",
+               payload_len, read);
+        return 1;
+    }
+    return 0;
+}
+
+// check that d has nothing more to receive
+int recv_expect_none(quiet_decoder *d) {
+    uint8_t buf[1 << 14];
+    ssize_t read = quiet_decoder_recv(d, buf, sizeof(buf));
+    if (read >= 0) {
+        printf("failed, received an unexpected frame of %zd bytes\n", read);
+        return 1;
+    }
+    return 0;
+}
+
+typedef struct {
+    uint8_t *received;
+    size_t received_len;
+    size_t num_frames;
+} callback_frames;
+
+void collect_frame(void *ctx, const uint8_t *payload, size_t payload_len,
+                   const quiet_decoder_frame_stats *stats) {
+    callback_frames *frames = ctx;
+    memcpy(frames->received + frames->received_len, payload, payload_len);
+    frames->received_len += payload_len;
+    frames->num_frames++;
+}
+
+// with a frame callback set, every frame goes to it in order and none
+//   reach the receive queue
+int test_frame_callback(unsigned int rate) {
+    quiet_encoder_options *encodeopt = load_encoder_opt("modem");
+    quiet_encoder *e = quiet_encoder_create(encodeopt, rate);
+    quiet_decoder_options *decodeopt = load_decoder_opt("modem");
+    quiet_decoder *d = quiet_decoder_create(decodeopt, rate);
+
+    size_t frame_len = quiet_encoder_get_frame_len(e);
+    size_t num_frames = 3;
+    uint8_t *payload = malloc(num_frames * frame_len);
+    fill_random(payload, num_frames * frame_len);
+    callback_frames frames = {
+        .received = malloc(num_frames * frame_len),
+        .received_len = 0,
+        .num_frames = 0,
+    };
+    quiet_decoder_set_frame_callback(d, collect_frame, &frames);
+
+    for (size_t i = 0; i < num_frames; i++) {
+        quiet_encoder_send(e, payload + i * frame_len, frame_len);
+    }
+    loopback(e, d);
+
+    int res = 0;
+    if (frames.num_frames != num_frames || frames.received_len != num_frames * frame_len ||
+        compare_chunk(payload, frames.received, frames.received_len)) {
+        printf("failed, callback received %zu frames of %zu bytes total\n",
+               frames.num_frames, frames.received_len);
+        res = 1;
+    }
+    res = res || recv_expect_none(d);
+
+    free(frames.received);
+    free(payload);
+    free(encodeopt);
+    free(decodeopt);
+    quiet_encoder_destroy(e);
+    quiet_decoder_destroy(d);
+    return res;
+}
+
+// send num_frames frames of frame_len from encoder_profile to
+//   decoder_profile, returning the payload sent and the decoder which
+//   received it
+uint8_t *send_frames(const char *encoder_profile, const char *decoder_profile,
+                     unsigned int rate, size_t num_frames, size_t *frame_len,
+                     size_t *encoder_dropped, quiet_decoder **d) {
+    quiet_encoder_options *encodeopt = load_encoder_opt(encoder_profile);
+    quiet_encoder *e = quiet_encoder_create(encodeopt, rate);
+    quiet_decoder_options *decodeopt = load_decoder_opt(decoder_profile);
+    *d = quiet_decoder_create(decodeopt, rate);
+
+    *frame_len = quiet_encoder_get_frame_len(e);
+    uint8_t *payload = malloc(num_frames * *frame_len);
+    fill_random(payload, num_frames * *frame_len);
+    for (size_t i = 0; i < num_frames; i++) {
+        quiet_encoder_send(e, payload + i * *frame_len, *frame_len);
+    }
+    if (encoder_dropped) {
+        *encoder_dropped = quiet_encoder_dropped_frames(e);
+        if (quiet_encoder_dropped_bytes(e) != *encoder_dropped * *frame_len) {
+            printf("failed, encoder dropped %zu frames but counted %zu bytes\n",
+                   *encoder_dropped, quiet_encoder_dropped_bytes(e));
+            *encoder_dropped = 0;
+        }
+    }
+    loopback(e, *d);
+
+    free(encodeopt);
+    free(decodeopt);
+    quiet_encoder_destroy(e);
+    return payload;
+}
+
+// drop_oldest keeps the newest frames at both ends, counting the rest
+int test_overflow(unsigned int rate) {
+    // the encoder's queue holds two frames
+    size_t num_frames = 5, frame_len, dropped;
+    quiet_decoder *d;
+    uint8_t *payload = send_frames("feature_overflow", "modem", rate, num_frames,
+                                   &frame_len, &dropped, &d);
+    int res = 0;
+    if (!dropped) {
+        printf("failed, encoder dropped no frames\n");
+        res = 1;
+    }
+    for (size_t i = dropped; i < num_frames; i++) {
+        res = res || recv_expect(d, payload + i * frame_len, frame_len);
+    }
+    res = res || recv_expect_none(d);
+    free(payload);
+    quiet_decoder_destroy(d);
+    if (res) {
+        return res;
+    }
+
+    // and so does the decoder's
+    num_frames = 3;
+    payload = send_frames("modem", "feature_overflow", rate, num_frames, &frame_len, NULL, &d);
+    if (quiet_decoder_dropped_frames(d) != 1 || quiet_decoder_dropped_bytes(d) != frame_len) {
+        printf("failed, decoder dropped %zu frames, %zu bytes\n",
+               quiet_decoder_dropped_frames(d), quiet_decoder_dropped_bytes(d));
+        res = 1;
+    }
+    for (size_t i = 1; i < num_frames; i++) {
+        res = res || recv_expect(d, payload + i * frame_len, frame_len);
+    }
+    res = res || recv_expect_none(d);
+    free(payload);
+    quiet_decoder_destroy(d);
+    return res;
+}
+
+// a frame queued at full length must still be sent after
+//   quiet_encoder_clamp_frame_len shrinks frame_len under it
+int test_mpsc_clamp(unsigned int rate) {
+    quiet_encoder_options *encodeopt = load_encoder_opt("modem");
+    encodeopt->multi_producer = true;
+    quiet_encoder *e = quiet_encoder_create(encodeopt, rate);
+    quiet_decoder_options *decodeopt = load_decoder_opt("modem");
+    quiet_decoder *d = quiet_decoder_create(decodeopt, rate);
+
+    size_t frame_len = quiet_encoder_get_frame_len(e);
+    uint8_t *payload = malloc(frame_len);
+    fill_random(payload, frame_len);
+    quiet_encoder_send(e, payload, frame_len);
+
+    quiet_encoder_clamp_frame_len(e, quiet_encoder_frame_airtime(e, frame_len) * rate / 2);
+    int res = 0;
+    if (quiet_encoder_get_frame_len(e) >= frame_len) {
+        printf("failed, clamp didn't shrink frame_len\n");
+        res = 1;
+    }
+
+    loopback(e, d);
+    res = res || recv_expect(d, payload, frame_len);
+
+    free(payload);
+    free(encodeopt);
+    free(decodeopt);
+    quiet_encoder_destroy(e);
+    quiet_decoder_destroy(d);
+    return res;
+}
+
+// emit everything queued in e, returning the samples in *samples
+size_t emit_all(quiet_encoder *e, quiet_sample_t **samples) {
+    size_t block_len = 16384;
+    size_t len = 0, cap = block_len;
+    quiet_sample_t *buf = malloc(cap * sizeof(quiet_sample_t));
+    for (;;) {
+        if (cap - len < block_len) {
+            cap *= 2;
+            buf = realloc(buf, cap * sizeof(quiet_sample_t));
+        }
+        ssize_t written = quiet_encoder_emit(e, buf + len, block_len);
+        if (written <= 0) {
+            break;
+        }
+        len += written;
+    }
+    *samples = buf;
+    return len;
+}
+
+// each frame is received once however many copies get through, and still
+//   received when one copy is lost
+int test_repeats(unsigned int rate) {
+    quiet_encoder_options *encodeopt = load_encoder_opt("feature_repeats");
+    quiet_encoder *e = quiet_encoder_create(encodeopt, rate);
+    quiet_decoder_options *decodeopt = load_decoder_opt("feature_repeats");
+    quiet_decoder *d = quiet_decoder_create(decodeopt, rate);
+
+    size_t frame_len = quiet_encoder_get_frame_len(e);
+    size_t num_frames = 3;
+    uint8_t *payload = malloc(num_frames * frame_len);
+    fill_random(payload, num_frames * frame_len);
+    for (size_t i = 0; i < num_frames; i++) {
+        quiet_encoder_send(e, payload + i * frame_len, frame_len);
+    }
+    loopback(e, d);
+    int res = 0;
+    for (size_t i = 0; i < num_frames; i++) {
+        res = res || recv_expect(d, payload + i * frame_len, frame_len);
+    }
+    res = res || recv_expect_none(d);
+
+    // the copies run back to back, so silencing the first quarter of the
+    //   burst loses the first copy and leaves the others whole
+    quiet_encoder_send(e, payload, frame_len);
+    quiet_sample_t *samples;
+    size_t samples_len = emit_all(e, &samples);
+    size_t start = 0, end = samples_len;
+    while (start < end && samples[start] == 0) {
+        start++;
+    }
+    while (end > start && samples[end - 1] == 0) {
+        end--;
+    }
+    memset(samples + start, 0, (end - start) / 4 * sizeof(quiet_sample_t));
+    quiet_decoder_consume(d, samples, samples_len);
+    finish_decoding(d);
+    res = res || recv_expect(d, payload, frame_len);
+    res = res || recv_expect_none(d);
+
+    free(samples);
+    free(payload);
+    free(encodeopt);
+    free(decodeopt);
+    quiet_encoder_destroy(e);
+    quiet_decoder_destroy(d);
+    return res;
+}
+
+// many short messages share each frame, and are received separately
+int test_aggregate(unsigned int rate) {
+    quiet_encoder_options *encodeopt = load_encoder_opt("feature_aggregate");
+    quiet_encoder *e = quiet_encoder_create(encodeopt, rate);
+    quiet_decoder_options *decodeopt = load_decoder_opt("feature_aggregate");
+    quiet_decoder *d = quiet_decoder_create(decodeopt, rate);
+    quiet_decoder_enable_stats(d);
+
+    size_t num_messages = 30, max_message_len = 40;
+    uint8_t *payload = malloc(num_messages * max_message_len);
+    fill_random(payload, num_messages * max_message_len);
+    size_t message_lens[30];
+    for (size_t i = 0; i < num_messages; i++) {
+        message_lens[i] = 1 + (size_t)rand() % max_message_len;
+        quiet_encoder_send(e, payload + i * max_message_len, message_lens[i]);
+    }
+    // closing the queue sends the last aggregate without lingering
+    quiet_encoder_close(e);
+
+    quiet_sample_t *samples;
+    size_t samples_len = emit_all(e, &samples);
+    size_t silence_len = 16384;
+    samples = realloc(samples, (samples_len + silence_len) * sizeof(quiet_sample_t));
+    memset(samples + samples_len, 0, silence_len * sizeof(quiet_sample_t));
+    quiet_decoder_consume(d, samples, samples_len + silence_len);
+
+    int res = 0;
+    // 30 messages of at most 42 bytes each, framing included, fit in 4
+    //   frames of 400
+    size_t num_frames;
+    quiet_decoder_consume_stats(d, &num_frames);
+    if (!num_frames || num_frames > 4) {
+        printf("failed, %zu messages took %zu frames\n", num_messages, num_frames);
+        res = 1;
+    }
+    for (size_t i = 0; i < num_messages; i++) {
+        res = res || recv_expect(d, payload + i * max_message_len, message_lens[i]);
+    }
+    res = res || recv_expect_none(d);
+
+    free(samples);
+    free(payload);
+    free(encodeopt);
+    free(decodeopt);
+    quiet_encoder_destroy(e);
+    quiet_decoder_destroy(d);
+    return res;
+}
+
+// a backed up queue goes out as one aggregate longer than frame_len,
+//   which the decoder splits back in to every message
+int test_burst(unsigned int rate) {
+    quiet_encoder_options *encodeopt = load_encoder_opt("feature_burst");
+    quiet_encoder *e = quiet_encoder_create(encodeopt, rate);
+    quiet_decoder_options *decodeopt = load_decoder_opt("feature_burst");
+    quiet_decoder *d = quiet_decoder_create(decodeopt, rate);
+    quiet_decoder_enable_stats(d);
+
+    // more than frame_len holds, but less than burst_frame_len
+    size_t num_messages = 40, message_len = 30;
+    uint8_t *payload = malloc(num_messages * message_len);
+    fill_random(payload, num_messages * message_len);
+    for (size_t i = 0; i < num_messages; i++) {
+        quiet_encoder_send(e, payload + i * message_len, message_len);
+    }
+
+    // consume everything at once, trailing silence included, so that the
+    //   stats cover every frame
+    quiet_sample_t *samples;
+    size_t samples_len = emit_all(e, &samples);
+    size_t silence_len = 16384;
+    samples = realloc(samples, (samples_len + silence_len) * sizeof(quiet_sample_t));
+    memset(samples + samples_len, 0, silence_len * sizeof(quiet_sample_t));
+    quiet_decoder_consume(d, samples, samples_len + silence_len);
+
+    int res = 0;
+    size_t num_frames;
+    quiet_decoder_consume_stats(d, &num_frames);
+    if (num_frames != 1) {
+        printf("failed, expected one burst frame, got %zu frames\n", num_frames);
+        res = 1;
+    }
+    for (size_t i = 0; i < num_messages; i++) {
+        res = res || recv_expect(d, payload + i * message_len, message_len);
+    }
+    res = res || recv_expect_none(d);
+
+    free(samples);
+    free(payload);
+    free(encodeopt);
+    free(decodeopt);
+    quiet_encoder_destroy(e);
+    quiet_decoder_destroy(d);
+    return res;
+}
+
+// the most urgent class goes first, and takes the place of a frame which
+//   was taken from its queue but hasn't started
+int test_priority(unsigned int rate) {
+    quiet_encoder_options *encodeopt = load_encoder_opt("feature_priority");
+    quiet_encoder *e = quiet_encoder_create(encodeopt, rate);
+    quiet_decoder_options *decodeopt = load_decoder_opt("feature_priority");
+    quiet_decoder *d = quiet_decoder_create(decodeopt, rate);
+
+    size_t frame_len = quiet_encoder_get_frame_len(e);
+    uint8_t *payload = malloc(3 * frame_len);
+    fill_random(payload, 3 * frame_len);
+    const uint8_t *bulk_a = payload, *bulk_b = payload + frame_len,
+                  *urgent = payload + 2 * frame_len;
+
+    quiet_encoder_send_priority(e, bulk_a, frame_len, 1);
+    quiet_encoder_send_priority(e, bulk_b, frame_len, 1);
+    quiet_encoder_send_priority(e, urgent, frame_len, 0);
+    loopback(e, d);
+    int res = 0;
+    res = res || recv_expect(d, urgent, frame_len);
+    res = res || recv_expect(d, bulk_a, frame_len);
+    res = res || recv_expect(d, bulk_b, frame_len);
+    res = res || recv_expect_none(d);
+
+    // with room for one and a half frames, low_latency sends the first
+    //   frame and defers the second, already taken, to the next block
+    quiet_encoder_send_priority(e, bulk_a, frame_len, 1);
+    quiet_encoder_send_priority(e, bulk_b, frame_len, 1);
+    size_t block_len = quiet_encoder_frame_airtime(e, frame_len) * rate * 3 / 2;
+    quiet_sample_t *samplebuf = malloc(block_len * sizeof(quiet_sample_t));
+    ssize_t written = quiet_encoder_emit(e, samplebuf, block_len);
+    if (written > 0) {
+        quiet_decoder_consume(d, samplebuf, written);
+    }
+    quiet_encoder_send_priority(e, urgent, frame_len, 0);
+    loopback(e, d);
+    res = res || recv_expect(d, bulk_a, frame_len);
+    res = res || recv_expect(d, urgent, frame_len);
+    res = res || recv_expect(d, bulk_b, frame_len);
+    res = res || recv_expect_none(d);
+
+    free(samplebuf);
+    free(payload);
+    free(encodeopt);
+    free(decodeopt);
+    quiet_encoder_destroy(e);
+    quiet_decoder_destroy(d);
+    return res;
+}
+
+// frames whose time to live has passed are dropped, whether they are
+//   still queued or waiting in an aggregate, and the others still go out
+int test_ttl(unsigned int rate) {
+    quiet_encoder_options *encodeopt = load_encoder_opt("modem");
+    quiet_encoder *e = quiet_encoder_create(encodeopt, rate);
+    quiet_decoder_options *decodeopt = load_decoder_opt("modem");
+    quiet_decoder *d = quiet_decoder_create(decodeopt, rate);
+
+    size_t frame_len = quiet_encoder_get_frame_len(e);
+    uint8_t *payload = malloc(3 * frame_len);
+    fill_random(payload, 3 * frame_len);
+    quiet_encoder_send(e, payload, frame_len);
+    quiet_encoder_send_ttl(e, payload + frame_len, frame_len, 0, 0);
+    quiet_encoder_send_ttl(e, payload + 2 * frame_len, frame_len, 60, 0);
+    loopback(e, d);
+    int res = 0;
+    if (quiet_encoder_expired_frames(e) != 1) {
+        printf("failed, expected 1 expired frame, got %zu\n", quiet_encoder_expired_frames(e));
+        res = 1;
+    }
+    res = res || recv_expect(d, payload, frame_len);
+    res = res || recv_expect(d, payload + 2 * frame_len, frame_len);
+    res = res || recv_expect_none(d);
+    free(encodeopt);
+    free(decodeopt);
+    quiet_encoder_destroy(e);
+    quiet_decoder_destroy(d);
+
+    // the first message expires while its aggregate lingers for more
+    encodeopt = load_encoder_opt("feature_aggregate");
+    e = quiet_encoder_create(encodeopt, rate);
+    decodeopt = load_decoder_opt("feature_aggregate");
+    d = quiet_decoder_create(decodeopt, rate);
+    size_t message_len = 20;
+    quiet_encoder_send_ttl(e, payload, message_len, 0, 20000000);
+    quiet_encoder_send(e, payload + message_len, message_len);
+    quiet_sample_t samplebuf[256];
+    quiet_encoder_emit(e, samplebuf, sizeof(samplebuf)/sizeof(quiet_sample_t));
+    struct timespec linger = { .tv_sec = 0, .tv_nsec = 150000000 };
+    nanosleep(&linger, NULL);
+    loopback(e, d);
+    if (quiet_encoder_expired_frames(e) != 1) {
+        printf("failed, expected 1 expired message, got %zu\n", quiet_encoder_expired_frames(e));
+        res = 1;
+    }
+    res = res || recv_expect(d, payload + message_len, message_len);
+    res = res || recv_expect_none(d);
+
+    free(payload);
+    free(encodeopt);
+    free(decodeopt);
+    quiet_encoder_destroy(e);
+    quiet_decoder_destroy(d);
+    return res;
+}
+
+// the queue reports what is waiting and roughly how long it takes to
+//   send, and a purge leaves only frames sent after it
+int test_queue_introspection(unsigned int rate) {
+    quiet_encoder_options *encodeopt = load_encoder_opt("modem");
+    quiet_encoder *e = quiet_encoder_create(encodeopt, rate);
+    quiet_decoder_options *decodeopt = load_decoder_opt("modem");
+    quiet_decoder *d = quiet_decoder_create(decodeopt, rate);
+
+    size_t frame_len = quiet_encoder_get_frame_len(e);
+    size_t num_frames = 3;
+    uint8_t *payload = malloc(num_frames * frame_len);
+    fill_random(payload, num_frames * frame_len);
+    for (size_t i = 0; i < num_frames; i++) {
+        quiet_encoder_send(e, payload + i * frame_len, frame_len);
+    }
+
+    int res = 0;
+    if (quiet_encoder_queued_frames(e) != num_frames ||
+        quiet_encoder_queued_bytes(e) != num_frames * frame_len) {
+        printf("failed, queue reports %zu frames, %zu bytes\n",
+               quiet_encoder_queued_frames(e), quiet_encoder_queued_bytes(e));
+        res = 1;
+    }
+    // the drain estimate comes from a fitted model, so allow some slack
+    float airtime = num_frames * quiet_encoder_frame_airtime(e, frame_len);
+    float drain_time = quiet_encoder_estimated_drain_time(e);
+    if (drain_time < 0.75f * airtime || drain_time > 1.25f * airtime) {
+        printf("failed, estimated drain time %f for %f of airtime\n", drain_time, airtime);
+        res = 1;
+    }
+    if (quiet_encoder_purge(e) != num_frames || quiet_encoder_queued_frames(e) ||
+        quiet_encoder_queued_bytes(e)) {
+        printf("failed, purge left %zu frames queued\n", quiet_encoder_queued_frames(e));
+        res = 1;
+    }
+
+    quiet_encoder_send(e, payload, frame_len);
+    loopback(e, d);
+    res = res || recv_expect(d, payload, frame_len);
+    res = res || recv_expect_none(d);
+
+    free(payload);
+    free(encodeopt);
+    free(decodeopt);
+    quiet_encoder_destroy(e);
+    quiet_decoder_destroy(d);
+    return res;
+}
+
+// with room for one and a half frames per block, each block carries one
+//   whole frame and ends in silence, and the encoder holds no more than
+//   the next frame in between
+int test_low_latency(unsigned int rate) {
+    quiet_encoder_options *encodeopt = load_encoder_opt("feature_low_latency");
+    quiet_encoder *e = quiet_encoder_create(encodeopt, rate);
+    quiet_decoder_options *decodeopt = load_decoder_opt("feature_low_latency");
+    quiet_decoder *d = quiet_decoder_create(decodeopt, rate);
+
+    size_t frame_len = quiet_encoder_get_frame_len(e);
+    size_t num_frames = 3;
+    uint8_t *payload = malloc(num_frames * frame_len);
+    fill_random(payload, num_frames * frame_len);
+    for (size_t i = 0; i < num_frames; i++) {
+        quiet_encoder_send(e, payload + i * frame_len, frame_len);
+    }
+
+    size_t block_len = quiet_encoder_frame_airtime(e, frame_len) * rate * 3 / 2;
+    quiet_sample_t *samplebuf = malloc(block_len * sizeof(quiet_sample_t));
+    int res = 0;
+    for (size_t i = 0; i < num_frames && !res; i++) {
+        ssize_t written = quiet_encoder_emit(e, samplebuf, block_len);
+        bool is_last = (i == num_frames - 1);
+        // only the last block, with nothing deferred to follow it, may end
+        //   early
+        if (written <= 0 || (!is_last && (size_t)written != block_len)) {
+            printf("failed, block %zu was %zd samples of %zu\n", i, written, block_len);
+            res = 1;
+            break;
+        }
+        if (!is_last && (!quiet_encoder_pending_samples(e) ||
+                         quiet_encoder_pending_samples(e) > block_len)) {
+            printf("failed, %zu samples pending after block %zu\n",
+                   quiet_encoder_pending_samples(e), i);
+            res = 1;
+        }
+        // the frame is whole within its block and followed by silence, so
+        //   it decodes without the next one
+        quiet_decoder_consume(d, samplebuf, written);
+        if (!is_last) {
+            res = res || recv_expect(d, payload + i * frame_len, frame_len);
+        }
+    }
+    if (!res && quiet_encoder_pending_samples(e)) {
+        printf("failed, %zu samples pending once the queue is empty\n",
+               quiet_encoder_pending_samples(e));
+        res = 1;
+    }
+    loopback(e, d);
+    res = res || recv_expect(d, payload + (num_frames - 1) * frame_len, frame_len);
+    res = res || recv_expect_none(d);
+
+    free(samplebuf);
+    free(payload);
+    free(encodeopt);
+    free(decodeopt);
+    quiet_encoder_destroy(e);
+    quiet_decoder_destroy(d);
+    return res;
+}
+
+// a payload replayed from the cache sounds the same as one rendered again
+int test_waveform_cache(unsigned int rate) {
+    quiet_encoder_options *cachedopt = load_encoder_opt("feature_waveform_cache");
+    quiet_encoder *cached = quiet_encoder_create(cachedopt, rate);
+    quiet_encoder_options *renderedopt = load_encoder_opt("modem");
+    quiet_encoder *rendered = quiet_encoder_create(renderedopt, rate);
+    quiet_decoder_options *decodeopt = load_decoder_opt("modem");
+    quiet_decoder *d = quiet_decoder_create(decodeopt, rate);
+
+    size_t frame_len = quiet_encoder_get_frame_len(cached);
+    uint8_t *payload = malloc(frame_len);
+    fill_random(payload, frame_len);
+
+    int res = 0;
+    // the first round records the frame, and the second replays it
+    for (size_t round = 0; round < 2 && !res; round++) {
+        quiet_encoder_send(cached, payload, frame_len);
+        quiet_encoder_send(rendered, payload, frame_len);
+        quiet_sample_t *cached_samples, *rendered_samples;
+        size_t cached_len = emit_all(cached, &cached_samples);
+        size_t rendered_len = emit_all(rendered, &rendered_samples);
+        if (cached_len != rendered_len) {
+            printf("failed, round %zu emitted %zu samples, %zu without the cache\n", round,
+                   cached_len, rendered_len);
+            res = 1;
+        }
+        for (size_t i = 0; i < cached_len && !res; i++) {
+            if (fabsf(cached_samples[i] - rendered_samples[i]) > 1e-6f) {
+                printf("failed, round %zu differs from rendering at sample %zu\n", round, i);
+                res = 1;
+            }
+        }
+        quiet_decoder_consume(d, cached_samples, cached_len);
+        finish_decoding(d);
+        res = res || recv_expect(d, payload, frame_len);
+        free(cached_samples);
+        free(rendered_samples);
+    }
+    res = res || recv_expect_none(d);
+
+    free(payload);
+    free(cachedopt);
+    free(renderedopt);
+    free(decodeopt);
+    quiet_encoder_destroy(cached);
+    quiet_encoder_destroy(rendered);
+    quiet_decoder_destroy(d);
+    return res;
+}
+
+// receive one message from d and check that it is message
+int recv_message_expect(quiet_decoder *d, const uint8_t *message, size_t message_len) {
+    uint8_t buf[1 << 14];
+    ssize_t read = quiet_decoder_recv_message(d, buf, sizeof(buf));
+    if (read < 0) {
+        printf("failed, expected a message of %zu bytes, got none\n", message_len);
+        return 1;
+    }
+    if ((size_t)read != message_len || compare_chunk(message, buf, message_len)) {
+        printf("failed, expected a message of %zu bytes, got a different one of %zd bytes\n",
+               message_len, read);
+        return 1;
+    }
+    return 0;
+}
+
+// messages longer than a frame are split and put back together, and a
+//   frame which isn't a segment is counted as a dropped message
+int test_segmentation(unsigned int rate) {
+    quiet_encoder_options *encodeopt = load_encoder_opt("modem");
+    quiet_encoder *e = quiet_encoder_create(encodeopt, rate);
+    quiet_decoder_options *decodeopt = load_decoder_opt("modem");
+    quiet_decoder *d = quiet_decoder_create(decodeopt, rate);
+
+    size_t long_len = 3000, short_len = 100;
+    uint8_t *payload = malloc(long_len + short_len);
+    fill_random(payload, long_len + short_len);
+    int res = 0;
+    if (quiet_encoder_send_message(e, payload, long_len) != (ssize_t)long_len) {
+        printf("failed, couldn't send a message of %zu bytes\n", long_len);
+        res = 1;
+    }
+    quiet_encoder_send(e, payload, short_len);
+    quiet_encoder_send_message(e, payload + long_len, short_len);
+    loopback(e, d);
+
+    res = res || recv_message_expect(d, payload, long_len);
+    res = res || recv_message_expect(d, payload + long_len, short_len);
+    uint8_t buf[1 << 14];
+    if (!res && quiet_decoder_recv_message(d, buf, sizeof(buf)) >= 0) {
+        printf("failed, received an unexpected message\n");
+        res = 1;
+    }
+    if (!res && quiet_decoder_dropped_messages(d) != 1) {
+        printf("failed, expected 1 dropped message, got %zu\n",
+               quiet_decoder_dropped_messages(d));
+        res = 1;
+    }
+
+    free(payload);
+    free(encodeopt);
+    free(decodeopt);
+    quiet_encoder_destroy(e);
+    quiet_decoder_destroy(d);
+    return res;
+}
+
+// a message sent with parity survives the loss of one of its frames
+int test_parity(unsigned int rate) {
+    quiet_encoder_options *encodeopt = load_encoder_opt("feature_parity");
+    quiet_encoder *e = quiet_encoder_create(encodeopt, rate);
+    quiet_decoder_options *decodeopt = load_decoder_opt("feature_parity");
+    quiet_decoder *d = quiet_decoder_create(decodeopt, rate);
+
+    // 6 segments in 400 byte frames, and 3 more of parity
+    size_t message_len = 2000;
+    uint8_t *payload = malloc(message_len);
+    fill_random(payload, message_len);
+    quiet_encoder_send_message(e, payload, message_len);
+
+    // with low_latency and room for one and a half frames, each block
+    //   starts with a frame, so the second block holds the second segment
+    //   and silencing it loses that segment alone
+    size_t frame_len = quiet_encoder_get_frame_len(e);
+    size_t block_len = quiet_encoder_frame_airtime(e, frame_len) * rate * 3 / 2;
+    quiet_sample_t *samplebuf = malloc(block_len * sizeof(quiet_sample_t));
+    for (size_t i = 0;; i++) {
+        ssize_t written = quiet_encoder_emit(e, samplebuf, block_len);
+        if (written <= 0) {
+            break;
+        }
+        if (i == 1) {
+            memset(samplebuf, 0, written * sizeof(quiet_sample_t));
+        }
+        quiet_decoder_consume(d, samplebuf, written);
+    }
+    finish_decoding(d);
+
+    int res = 0;
+    res = res || recv_message_expect(d, payload, message_len);
+    if (!res && quiet_decoder_dropped_messages(d)) {
+        printf("failed, %zu messages dropped\n", quiet_decoder_dropped_messages(d));
+        res = 1;
+    }
+
+    free(samplebuf);
+    free(payload);
+    free(encodeopt);
+    free(decodeopt);
+    quiet_encoder_destroy(e);
+    quiet_decoder_destroy(d);
+    return res;
+}
+
+// compressible messages take less airtime, and every message comes back
+//   as it was sent
+int test_compress(unsigned int rate) {
+    static const char dictionary[] = "{\"sensor\": \"temperature\", \"unit\": \"celsius\", ";
+    quiet_encoder_options *encodeopt = load_encoder_opt("feature_compress");
+    encodeopt->compression_dictionary = (const uint8_t *)dictionary;
+    encodeopt->compression_dictionary_len = strlen(dictionary);
+    quiet_encoder *e = quiet_encoder_create(encodeopt, rate);
+    quiet_decoder_options *decodeopt = load_decoder_opt("feature_compress");
+    decodeopt->compression_dictionary = (const uint8_t *)dictionary;
+    decodeopt->compression_dictionary_len = strlen(dictionary);
+    quiet_decoder *d = quiet_decoder_create(decodeopt, rate);
+
+    size_t message_len = 300;
+    uint8_t *repetitive = malloc(message_len);
+    for (size_t i = 0; i < message_len; i++) {
+        repetitive[i] = "abcd"[i % 4];
+    }
+    uint8_t *random = malloc(message_len);
+    fill_random(random, message_len);
+    const char *short_message = "{\"sensor\": \"temperature\", \"unit\": \"celsius\", \"value\": 21}";
+    size_t short_len = strlen(short_message);
+
+    // each message is paired with a random one of the same length, which
+    //   doesn't compress
+    const uint8_t *messages[] = { repetitive, random, (const uint8_t *)short_message, random };
+    size_t message_lens[] = { message_len, message_len, short_len, short_len };
+    size_t samples_lens[4];
+    int res = 0;
+    for (size_t i = 0; i < 4; i++) {
+        quiet_encoder_send(e, messages[i], message_lens[i]);
+        quiet_sample_t *samples;
+        samples_lens[i] = emit_all(e, &samples);
+        quiet_decoder_consume(d, samples, samples_lens[i]);
+        finish_decoding(d);
+        free(samples);
+        res = res || recv_expect(d, messages[i], message_lens[i]);
+    }
+    res = res || recv_expect_none(d);
+    if (!res && samples_lens[0] >= samples_lens[1]) {
+        printf("failed, a repetitive message took %zu samples, a random one %zu\n",
+               samples_lens[0], samples_lens[1]);
+        res = 1;
+    }
+    // mostly made of the dictionary, so it shrinks despite being short
+    if (!res && samples_lens[2] >= samples_lens[3]) {
+        printf("failed, a message much like the dictionary took %zu samples, a random one %zu\n",
+               samples_lens[2], samples_lens[3]);
+        res = 1;
+    }
+
+    free(repetitive);
+    free(random);
+    free(encodeopt);
+    free(decodeopt);
+    quiet_encoder_destroy(e);
+    quiet_decoder_destroy(d);
+    return res;
+}
+
+// emit one frame of payload from e in to d, returning its length in samples
+size_t emit_frame(quiet_encoder *e, quiet_decoder *d, const uint8_t *payload,
+                  size_t payload_len) {
+    quiet_encoder_send(e, payload, payload_len);
+    quiet_sample_t *samples;
+    size_t samples_len = emit_all(e, &samples);
+    quiet_decoder_consume(d, samples, samples_len);
+    finish_decoding(d);
+    free(samples);
+    return samples_len;
+}
+
+// good reports move the encoder to its faster level, which the decoder
+//   follows on its own, and a failed frame moves it back
+int test_adaptation(unsigned int rate) {
+    quiet_encoder_options *encodeopt = load_encoder_opt("feature_adaptation");
+    quiet_encoder *fixed = quiet_encoder_create(encodeopt, rate);
+    quiet_adaptation_level fast = {
+        .checksum_scheme = quiet_checksum_crc32,
+        .inner_fec_scheme = quiet_error_correction_conv_perf_23_7,
+        .outer_fec_scheme = quiet_error_correction_reed_solomon_223_255,
+        .mod_scheme = quiet_modulation_qask256,
+        .max_error_vector_magnitude = -20,
+    };
+    encodeopt->adaptation_levels = &fast;
+    encodeopt->num_adaptation_levels = 1;
+    quiet_encoder *e = quiet_encoder_create(encodeopt, rate);
+    quiet_decoder_options *decodeopt = load_decoder_opt("feature_adaptation");
+    quiet_decoder *d = quiet_decoder_create(decodeopt, rate);
+
+    size_t frame_len = quiet_encoder_get_frame_len(e);
+    uint8_t *payload = malloc(frame_len);
+    fill_random(payload, frame_len);
+
+    int res = 0;
+    // the encoder's own schemes are the slowest, so they set the airtime
+    if (quiet_encoder_frame_airtime(e, frame_len) != quiet_encoder_frame_airtime(fixed, frame_len)) {
+        printf("failed, airtime %f with levels, %f without\n",
+               quiet_encoder_frame_airtime(e, frame_len),
+               quiet_encoder_frame_airtime(fixed, frame_len));
+        res = 1;
+    }
+
+    size_t slow_len = emit_frame(e, d, payload, frame_len);
+    res = res || recv_expect(d, payload, frame_len);
+
+    quiet_decoder_frame_stats report;
+    memset(&report, 0, sizeof(report));
+    report.error_vector_magnitude = -30;
+    report.checksum_passed = true;
+    for (size_t i = 0; i < 8; i++) {
+        quiet_encoder_report_frame_stats(e, &report);
+    }
+    if (!res && quiet_encoder_adaptation_level(e) != 1) {
+        printf("failed, still at level %zu after good reports\n", quiet_encoder_adaptation_level(e));
+        res = 1;
+    }
+    size_t fast_len = emit_frame(e, d, payload, frame_len);
+    res = res || recv_expect(d, payload, frame_len);
+    if (!res && fast_len >= slow_len) {
+        printf("failed, the faster level took %zu samples, the slower %zu\n", fast_len, slow_len);
+        res = 1;
+    }
+
+    report.checksum_passed = false;
+    quiet_encoder_report_frame_stats(e, &report);
+    if (!res && quiet_encoder_adaptation_level(e) != 0) {
+        printf("failed, still at level %zu after a failed frame\n",
+               quiet_encoder_adaptation_level(e));
+        res = 1;
+    }
+
+    free(payload);
+    free(encodeopt);
+    free(decodeopt);
+    quiet_encoder_destroy(fixed);
+    quiet_encoder_destroy(e);
+    quiet_decoder_destroy(d);
+    return res;
+}
+
+// emit one block from e in to block, filling with silence if e has
+//   nothing to send, and return whether any of it is sound
+bool emit_block(quiet_encoder *e, quiet_sample_t *block, size_t block_len) {
+    ssize_t written = quiet_encoder_emit(e, block, block_len);
+    if (written < 0) {
+        written = 0;
+    }
+    memset(block + written, 0, (block_len - written) * sizeof(quiet_sample_t));
+    for (size_t i = 0; i < block_len; i++) {
+        if (block[i] != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// an encoder with carrier sense waits for another node's burst to end
+//   before it starts its own
+int test_csma(unsigned int rate) {
+    quiet_encoder_options *otheropt = load_encoder_opt("modem");
+    quiet_encoder *other = quiet_encoder_create(otheropt, rate);
+    quiet_encoder_options *encodeopt = load_encoder_opt("feature_csma");
+    quiet_encoder *e = quiet_encoder_create(encodeopt, rate);
+    quiet_decoder_options *listenopt = load_decoder_opt("feature_csma");
+    quiet_decoder *listener = quiet_decoder_create(listenopt, rate);
+    quiet_encoder_set_carrier_sense(e, listener);
+    quiet_decoder_options *decodeopt = load_decoder_opt("modem");
+    quiet_decoder *d = quiet_decoder_create(decodeopt, rate);
+
+    size_t frame_len = quiet_encoder_get_frame_len(e);
+    size_t num_frames = 4;
+    uint8_t *payload = malloc(num_frames * frame_len);
+    fill_random(payload, num_frames * frame_len);
+    for (size_t i = 0; i < num_frames - 1; i++) {
+        quiet_encoder_send(other, payload + i * frame_len, frame_len);
+    }
+
+    size_t block_len = 1024;
+    quiet_sample_t *other_block = malloc(block_len * sizeof(quiet_sample_t));
+    quiet_sample_t *block = malloc(block_len * sizeof(quiet_sample_t));
+    int res = 0;
+    // channel time is bounded, as the backoffs are random
+    bool is_active = true;
+    for (size_t i = 0; i < 4000 && is_active; i++) {
+        bool other_sounds = emit_block(other, other_block, block_len);
+        bool sounds = emit_block(e, block, block_len);
+        if (other_sounds && sounds && !res) {
+            printf("failed, transmitted over another node in block %zu\n", i);
+            res = 1;
+        }
+        for (size_t j = 0; j < block_len; j++) {
+            block[j] += other_block[j];
+        }
+        quiet_decoder_consume(listener, block, block_len);
+        quiet_decoder_consume(d, block, block_len);
+        if (i == 0) {
+            // the other node has the channel by now
+            quiet_encoder_send(e, payload + (num_frames - 1) * frame_len, frame_len);
+        }
+        is_active = other_sounds || sounds || quiet_encoder_queued_frames(e) ||
+                    quiet_encoder_queued_frames(other);
+    }
+    finish_decoding(d);
+
+    if (!res && !quiet_encoder_backoffs(e)) {
+        printf("failed, never backed off\n");
+        res = 1;
+    }
+    for (size_t i = 0; i < num_frames; i++) {
+        res = res || recv_expect(d, payload + i * frame_len, frame_len);
+    }
+    res = res || recv_expect_none(d);
+
+    free(block);
+    free(other_block);
+    free(payload);
+    free(otheropt);
+    free(encodeopt);
+    free(listenopt);
+    free(decodeopt);
+    quiet_encoder_destroy(other);
+    quiet_encoder_destroy(e);
+    quiet_decoder_destroy(listener);
+    quiet_decoder_destroy(d);
+    return res;
+}
+
+// two encoders which own alternate slots share a channel without
+//   overlapping, and everything they send is received
+int test_tdma(unsigned int rate) {
+    const char *profiles[] = { "feature_tdma_a", "feature_tdma_b" };
+    quiet_encoder_options *encodeopts[2];
+    quiet_encoder *encoders[2];
+    for (size_t n = 0; n < 2; n++) {
+        encodeopts[n] = load_encoder_opt(profiles[n]);
+        encoders[n] = quiet_encoder_create(encodeopts[n], rate);
+    }
+    quiet_decoder_options *decodeopt = load_decoder_opt("modem");
+    quiet_decoder *d = quiet_decoder_create(decodeopt, rate);
+
+    size_t frame_len = quiet_encoder_get_frame_len(encoders[0]);
+    size_t slot_len = quiet_encoder_tdma_slot_len(encoders[0]);
+    int res = 0;
+    if (!slot_len || quiet_encoder_tdma_slot_len(encoders[1]) != slot_len) {
+        printf("failed, slot lengths %zu and %zu\n", slot_len,
+               quiet_encoder_tdma_slot_len(encoders[1]));
+        res = 1;
+    }
+
+    // each node sends two frames, then closes so that emit ends once
+    //   they are out rather than waiting for more
+    size_t frames_per_node = 2;
+    uint8_t *payload = malloc(2 * frames_per_node * frame_len);
+    fill_random(payload, 2 * frames_per_node * frame_len);
+    for (size_t n = 0; n < 2; n++) {
+        for (size_t i = 0; i < frames_per_node; i++) {
+            quiet_encoder_send(encoders[n], payload + (n * frames_per_node + i) * frame_len,
+                               frame_len);
+        }
+        quiet_encoder_close(encoders[n]);
+    }
+
+    size_t block_len = 1024;
+    quiet_sample_t *blocks[2], *channel = malloc(block_len * sizeof(quiet_sample_t));
+    for (size_t n = 0; n < 2; n++) {
+        blocks[n] = malloc(block_len * sizeof(quiet_sample_t));
+    }
+    uint64_t now = 0;
+    bool is_done[2] = { false, false };
+    for (size_t i = 0; i < 4000 && !(is_done[0] && is_done[1]) && !res; i++) {
+        memset(channel, 0, block_len * sizeof(quiet_sample_t));
+        for (size_t n = 0; n < 2; n++) {
+            ssize_t written = is_done[n] ? 0 : quiet_encoder_emit(encoders[n], blocks[n], block_len);
+            if (written <= 0) {
+                is_done[n] = (written == 0);
+                written = 0;
+            }
+            for (size_t j = 0; j < (size_t)written; j++) {
+                // node n owns slot n of each cycle of two
+                size_t slot = ((now + j) / slot_len) % 2;
+                if (blocks[n][j] != 0 && slot != n && !res) {
+                    printf("failed, node %zu transmitted in slot %zu at sample %zu\n", n,
+                           slot, (size_t)(now + j));
+                    res = 1;
+                }
+                channel[j] += blocks[n][j];
+            }
+        }
+        quiet_decoder_consume(d, channel, block_len);
+        now += block_len;
+    }
+    finish_decoding(d);
+
+    for (size_t n = 0; n < 2; n++) {
+        if (!res && !(quiet_encoder_tdma_utilization(encoders[n]) > 0)) {
+            printf("failed, node %zu reports no slot utilization\n", n);
+            res = 1;
+        }
+    }
+    // a slot only fits one frame, so the nodes take turns, node 0 first
+    for (size_t i = 0; i < frames_per_node; i++) {
+        for (size_t n = 0; n < 2; n++) {
+            res = res || recv_expect(d, payload + (n * frames_per_node + i) * frame_len,
+                                     frame_len);
+        }
+    }
+    res = res || recv_expect_none(d);
+
+    for (size_t n = 0; n < 2; n++) {
+        free(blocks[n]);
+        free(encodeopts[n]);
+        quiet_encoder_destroy(encoders[n]);
+    }
+    free(channel);
+    free(payload);
+    free(decodeopt);
+    quiet_decoder_destroy(d);
+    return res;
+}
+
+typedef struct {
+    const char *name;
+    int (*test)(unsigned int rate);
+} feature_test;
+
+int test_features(unsigned int rate) {
+    const feature_test tests[] = {
+        { "frame callback", test_frame_callback },
+        { "overflow", test_overflow },
+        { "mpsc clamp", test_mpsc_clamp },
+        { "priority", test_priority },
+        { "ttl", test_ttl },
+        { "queue introspection", test_queue_introspection },
+        { "low latency", test_low_latency },
+        { "waveform cache", test_waveform_cache },
+        { "repeats", test_repeats },
+        { "aggregate", test_aggregate },
+        { "burst", test_burst },
+        { "segmentation", test_segmentation },
+        { "parity", test_parity },
+        { "compress", test_compress },
+        { "adaptation", test_adaptation },
+        { "csma", test_csma },
+        { "tdma", test_tdma },
+    };
+    size_t tests_len = sizeof(tests)/sizeof(feature_test);
+    for (size_t i = 0; i < tests_len; i++) {
+        printf("  feature=%s... ", tests[i].name);
+        if (tests[i].test(rate)) {
+            printf("FAILED\n");
+            return -1;
+        }
+        printf("PASSED\n");
+    }
+    return 0;
+}
+
 int test_profile(unsigned int encode_rate, unsigned int decode_rate, const char *profile) {
     size_t payload_lens[] = { 1, 2, 4, 12, 320, 399, 400, 797, 798, 799, 800, 1023 };
     size_t payload_lens_len = sizeof(payload_lens)/sizeof(size_t);
@@ -142,6 +1263,12 @@ int test_sample_rate_pair(unsigned int encode_rate, unsigned int decode_rate) {
     char **profiles = quiet_profile_keys_file(profiles_f, &num_profiles);
     for (size_t i = 0; i < num_profiles; i++) {
         const char *profile = profiles[i];
+        // feature_ profiles each set up one option for test_features rather
+        //   than the payload sweep
+        if (!strncmp(profile, "feature_", strlen("feature_"))) {
+            free(profiles[i]);
+            continue;
+        }
         printf("  profile=%s\n", profile);
         if (test_profile(encode_rate, decode_rate, profile)) {
             return -1;
@@ -165,6 +1292,9 @@ int main(int argc, char **argv) {
         if (test_sample_rate_pair(encode_rate, decode_rate)) {
             return 1;
         }
+        if (encode_rate == decode_rate && test_features(encode_rate)) {
+            return 1;
+        }
     }
 
     fclose(profiles_f);
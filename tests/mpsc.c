@@ -0,0 +1,123 @@
+#include "quiet/mpsc.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+#include <sched.h>
+
+#define NUM_PRODUCERS 4
+
+typedef struct {
+    mpsc_queue *q;
+    uint32_t id;
+    size_t num_frames;
+} arg_t;
+
+// each frame carries its producer's id and a per-producer sequence number,
+//   padded out to a length derived from the sequence number
+void *produce(void *arg_void) {
+    arg_t *arg = (arg_t*)arg_void;
+    uint8_t frame[64] = { 0 };
+    for (uint32_t seq = 0; seq < arg->num_frames; ) {
+        memcpy(frame, &arg->id, sizeof(uint32_t));
+        memcpy(frame + sizeof(uint32_t), &seq, sizeof(uint32_t));
+        size_t len = 2 * sizeof(uint32_t) + seq % (sizeof(frame) - 2 * sizeof(uint32_t));
+        ssize_t res = mpsc_enqueue(arg->q, frame, len, 0);
+        if (res == 1) {
+            seq++;
+        } else if (res == RingErrorWouldBlock) {
+            sched_yield();
+        } else {
+            printf("enqueue failed: %zd\n", res);
+            break;
+        }
+    }
+    return NULL;
+}
+
+int test_producers() {
+    mpsc_queue *q = mpsc_create(64, 64);
+    size_t num_frames = 1 << 18;
+    arg_t args[NUM_PRODUCERS];
+    pthread_t producers[NUM_PRODUCERS];
+    for (uint32_t i = 0; i < NUM_PRODUCERS; i++) {
+        args[i].q = q;
+        args[i].id = i;
+        args[i].num_frames = num_frames;
+        pthread_create(&producers[i], NULL, produce, &args[i]);
+    }
+
+    // frames from any one producer must arrive in the order it sent them
+    uint32_t next[NUM_PRODUCERS] = { 0 };
+    uint8_t frame[64];
+    int res = 0;
+    for (size_t i = 0; i < NUM_PRODUCERS * num_frames; ) {
+        size_t len;
+        uint64_t deadline;
+        ssize_t nread = mpsc_dequeue(q, frame, sizeof(frame), &len, &deadline);
+        if (nread == RingErrorWouldBlock) {
+            sched_yield();
+            continue;
+        }
+        if (nread != 1) {
+            printf("dequeue failed: %zd\n", nread);
+            res = 1;
+            break;
+        }
+        uint32_t id, seq;
+        memcpy(&id, frame, sizeof(uint32_t));
+        memcpy(&seq, frame + sizeof(uint32_t), sizeof(uint32_t));
+        size_t expected_len = 2 * sizeof(uint32_t) + seq % (sizeof(frame) - 2 * sizeof(uint32_t));
+        if (id >= NUM_PRODUCERS || seq != next[id] || len != expected_len) {
+            printf("mismatch at %zu: producer %u sent %u (len %zu), expected %u\n",
+                   i, id, seq, len, next[id]);
+            res = 1;
+            break;
+        }
+        next[id]++;
+        i++;
+    }
+
+    for (size_t i = 0; i < NUM_PRODUCERS; i++) {
+        pthread_join(producers[i], NULL);
+    }
+    mpsc_destroy(q);
+    return res;
+}
+
+int test_full_and_close() {
+    mpsc_queue *q = mpsc_create(4, 8);
+    uint8_t frame[8] = { 0 };
+    int res = 0;
+
+    for (size_t i = 0; i < q->num_slots; i++) {
+        res |= (mpsc_enqueue(q, frame, sizeof(frame), 0) != 1);
+    }
+    res |= (mpsc_enqueue(q, frame, sizeof(frame), 0) != RingErrorWouldBlock);
+    res |= (mpsc_enqueue(q, frame, sizeof(frame) + 1, 0) != RingErrorIO);
+
+    // frames queued before the close are still delivered
+    mpsc_close(q);
+    res |= (mpsc_enqueue(q, frame, sizeof(frame), 0) != 0);
+    size_t len;
+    uint64_t deadline;
+    for (size_t i = 0; i < q->num_slots; i++) {
+        res |= (mpsc_dequeue(q, frame, sizeof(frame), &len, &deadline) != 1);
+    }
+    res |= (mpsc_dequeue(q, frame, sizeof(frame), &len, &deadline) != 0);
+
+    mpsc_destroy(q);
+    return res;
+}
+
+int main() {
+    int res = test_producers();
+    printf("%d producer, single consumer test passed: %s\n", NUM_PRODUCERS, res ? "FALSE" : "TRUE");
+
+    int full_res = test_full_and_close();
+    printf("full and close test passed: %s\n", full_res ? "FALSE" : "TRUE");
+    res = res ? res : full_res;
+
+    return res;
+}
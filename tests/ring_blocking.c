@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <pthread.h>
 #include <time.h>
+#include <poll.h>
 
 typedef struct {
     ring *buf;
@@ -102,6 +103,43 @@ void *read_sequence(void *arg_void) {
     return NULL;
 }
 
+bool fd_is_readable(int fd) {
+    struct pollfd p = { .fd = fd, .events = POLLIN };
+    return poll(&p, 1, 0) == 1 && (p.revents & POLLIN);
+}
+
+int test_notify_fd() {
+    ring *buf = ring_create(64);
+    uint8_t temp[48] = { 0 };
+    int res = 0;
+
+    ring_reader_lock(buf);
+    int rfd = ring_get_reader_fd(buf);
+    // rings may round their length up, so pick a threshold that one
+    //   write of temp will take us below
+    int wfd = ring_get_writer_fd(buf, buf->length - sizeof(temp) + 1);
+    ring_reader_unlock(buf);
+
+    // empty ring: nothing to read, room to write
+    res |= fd_is_readable(rfd);
+    res |= !fd_is_readable(wfd);
+
+    ring_write(buf, temp, sizeof(temp));
+    res |= !fd_is_readable(rfd);
+    res |= fd_is_readable(wfd);
+
+    ring_read(buf, temp, sizeof(temp));
+    res |= fd_is_readable(rfd);
+    res |= !fd_is_readable(wfd);
+
+    // closed rings wake everyone up
+    ring_close(buf);
+    res |= !fd_is_readable(rfd);
+    res |= !fd_is_readable(wfd);
+
+    ring_destroy(buf);
+    return res;
+}
 
 int main() {
     srand(time(NULL));
@@ -156,5 +194,10 @@ int main() {
     res = res ? res : read_sum != write_sum;
 
     ring_destroy(buf);
+
+    int fd_res = test_notify_fd();
+    printf("notify fd test passed: %s\n", fd_res ? "FALSE" : "TRUE");
+    res = res ? res : fd_res;
+
     return res;
 }
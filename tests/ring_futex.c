@@ -0,0 +1,284 @@
+#include "quiet/ring_futex.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+#include <poll.h>
+
+typedef struct {
+    ring *buf;
+    size_t write_len;
+    bool multi;
+} arg_t;
+
+const uint8_t seq_len = 231; // make this non power of 2 to force buffer variations
+
+// both sides run in blocking mode, so every call should complete without retrying
+
+void *write_sequence(void *arg_void) {
+    arg_t *arg = (arg_t*)arg_void;
+    ring *buf = arg->buf;
+    size_t write_len = arg->write_len;
+    uint8_t seq = 0;
+    size_t temp_len = 16;
+    uint8_t *temp = malloc(temp_len * sizeof(uint8_t));
+    int *res = malloc(1 * sizeof(int));
+    *res = 0;
+    for (size_t i = 0; i < write_len; ) {
+        size_t nitems = rand() % 16 + 1;
+        if (i + nitems > write_len) {
+            nitems = write_len - i;
+        }
+        for (size_t j = 0; j < nitems; j++) {
+            temp[j] = seq;
+            *res += seq;
+            seq++;
+            seq %= seq_len;
+        }
+        ring_writer_lock(buf);
+        ssize_t nwritten = ring_write(buf, temp, nitems);
+        ring_writer_unlock(buf);
+        if (nwritten != nitems) {
+            printf("blocking write failed: %zd\n", nwritten);
+            *res = -1;
+            break;
+        }
+        i += nitems;
+    }
+    free(temp);
+    pthread_exit(res);
+    return NULL;
+}
+
+void *read_sequence(void *arg_void) {
+    arg_t *arg = (arg_t*)arg_void;
+    ring *buf = arg->buf;
+    size_t write_len = arg->write_len;
+    size_t temp_len = 16;
+    uint8_t *temp = malloc(temp_len * sizeof(uint8_t));
+    uint8_t seq = 0;
+    int *res = malloc(1 * sizeof(int));
+    *res = 0;
+    for (size_t i = 0; i < write_len; ) {
+        size_t nitems = rand() % 16 + 1;
+        if (i + nitems > write_len) {
+            nitems = write_len - i;
+        }
+        ring_reader_lock(buf);
+        ssize_t nread = ring_read(buf, temp, nitems);
+        ring_reader_unlock(buf);
+        if (nread != nitems) {
+            printf("blocking read failed: %zd\n", nread);
+            *res = -1;
+            break;
+        }
+        for (size_t j = 0; j < nitems; j++) {
+            if (arg->multi) {
+                *res += temp[j];
+            } else {
+                if (temp[j] != seq) {
+                    printf("mismatch at %zu: %u != %u\n", i + j, temp[j], seq);
+                    free(temp);
+                    *res = 1;
+                    pthread_exit(res);
+                    return NULL;
+                }
+            }
+            seq++;
+            seq %= seq_len;
+        }
+        i += nitems;
+    }
+    free(temp);
+    pthread_exit(res);
+    return NULL;
+}
+
+double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int test_timeout() {
+    ring *buf = ring_create(64);
+    uint8_t temp[16];
+    int res = 0;
+
+    ring_reader_lock(buf);
+    ring_set_reader_blocking(buf, 0, 20000000);
+    double start = now_seconds();
+    ssize_t nread = ring_read(buf, temp, sizeof(temp));
+    double elapsed = now_seconds() - start;
+    ring_reader_unlock(buf);
+    res |= (nread != RingErrorTimedout);
+    res |= (elapsed < 0.019);
+
+    // fill the ring so that the writer has to wait too
+    ring_writer_lock(buf);
+    ring_set_writer_blocking(buf, 0, 20000000);
+    for (size_t i = 0; i < buf->length / sizeof(temp); i++) {
+        ring_write(buf, temp, sizeof(temp));
+    }
+    start = now_seconds();
+    ssize_t nwritten = ring_write(buf, temp, sizeof(temp));
+    elapsed = now_seconds() - start;
+    ring_writer_unlock(buf);
+    res |= (nwritten != RingErrorTimedout);
+    res |= (elapsed < 0.019);
+
+    ring_destroy(buf);
+    return res;
+}
+
+void *read_until_closed(void *arg_void) {
+    ring *buf = (ring*)arg_void;
+    uint8_t temp[16];
+    ssize_t *res = malloc(sizeof(ssize_t));
+    ring_reader_lock(buf);
+    *res = ring_read(buf, temp, sizeof(temp));
+    ring_reader_unlock(buf);
+    pthread_exit(res);
+    return NULL;
+}
+
+int test_close_wakes_reader() {
+    ring *buf = ring_create(64);
+    ring_reader_lock(buf);
+    ring_set_reader_blocking(buf, 0, 0);
+    ring_reader_unlock(buf);
+
+    pthread_t r;
+    pthread_create(&r, NULL, read_until_closed, buf);
+    struct timespec delay = { .tv_sec = 0, .tv_nsec = 20000000 };
+    nanosleep(&delay, NULL);
+
+    // the sleeping reader must have let go of the reader lock
+    ring_reader_lock(buf);
+    ring_close(buf);
+    ring_reader_unlock(buf);
+
+    void *res_p;
+    pthread_join(r, &res_p);
+    int res = (*(ssize_t*)res_p != 0);
+    free(res_p);
+    ring_destroy(buf);
+    return res;
+}
+
+bool fd_is_readable(int fd) {
+    struct pollfd p = { .fd = fd, .events = POLLIN };
+    return poll(&p, 1, 0) == 1 && (p.revents & POLLIN);
+}
+
+int test_notify_fd() {
+    ring *buf = ring_create(64);
+    uint8_t temp[48] = { 0 };
+    int res = 0;
+
+    int rfd = ring_get_reader_fd(buf);
+    // rings may round their length up, so pick a threshold that one
+    //   write of temp will take us below
+    int wfd = ring_get_writer_fd(buf, buf->length - sizeof(temp) + 1);
+
+    // empty ring: nothing to read, room to write
+    res |= fd_is_readable(rfd);
+    res |= !fd_is_readable(wfd);
+
+    ring_write(buf, temp, sizeof(temp));
+    res |= !fd_is_readable(rfd);
+    res |= fd_is_readable(wfd);
+
+    ring_read(buf, temp, sizeof(temp));
+    res |= fd_is_readable(rfd);
+    res |= !fd_is_readable(wfd);
+
+    // closed rings wake everyone up
+    ring_close(buf);
+    res |= !fd_is_readable(rfd);
+    res |= !fd_is_readable(wfd);
+
+    ring_destroy(buf);
+    return res;
+}
+
+int main() {
+    srand(time(NULL));
+    ring *buf = ring_create(1 << 14);
+    ring_set_exclusive_writer(buf);
+    ring_set_exclusive_reader(buf);
+    ring_set_reader_blocking(buf, 0, 0);
+    ring_set_writer_blocking(buf, 0, 0);
+    pthread_t w, w1, r, r1;
+
+    // first we do a test with a single writer, single reader
+    // in this test, the reader will ensure the sequence appears
+    // strictly in the same order it is written
+    arg_t args = {
+        .buf = buf,
+        .write_len = 1 << 22,
+        .multi = false,
+    };
+    pthread_create(&w, NULL, write_sequence, &args);
+    pthread_create(&r, NULL, read_sequence, &args);
+
+    int res;
+    void *res_p;
+    pthread_join(w, &res_p);
+    res = *(int*)res_p < 0;
+    free(res_p);
+    pthread_join(r, &res_p);
+    res = res ? res : *(int*)res_p;
+    free(res_p);
+    ring_destroy(buf);
+
+    printf("single reader, single writer test passed: %s\n", res ? "FALSE" : "TRUE");
+
+    // now do 2 writers, 2 readers
+    // we relax the sequence restriction and now just look for the same sums
+    buf = ring_create(1 << 14);
+    ring_set_reader_blocking(buf, 0, 0);
+    ring_set_writer_blocking(buf, 0, 0);
+    args.buf = buf;
+    args.multi = true;
+
+    pthread_create(&w, NULL, write_sequence, &args);
+    pthread_create(&w1, NULL, write_sequence, &args);
+    pthread_create(&r, NULL, read_sequence, &args);
+    pthread_create(&r1, NULL, read_sequence, &args);
+
+    int write_sum = 0;
+    pthread_join(w, &res_p);
+    write_sum += *(int*)res_p;
+    free(res_p);
+    pthread_join(w1, &res_p);
+    write_sum += *(int*)res_p;
+    free(res_p);
+    int read_sum = 0;
+    pthread_join(r, &res_p);
+    read_sum += *(int*)res_p;
+    free(res_p);
+    pthread_join(r1, &res_p);
+    read_sum += *(int*)res_p;
+    free(res_p);
+
+    printf("2 reader, 2 writer test passed: %s\n", (read_sum != write_sum) ? "FALSE" : "TRUE");
+    res = res ? res : read_sum != write_sum;
+
+    ring_destroy(buf);
+
+    int timeout_res = test_timeout();
+    printf("timeout test passed: %s\n", timeout_res ? "FALSE" : "TRUE");
+    res = res ? res : timeout_res;
+
+    int close_res = test_close_wakes_reader();
+    printf("close wakes reader test passed: %s\n", close_res ? "FALSE" : "TRUE");
+    res = res ? res : close_res;
+
+    int fd_res = test_notify_fd();
+    printf("notify fd test passed: %s\n", fd_res ? "FALSE" : "TRUE");
+    res = res ? res : fd_res;
+
+    return res;
+}
@@ -0,0 +1,206 @@
+#include "quiet/sar.h"
+
+#include <stdio.h>
+
+#define SEGMENT_PAYLOAD_LEN 16
+
+typedef struct {
+    uint8_t buf[SAR_HEADER_LEN + SEGMENT_PAYLOAD_LEN];
+    size_t len;
+} segment_t;
+
+// split msg the same way quiet_encoder_send_message does
+static size_t segment_message(uint16_t id, const uint8_t *msg, size_t len, segment_t *segments) {
+    size_t count = len ? (len + SEGMENT_PAYLOAD_LEN - 1) / SEGMENT_PAYLOAD_LEN : 1;
+    sar_header h = {
+        .id = id,
+        .count = count,
+        .len = len,
+        .crc = sar_crc32(msg, len),
+    };
+    for (size_t i = 0; i < count; i++) {
+        h.index = i;
+        size_t seg_len = sar_segment_len(&h, i);
+        sar_header_write(segments[i].buf, &h);
+        memcpy(segments[i].buf + SAR_HEADER_LEN, msg + sar_segment_offset(&h, i), seg_len);
+        segments[i].len = SAR_HEADER_LEN + seg_len;
+    }
+    return count;
+}
+
+static void fill_message(uint8_t *msg, size_t len, uint8_t seed) {
+    for (size_t i = 0; i < len; i++) {
+        msg[i] = seed + i * 7;
+    }
+}
+
+int test_crc() {
+    const char *check = "123456789";
+    return sar_crc32((const uint8_t *)check, strlen(check)) != 0xcbf43926;
+}
+
+int test_out_of_order() {
+    sar_reassembler *r = sar_reassembler_create(4, 1 << 12);
+    uint8_t msg[100], out[100];
+    segment_t segments[8];
+    fill_message(msg, sizeof(msg), 3);
+    size_t count = segment_message(7, msg, sizeof(msg), segments);
+    int res = (count != 7);
+
+    // last first, then the rest backwards, with a duplicate thrown in
+    size_t msg_len = 0;
+    bool done = false;
+    for (size_t i = count; i-- > 1; ) {
+        done |= sar_reassembler_add(r, segments[i].buf, segments[i].len, out, sizeof(out), &msg_len);
+    }
+    done |= sar_reassembler_add(r, segments[3].buf, segments[3].len, out, sizeof(out), &msg_len);
+    res |= done;
+    done = sar_reassembler_add(r, segments[0].buf, segments[0].len, out, sizeof(out), &msg_len);
+    res |= !done || msg_len != sizeof(msg) || memcmp(msg, out, sizeof(msg));
+
+    // a single segment message completes straight away
+    count = segment_message(8, msg, 10, segments);
+    done = sar_reassembler_add(r, segments[0].buf, segments[0].len, out, sizeof(out), &msg_len);
+    res |= count != 1 || !done || msg_len != 10 || memcmp(msg, out, 10);
+
+    res |= r->dropped_messages != 0;
+    sar_reassembler_destroy(r);
+    return res;
+}
+
+int test_bounded_memory() {
+    // room for two 64 byte messages at once
+    sar_reassembler *r = sar_reassembler_create(4, 128);
+    uint8_t msg[3][64], out[64];
+    segment_t segments[3][4];
+    size_t msg_len;
+    int res = 0;
+
+    for (size_t m = 0; m < 3; m++) {
+        fill_message(msg[m], 64, m);
+        segment_message(m, msg[m], 64, segments[m]);
+        sar_reassembler_add(r, segments[m][0].buf, segments[m][0].len, out, sizeof(out), &msg_len);
+    }
+    // starting message 2 abandoned message 0
+    res |= r->dropped_messages != 1;
+
+    bool done = false;
+    for (size_t i = 1; i < 4; i++) {
+        done = sar_reassembler_add(r, segments[1][i].buf, segments[1][i].len, out, sizeof(out), &msg_len);
+    }
+    res |= !done || memcmp(msg[1], out, 64);
+
+    // too large to ever fit
+    uint8_t big[200];
+    segment_t big_segments[13];
+    fill_message(big, sizeof(big), 9);
+    segment_message(9, big, sizeof(big), big_segments);
+    res |= sar_reassembler_add(r, big_segments[0].buf, big_segments[0].len, out, sizeof(out), &msg_len);
+    res |= r->dropped_messages != 2;
+
+    sar_reassembler_destroy(r);
+    return res;
+}
+
+int test_corrupt() {
+    sar_reassembler *r = sar_reassembler_create(4, 1 << 12);
+    uint8_t msg[40], out[40];
+    segment_t segments[3];
+    size_t msg_len;
+    int res = 0;
+
+    fill_message(msg, sizeof(msg), 1);
+    size_t count = segment_message(1, msg, sizeof(msg), segments);
+    segments[1].buf[SAR_HEADER_LEN] ^= 0xff;
+    bool done = false;
+    for (size_t i = 0; i < count; i++) {
+        done |= sar_reassembler_add(r, segments[i].buf, segments[i].len, out, sizeof(out), &msg_len);
+    }
+    res |= done || r->dropped_messages != 1;
+
+    // lengths which don't agree with the header are ignored
+    segment_message(2, msg, sizeof(msg), segments);
+    res |= sar_reassembler_add(r, segments[0].buf, segments[0].len - 1, out, sizeof(out), &msg_len);
+    res |= sar_reassembler_add(r, segments[0].buf, SAR_HEADER_LEN - 1, out, sizeof(out), &msg_len);
+
+    sar_reassembler_destroy(r);
+    return res;
+}
+
+int test_parity() {
+    sar_reassembler *r = sar_reassembler_create(4, 1 << 12);
+    uint8_t msg[100], out[100];
+    fill_message(msg, sizeof(msg), 5);
+    size_t msg_len;
+    int res = 0;
+
+    // 7 data segments and 3 parity, coded the way quiet_encoder_send_message
+    //   does it, with the short last segment padded out to a full stride
+    sar_header h = {
+        .id = 3,
+        .count = 7,
+        .parity = 3,
+        .len = sizeof(msg),
+        .crc = sar_crc32(msg, sizeof(msg)),
+    };
+    size_t stride = sar_segment_stride(&h);
+    uint8_t coded[10 * SEGMENT_PAYLOAD_LEN] = {0};
+    memcpy(coded, msg, sizeof(msg));
+    erasure_encode(coded, h.count, h.parity, stride, coded + h.count * stride);
+
+    segment_t segments[10];
+    for (size_t i = 0; i < 10; i++) {
+        h.index = i;
+        size_t seg_len = sar_segment_len(&h, i);
+        sar_header_write(segments[i].buf, &h);
+        memcpy(segments[i].buf + SAR_HEADER_LEN, coded + sar_segment_offset(&h, i), seg_len);
+        segments[i].len = SAR_HEADER_LEN + seg_len;
+    }
+
+    // lose three, including the short last one, and finish on a parity segment
+    const size_t order[] = { 9, 0, 2, 3, 7, 5, 8 };
+    bool done = false;
+    for (size_t i = 0; i < sizeof(order) / sizeof(order[0]); i++) {
+        res |= done;
+        done = sar_reassembler_add(r, segments[order[i]].buf, segments[order[i]].len,
+                                   out, sizeof(out), &msg_len);
+    }
+    res |= !done || msg_len != sizeof(msg) || memcmp(msg, out, sizeof(msg));
+
+    // stragglers after the message is done are ignored, not restarted
+    res |= sar_reassembler_add(r, segments[1].buf, segments[1].len, out, sizeof(out), &msg_len);
+    res |= sar_reassembler_add(r, segments[4].buf, segments[4].len, out, sizeof(out), &msg_len);
+    for (size_t i = 0; i < r->num_slots; i++) {
+        res |= r->slots[i].in_use;
+    }
+
+    res |= r->dropped_messages != 0;
+    sar_reassembler_destroy(r);
+    return res;
+}
+
+int main() {
+    int res = 0;
+
+    int crc_res = test_crc();
+    printf("crc32 test passed: %s\n", crc_res ? "FALSE" : "TRUE");
+    res = res ? res : crc_res;
+
+    int order_res = test_out_of_order();
+    printf("out of order test passed: %s\n", order_res ? "FALSE" : "TRUE");
+    res = res ? res : order_res;
+
+    int bounded_res = test_bounded_memory();
+    printf("bounded memory test passed: %s\n", bounded_res ? "FALSE" : "TRUE");
+    res = res ? res : bounded_res;
+
+    int corrupt_res = test_corrupt();
+    printf("corrupt message test passed: %s\n", corrupt_res ? "FALSE" : "TRUE");
+    res = res ? res : corrupt_res;
+
+    int parity_res = test_parity();
+    printf("parity test passed: %s\n", parity_res ? "FALSE" : "TRUE");
+    res = res ? res : parity_res;
+
+    return res;
+}
@@ -0,0 +1,91 @@
+#include "quiet/waveform_cache.h"
+
+#include <stdio.h>
+
+// fill samples with a pattern derived from tag so entries can be told apart
+static void make_samples(sample_t *samples, size_t len, uint8_t tag) {
+    for (size_t i = 0; i < len; i++) {
+        samples[i] = tag + i * 0.5f;
+    }
+}
+
+static bool entry_matches(const waveform_cache_entry *entry, size_t len, uint8_t tag) {
+    if (!entry || entry->samples_len != len) {
+        return false;
+    }
+    sample_t expected[32];
+    make_samples(expected, len, tag);
+    return memcmp(entry->samples, expected, len * sizeof(sample_t)) == 0;
+}
+
+int test_hit_and_miss() {
+    waveform_cache *c = waveform_cache_create(4);
+    sample_t samples[32];
+    int res = 0;
+
+    uint8_t beacon[] = { 'b', 'e', 'a', 'c', 'o', 'n' };
+    res |= waveform_cache_get(c, beacon, sizeof(beacon)) != NULL;
+
+    make_samples(samples, 32, 1);
+    res |= !waveform_cache_put(c, beacon, sizeof(beacon), samples, 32);
+    // the cache keeps its own copy
+    make_samples(samples, 32, 9);
+    res |= !entry_matches(waveform_cache_get(c, beacon, sizeof(beacon)), 32, 1);
+
+    // same length, different bytes
+    uint8_t other[] = { 'b', 'e', 'a', 'c', 'o', 'm' };
+    res |= waveform_cache_get(c, other, sizeof(other)) != NULL;
+    // prefix of a cached payload
+    res |= waveform_cache_get(c, beacon, sizeof(beacon) - 1) != NULL;
+
+    // empty payloads are valid frames
+    make_samples(samples, 8, 2);
+    res |= !waveform_cache_put(c, beacon, 0, samples, 8);
+    res |= !entry_matches(waveform_cache_get(c, beacon, 0), 8, 2);
+    res |= !entry_matches(waveform_cache_get(c, beacon, sizeof(beacon)), 32, 1);
+
+    waveform_cache_clear(c);
+    res |= waveform_cache_get(c, beacon, sizeof(beacon)) != NULL;
+    res |= waveform_cache_get(c, beacon, 0) != NULL;
+
+    waveform_cache_destroy(c);
+    return res;
+}
+
+int test_evicts_least_recent() {
+    waveform_cache *c = waveform_cache_create(2);
+    sample_t samples[32];
+    int res = 0;
+
+    uint8_t a = 'a', b = 'b', d = 'd';
+    make_samples(samples, 16, 'a');
+    waveform_cache_put(c, &a, 1, samples, 16);
+    make_samples(samples, 16, 'b');
+    waveform_cache_put(c, &b, 1, samples, 16);
+
+    // touch a so that b is now the oldest
+    res |= !entry_matches(waveform_cache_get(c, &a, 1), 16, 'a');
+
+    make_samples(samples, 16, 'd');
+    waveform_cache_put(c, &d, 1, samples, 16);
+    res |= !entry_matches(waveform_cache_get(c, &a, 1), 16, 'a');
+    res |= waveform_cache_get(c, &b, 1) != NULL;
+    res |= !entry_matches(waveform_cache_get(c, &d, 1), 16, 'd');
+
+    waveform_cache_destroy(c);
+    return res;
+}
+
+int main() {
+    int res = 0;
+
+    int hit_res = test_hit_and_miss();
+    printf("hit and miss test passed: %s\n", hit_res ? "FALSE" : "TRUE");
+    res = res ? res : hit_res;
+
+    int evict_res = test_evicts_least_recent();
+    printf("least recent eviction test passed: %s\n", evict_res ? "FALSE" : "TRUE");
+    res = res ? res : evict_res;
+
+    return res;
+}